@@ -0,0 +1,99 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "include/hashmap.h"
+
+/**
+  * 批量查找的 benchmark
+  * 插入 n 个 key 后，随机查找 ops 次，分别使用 get_hashmap
+  * 和不同大小的 get_hashmap_batch，比较吞吐量
+  * 
+  * 用法: batch [n] [ops]
+  */
+
+static size_t long_hash(const void *p)
+{
+    return *((const size_t*) p) * 0x9e3779b97f4a7c15ull;
+}
+
+static int long_cmp(const void *p1, const void *p2)
+{
+    size_t a = *((const size_t*) p1), b = *((const size_t*) p2);
+    return a < b ? -1 : a > b;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const char *name, unsigned int type, size_t *keys, size_t n, size_t ops)
+{
+    struct hash_map map;
+    memset(&map, 0, sizeof(map));
+    map.hm_hash = long_hash;
+    map.hm_cmp = long_cmp;
+    map.hm_type = type;
+
+    if (set_hashmap(&map) == NULL) {
+        fprintf(stderr, "failed to init hashmap\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < n; i++) {
+        put_hashmap(&map, keys + i, keys + i, 0);
+    }
+
+    // 预先生成随机的查找序列，避免随机数的开销
+    const void **lookup = (const void**) malloc(sizeof(void*) * ops);
+    void **values = (void**) malloc(sizeof(void*) * ops);
+    unsigned int seed = 1;
+    for (size_t i = 0; i < ops; i++) {
+        lookup[i] = keys + ((size_t) rand_r(&seed) * RAND_MAX + rand_r(&seed)) % n;
+    }
+
+    double start = now_sec();
+    size_t found = 0;
+    for (size_t i = 0; i < ops; i++) {
+        found += get_hashmap(&map, lookup[i]) != NULL;
+    }
+    double single = now_sec() - start;
+    printf("%-6s n=%-9zu single       %7.1f ns/op (%zu)\n", name, n, single * 1e9 / ops, found);
+
+    static const size_t batches[] = { 16, 32, 64, 256 };
+    for (int b = 0; b < 4; b++) {
+        start = now_sec();
+        found = 0;
+        for (size_t i = 0; i < ops; i += batches[b]) {
+            size_t m = ops - i < batches[b] ? ops - i : batches[b];
+            found += get_hashmap_batch(&map, lookup + i, m, values + i);
+        }
+        double cost = now_sec() - start;
+        printf("%-6s n=%-9zu batch %-6zu %7.1f ns/op (%zu) x%.2f\n", name, n, batches[b],
+            cost * 1e9 / ops, found, single / cost);
+    }
+
+    free(lookup);
+    free(values);
+    free_hashmap(&map);
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 4000000;
+    size_t ops = argc > 2 ? strtoul(argv[2], NULL, 0) : 4000000;
+
+    size_t *keys = (size_t*) malloc(sizeof(size_t) * n);
+    for (size_t i = 0; i < n; i++)
+        keys[i] = i;
+
+    run("chain", HASHMAP_TYPE_CHAIN, keys, n, ops);
+    run("swiss", HASHMAP_TYPE_SWISS, keys, n, ops);
+
+    free(keys);
+    return 0;
+}
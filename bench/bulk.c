@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "include/hashmap.h"
+#include "include/hash.h"
+
+/**
+  * build_hashmap_bulk 的 benchmark
+  * 把 n 个随机顺序的 8 字节整数 key 装入空的 hashmap，比较逐个 put_hashmap
+  * 和不同线程数的 build_hashmap_bulk 的耗时，分别测试 malloc 和 HASHMAP_FLAG_SLAB
+  *
+  * 用法: bulk [n] [max threads]
+  */
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void init_map(struct hash_map *map, unsigned int flags)
+{
+    memset(map, 0, sizeof(struct hash_map));
+    map->hm_hash = hm_int64_hash;
+    map->hm_cmp = hm_int64_cmp;
+    map->hm_flags = flags;
+    if (set_hashmap(map) == NULL) {
+        fprintf(stderr, "failed to init hashmap\n");
+        exit(1);
+    }
+}
+
+static void run(const char *name, unsigned int flags, const void **keys, size_t n, int threads)
+{
+    struct hash_map map;
+    init_map(&map, flags);
+
+    double start = now_sec();
+    if (threads == 0) {
+        for (size_t i = 0; i < n; i++)
+            put_hashmap(&map, keys[i], keys[i], 0);
+    }
+    else if (build_hashmap_bulk(&map, keys, keys, n, threads) == -1) {
+        fprintf(stderr, "failed to build hashmap\n");
+        exit(1);
+    }
+    double cost = now_sec() - start;
+
+    if (threads == 0)
+        printf("%-6s n=%-10zu put_hashmap         %8.1f ms  %6.1f ns/key\n",
+            name, n, cost * 1e3, cost * 1e9 / n);
+    else
+        printf("%-6s n=%-10zu bulk, %2d threads    %8.1f ms  %6.1f ns/key\n",
+            name, n, threads, cost * 1e3, cost * 1e9 / n);
+    free_hashmap(&map);
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 4000000;
+    int max_threads = argc > 2 ? atoi(argv[2]) : 8;
+    unsigned int seed = 1;
+
+    uint64_t *data = (uint64_t*) malloc(sizeof(uint64_t) * n);
+    const void **keys = (const void**) malloc(sizeof(void*) * n);
+    for (size_t i = 0; i < n; i++) {
+        data[i] = i;
+    }
+    // 打乱顺序，模拟从文件中读出的无序数据
+    for (size_t i = n - 1; i > 0; i--) {
+        size_t j = ((size_t) rand_r(&seed) * RAND_MAX + rand_r(&seed)) % (i + 1);
+        uint64_t t = data[i];
+        data[i] = data[j];
+        data[j] = t;
+    }
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = data + i;
+    }
+
+    for (int slab = 0; slab < 2; slab++) {
+        const char *name = slab ? "slab" : "malloc";
+        const unsigned int flags = slab ? HASHMAP_FLAG_SLAB : 0;
+        run(name, flags, keys, n, 0);
+        for (int t = 1; t <= max_threads; t *= 2)
+            run(name, flags, keys, n, t);
+    }
+
+    free(keys);
+    free(data);
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "include/hashcache.h"
+#include "include/hash.h"
+
+/**
+  * hash_cache 的 benchmark，比较严格的 LRU 和 HASHCACHE_FLAG_CLOCK
+  * key 空间是 n，缓存能放下 n / 10 个条目，访问集中在小的 key 上
+  * (u 为 [0, 1) 的均匀分布，key = n * u^3)，没命中时插入 64 字节的 value
+  * 输出每次访问的平均耗时和命中率
+  *
+  * 用法: cache [n] [ops]
+  */
+
+static uint64_t rng_state = 0x2545f4914f6cdd1dull;
+
+static uint64_t next_rand(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const char *name, unsigned int flags, const uint64_t *keys,
+    const size_t *script, size_t n, size_t ops)
+{
+    struct hash_cache cache;
+    char value[64] = { 0 };
+    size_t hits = 0;
+
+    memset(&cache, 0, sizeof(cache));
+    cache.hc_map.hm_hash = hm_int64_hash;
+    cache.hc_map.hm_cmp = hm_int64_cmp;
+    cache.hc_max_count = n / 10;
+    cache.hc_flags = flags;
+    if (set_hashcache(&cache) == NULL) {
+        fprintf(stderr, "failed to init hash_cache\n");
+        exit(1);
+    }
+
+    double start = now_sec();
+    for (size_t i = 0; i < ops; i++) {
+        const uint64_t *key = keys + script[i];
+        if (get_hashcache(&cache, key) != NULL)
+            hits ++;
+        else
+            put_hashcache(&cache, key, value, sizeof(value));
+    }
+    double cost = now_sec() - start;
+
+    printf("%-5s n=%-9zu cap %-8zu %7.1f ns/op  hit %5.1f%%  evictions %zu\n", name, n,
+        cache.hc_max_count, cost * 1e9 / ops, hits * 100.0 / ops, cache.hc_evictions);
+    free_hashcache(&cache);
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+    size_t ops = argc > 2 ? strtoul(argv[2], NULL, 0) : 10000000;
+
+    uint64_t *keys = (uint64_t*) malloc(sizeof(uint64_t) * n);
+    size_t *script = (size_t*) malloc(sizeof(size_t) * ops);
+    if (keys == NULL || script == NULL) {
+        fprintf(stderr, "failed to malloc benchmark data\n");
+        return 1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = i;
+    }
+    for (size_t i = 0; i < ops; i++) {
+        double u = (double) (next_rand() >> 11) / (double) (1ull << 53);
+        script[i] = (size_t) (n * u * u * u);
+    }
+
+    run("lru", 0, keys, script, n, ops);
+    run("clock", HASHCACHE_FLAG_CLOCK, keys, script, n, ops);
+    free(script);
+    free(keys);
+    return 0;
+}
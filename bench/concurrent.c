@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "include/hashmap.h"
+#include "include/chashmap.h"
+
+/**
+  * 多线程混合读写的 benchmark
+  * 预先插入一半的 key，然后 1, 2, 4 ... max 个线程同时随机地
+  * get/put/remove，比较一把全局锁保护的 hash_map 和 chash_map 的吞吐量
+  * 
+  * 用法: concurrent [n] [ops 每个线程] [max 线程数] [读的百分比]
+  */
+
+static size_t long_hash(const void *p)
+{
+    return *((const size_t*) p) * 0x9e3779b97f4a7c15ull;
+}
+
+static int long_cmp(const void *p1, const void *p2)
+{
+    size_t a = *((const size_t*) p1), b = *((const size_t*) p2);
+    return a < b ? -1 : a > b;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t *keys;
+static size_t n, ops;
+static unsigned int read_pct;
+
+static struct hash_map locked_map;
+static pthread_mutex_t locked_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct chash_map cmap;
+
+static pthread_barrier_t barrier;
+
+static void* run_locked(void *arg)
+{
+    unsigned int seed = (unsigned int) (size_t) arg;
+    size_t i, hit = 0;
+
+    pthread_barrier_wait(&barrier);
+    for (i = 0; i < ops; i++) {
+        unsigned int r = rand_r(&seed);
+        size_t *key = keys + ((size_t) rand_r(&seed) * RAND_MAX + r) % n;
+        unsigned int op = r % 100;
+
+        pthread_mutex_lock(&locked_mutex);
+        if (op < read_pct)
+            hit += get_hashmap(&locked_map, key) != NULL;
+        else if (op & 1)
+            put_hashmap(&locked_map, key, key, 0);
+        else
+            remove_hashmap(&locked_map, key);
+        pthread_mutex_unlock(&locked_mutex);
+    }
+    return (void*) hit;
+}
+
+static void* run_concurrent(void *arg)
+{
+    unsigned int seed = (unsigned int) (size_t) arg;
+    size_t i, hit = 0;
+
+    pthread_barrier_wait(&barrier);
+    for (i = 0; i < ops; i++) {
+        unsigned int r = rand_r(&seed);
+        size_t *key = keys + ((size_t) rand_r(&seed) * RAND_MAX + r) % n;
+        unsigned int op = r % 100;
+
+        if (op < read_pct)
+            hit += get_chashmap(&cmap, key) != NULL;
+        else if (op & 1)
+            put_chashmap(&cmap, key, key);
+        else
+            remove_chashmap(&cmap, key);
+    }
+    return (void*) hit;
+}
+
+static double run(void* (*fn)(void*), int threads)
+{
+    pthread_t tid[threads];
+    int i;
+
+    pthread_barrier_init(&barrier, NULL, threads + 1);
+    for (i = 0; i < threads; i++)
+        pthread_create(tid + i, NULL, fn, (void*) (size_t) (i + 1));
+
+    pthread_barrier_wait(&barrier);
+    double start = now_sec();
+    for (i = 0; i < threads; i++)
+        pthread_join(tid[i], NULL);
+    double cost = now_sec() - start;
+
+    pthread_barrier_destroy(&barrier);
+    return ops * threads / cost / 1e6;
+}
+
+int main(int argc, char const *argv[])
+{
+    n = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+    ops = argc > 2 ? strtoul(argv[2], NULL, 0) : 1000000;
+    int max = argc > 3 ? atoi(argv[3]) : 64;
+    read_pct = argc > 4 ? atoi(argv[4]) : 80;
+
+    keys = (size_t*) malloc(sizeof(size_t) * n);
+    for (size_t i = 0; i < n; i++)
+        keys[i] = i;
+
+    printf("n=%zu ops=%zu read=%u%%\n", n, ops, read_pct);
+    printf("%-8s %14s %14s %8s\n", "threads", "mutex Mops/s", "chash Mops/s", "speedup");
+
+    for (int t = 1; t <= max; t <<= 1) {
+        memset(&locked_map, 0, sizeof(locked_map));
+        locked_map.hm_hash = long_hash;
+        locked_map.hm_cmp = long_cmp;
+        memset(&cmap, 0, sizeof(cmap));
+        cmap.cm_hash = long_hash;
+        cmap.cm_cmp = long_cmp;
+        if (set_hashmap(&locked_map) == NULL || set_chashmap(&cmap) == NULL) {
+            fprintf(stderr, "failed to init hashmap\n");
+            return 1;
+        }
+        for (size_t i = 0; i < n; i += 2) {
+            put_hashmap(&locked_map, keys + i, keys + i, 0);
+            put_chashmap(&cmap, keys + i, keys + i);
+        }
+
+        double locked = run(run_locked, t);
+        double concurrent = run(run_concurrent, t);
+        printf("%-8d %14.2f %14.2f %7.2fx\n", t, locked, concurrent, concurrent / locked);
+
+        free_hashmap(&locked_map);
+        free_chashmap(&cmap);
+    }
+
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,349 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "include/hashmap.h"
+#include "include/hash.h"
+
+/**
+  * 通用的 benchmark 驱动
+  * 先插入 n 个 8 字节的整数 key，然后按照指定的分布选择 key，执行 ops 次操作：
+  * 读操作是 get_hashmap，写操作先 remove_hashmap，key 不存在时改为 put_hashmap，
+  * 因此 hashmap 的大小在 n/2 到 n 之间波动，插入和删除都会被覆盖
+  *
+  * key 的分布：
+  *   uniform  均匀随机
+  *   zipf     Zipf 分布，参数由 -s 指定，热点 key 被打散到整个 key 空间
+  *   seq      按顺序循环访问
+  *   collide  均匀随机，但每 COLLIDE_GROUP 个 key 的 hash 相同，
+  *            强制链表转为红黑树，用来衡量最坏情况
+  *
+  * 输出每秒操作数，p50/p99/p999 延迟，以及插入 n 个 key 之后
+  * 每个键值对占用的堆内存 (只在 glibc 上统计，不包括 key 本身)
+  * 延迟每 SAMPLE_EVERY 次操作采样一次，避免计时本身影响吞吐量
+  *
+  * 不带参数时，依次运行一组从 L1 到内存大小的默认配置
+  * 需要测量几 GB 的 hashmap 时，使用 -n 指定，例如 -n 100000000
+  *
+  * 用法: driver [-t chain|swiss] [-f flags] [-n keys] [-o ops]
+  *              [-d uniform|zipf|seq|collide] [-r read%] [-s theta]
+  */
+
+#define SAMPLE_EVERY    16
+#define COLLIDE_GROUP   1024
+
+enum { DIST_UNIFORM, DIST_ZIPF, DIST_SEQ, DIST_COLLIDE };
+
+static const char *dist_names[] = { "uniform", "zipf", "seq", "collide" };
+
+struct config {
+    unsigned int type;
+    unsigned int flags;
+    size_t n;
+    size_t ops;
+    int dist;
+    int read;
+    double theta;
+};
+
+static uint64_t rng_state = 0x2545f4914f6cdd1dull;
+
+static uint64_t next_rand(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+  * 计时器，x86 上使用 rdtsc，最后根据总耗时换算成纳秒
+  * 两侧的 lfence 防止被计时的操作和 rdtsc 乱序执行
+  */
+static inline uint64_t now_tick(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_lfence();
+    uint64_t t = __rdtsc();
+    _mm_lfence();
+    return t;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+static size_t heap_bytes(void)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+/** 同一组的 key 得到相同的 hash */
+static size_t collide_hash(const void *key)
+{
+    return (size_t) hash_mix64(*((const uint64_t*) key) / COLLIDE_GROUP);
+}
+
+/**
+  * Zipf 分布的生成器，参考 Gray 等人的 "Quickly Generating Billion-Record
+  * Synthetic Databases"，和 YCSB 使用的方法相同
+  */
+struct zipf {
+    size_t n;
+    double theta, alpha, zetan, eta;
+};
+
+static double zeta(size_t n, double theta)
+{
+    double sum = 0;
+    for (size_t i = 1; i <= n; i++)
+        sum += 1 / pow((double) i, theta);
+    return sum;
+}
+
+static void set_zipf(struct zipf *z, size_t n, double theta)
+{
+    z->n = n;
+    z->theta = theta;
+    z->alpha = 1 / (1 - theta);
+    z->zetan = zeta(n, theta);
+    z->eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta(2, theta) / z->zetan);
+}
+
+static size_t next_zipf(struct zipf *z)
+{
+    double u = (double) (next_rand() >> 11) / (double) (1ull << 53);
+    double uz = u * z->zetan;
+    if (uz < 1)
+        return 0;
+    if (uz < 1 + pow(0.5, z->theta))
+        return 1;
+    size_t rank = (size_t) (z->n * pow(z->eta * u - z->eta + 1, z->alpha));
+    return rank < z->n ? rank : z->n - 1;
+}
+
+/**
+  * 预先生成每次操作的 key 的下标，最高位表示写操作
+  * 这样测量阶段不包含随机数的开销
+  */
+static size_t* make_script(const struct config *cfg)
+{
+    const size_t write_bit = (size_t) 1 << (sizeof(size_t) * 8 - 1);
+    size_t *script = (size_t*) malloc(sizeof(size_t) * cfg->ops);
+    struct zipf z;
+
+    if (script == NULL) {
+        return NULL;
+    }
+    if (cfg->dist == DIST_ZIPF) {
+        set_zipf(&z, cfg->n, cfg->theta);
+    }
+
+    for (size_t i = 0; i < cfg->ops; i++) {
+        size_t idx;
+        switch (cfg->dist) {
+        case DIST_ZIPF:
+            // 排名靠前的 key 不应该在 key 空间中相邻
+            idx = (size_t) (hash_mix64(next_zipf(&z)) % cfg->n);
+            break;
+        case DIST_SEQ:
+            idx = i % cfg->n;
+            break;
+        default:
+            idx = (size_t) (next_rand() % cfg->n);
+            break;
+        }
+        if ((int) (next_rand() % 100) >= cfg->read)
+            idx |= write_bit;
+        script[i] = idx;
+    }
+    return script;
+}
+
+static int cmp_tick(const void *p1, const void *p2)
+{
+    uint64_t a = *((const uint64_t*) p1), b = *((const uint64_t*) p2);
+    return a < b ? -1 : a > b;
+}
+
+static void run(const struct config *cfg)
+{
+    const size_t write_bit = (size_t) 1 << (sizeof(size_t) * 8 - 1);
+    const size_t samples_n = cfg->ops / SAMPLE_EVERY;
+    struct hash_map map;
+    size_t i;
+
+    uint64_t *keys = (uint64_t*) malloc(sizeof(uint64_t) * cfg->n);
+    uint64_t *samples = (uint64_t*) malloc(sizeof(uint64_t) * (samples_n + 1));
+    size_t *script = make_script(cfg);
+    if (keys == NULL || samples == NULL || script == NULL) {
+        fprintf(stderr, "failed to malloc benchmark data for %zu keys\n", cfg->n);
+        exit(1);
+    }
+    for (i = 0; i < cfg->n; i++)
+        keys[i] = i;
+
+    memset(&map, 0, sizeof(map));
+    map.hm_type = cfg->type;
+    map.hm_flags = cfg->flags;
+    map.hm_hash = cfg->dist == DIST_COLLIDE ? collide_hash : hm_int64_hash;
+    map.hm_cmp = hm_int64_cmp;
+    map.hm_klen = hm_int64_klen;
+
+    const size_t heap = heap_bytes();
+    if (set_hashmap(&map) == NULL) {
+        fprintf(stderr, "failed to init hashmap\n");
+        exit(1);
+    }
+    for (i = 0; i < cfg->n; i++) {
+        if (put_hashmap(&map, keys + i, keys + i, 0) == -1) {
+            fprintf(stderr, "failed to put key %zu\n", i);
+            exit(1);
+        }
+    }
+    const double per_entry = (double) (heap_bytes() - heap) / cfg->n;
+
+    const double start = now_sec();
+    const uint64_t tick = now_tick();
+    size_t found = 0, s = 0;
+
+    for (i = 0; i < cfg->ops; i++) {
+        const size_t op = script[i];
+        const uint64_t *key = keys + (op & ~write_bit);
+        uint64_t t0 = 0;
+
+        if (i % SAMPLE_EVERY == 0)
+            t0 = now_tick();
+
+        if ((op & write_bit) == 0)
+            found += get_hashmap(&map, key) != NULL;
+        else if (remove_hashmap(&map, key) == 0)
+            put_hashmap(&map, key, key, 0);
+
+        if (i % SAMPLE_EVERY == 0)
+            samples[s++] = now_tick() - t0;
+    }
+
+    const double cost = now_sec() - start;
+    const double ns_per_tick = cost * 1e9 / (double) (now_tick() - tick);
+
+    qsort(samples, s, sizeof(uint64_t), cmp_tick);
+#define _PCT(p) (s ? samples[(size_t) ((s - 1) * (p))] * ns_per_tick : 0)
+    printf("%-5s %-7s n=%-10zu read %3d%%  %8.2f Mops/s  p50 %7.0f  p99 %7.0f  p999 %8.0f ns  %6.1f B/entry  (%zu)\n",
+        cfg->type == HASHMAP_TYPE_SWISS ? "swiss" : "chain", dist_names[cfg->dist],
+        cfg->n, cfg->read, cfg->ops / cost / 1e6, _PCT(0.5), _PCT(0.99), _PCT(0.999),
+        per_entry, found);
+#undef _PCT
+
+    free_hashmap(&map);
+    free(script);
+    free(samples);
+    free(keys);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-t chain|swiss] [-f flags] [-n keys] [-o ops]\n"
+        "          [-d uniform|zipf|seq|collide] [-r read%%] [-s theta]\n", name);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    struct config cfg = { HASHMAP_TYPE_CHAIN, 0, 1000000, 4000000, DIST_UNIFORM, 100, 0.99 };
+    int opt, custom = 0;
+
+    while ((opt = getopt(argc, argv, "t:f:n:o:d:r:s:")) != -1) {
+        custom = 1;
+        switch (opt) {
+        case 't':
+            if (strcmp(optarg, "swiss") == 0)
+                cfg.type = HASHMAP_TYPE_SWISS;
+            else if (strcmp(optarg, "chain") != 0)
+                usage(argv[0]);
+            break;
+        case 'f':
+            cfg.flags = (unsigned int) strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            cfg.n = strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            cfg.ops = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            for (cfg.dist = 0; cfg.dist < 4; cfg.dist++) {
+                if (strcmp(optarg, dist_names[cfg.dist]) == 0)
+                    break;
+            }
+            if (cfg.dist == 4)
+                usage(argv[0]);
+            break;
+        case 'r':
+            cfg.read = atoi(optarg);
+            break;
+        case 's':
+            cfg.theta = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (cfg.n == 0 || cfg.read < 0 || cfg.read > 100 || cfg.theta <= 0 || cfg.theta == 1) {
+        usage(argv[0]);
+    }
+    if (custom) {
+        run(&cfg);
+        return 0;
+    }
+
+    // 默认配置：256 个 key 可以放进 L1，64K 个放进 L2/L3，1M 个需要访问内存
+    static const size_t sizes[] = { 256, 65536, 1000000 };
+    static const int reads[] = { 100, 95, 50, 0 };
+
+    cfg.ops = 2000000;
+    for (int t = 0; t < 2; t++) {
+        cfg.type = t == 0 ? HASHMAP_TYPE_CHAIN : HASHMAP_TYPE_SWISS;
+        for (int n = 0; n < 3; n++) {
+            cfg.n = sizes[n];
+            for (cfg.dist = DIST_UNIFORM; cfg.dist <= DIST_SEQ; cfg.dist++) {
+                for (int r = 0; r < 4; r++) {
+                    cfg.read = reads[r];
+                    run(&cfg);
+                }
+            }
+        }
+        cfg.n = 65536;
+        cfg.dist = DIST_COLLIDE;
+        for (int r = 0; r < 4; r += 2) {
+            cfg.read = reads[r];
+            run(&cfg);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "include/hashmap.h"
+#include "include/hash.h"
+#include "private/util.h"
+
+/**
+  * hash 函数的 benchmark
+  * 1. 分布：把 n 个 key 按照 hashmap 的方式 (spread_hash，容量 n / 0.75)
+  *    放入桶中，统计非空桶的比例、最长的链、会被转为红黑树的桶，
+  *    以及完整的 hash 值重复的次数。理想的 hash 非空桶的比例是 1 - e^(-n/cap)
+  * 2. 速度：不同长度的 key 的吞吐量
+  * 
+  * 旧的 hash 是 main.c 中的 31 * h + c，example/int_map.c 中直接使用整数，
+  * 以及直接使用地址
+  * 
+  * 用法: hash [n]
+  */
+
+static size_t old_str_hash(const void *p)
+{
+    size_t hash = 0;
+    for (const char *str = (const char*) p; *str != '\0'; str ++)
+        hash = 31 * hash + *str;
+    return hash;
+}
+
+static size_t old_int_hash(const void *p)
+{
+    return (size_t) *((const int*) p);
+}
+
+static size_t old_ptr_hash(const void *p)
+{
+    return (size_t) p;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int cmp_size(const void *p1, const void *p2)
+{
+    size_t a = *((const size_t*) p1), b = *((const size_t*) p2);
+    return a < b ? -1 : a > b;
+}
+
+static void distribution(const char *name, size_t (*hash)(const void*),
+    const void **keys, size_t n)
+{
+    const size_t cap = round_capacity((size_t) (n / HASHMAP_DEF_LOAD_FACTOR) + 1);
+    unsigned int *count = (unsigned int*) calloc(cap, sizeof(unsigned int));
+    size_t *hashes = (size_t*) malloc(sizeof(size_t) * n);
+    size_t used = 0, longest = 0, trees = 0, dup = 0, i;
+
+    for (i = 0; i < n; i++) {
+        hashes[i] = hash(keys[i]);
+        unsigned int c = ++ count[spread_hash(hashes[i]) & (cap - 1)];
+        used += c == 1;
+        trees += c == HASHMAP_DEF_TREE_THRESHOLD;
+        if (c > longest)
+            longest = c;
+    }
+    qsort(hashes, n, sizeof(size_t), cmp_size);
+    for (i = 1; i < n; i++)
+        dup += hashes[i] == hashes[i - 1];
+
+    const double ideal = 1 - exp(-(double) n / cap);
+    printf("  %-14s used %6.2f%% (ideal %5.2f%%) longest %-6zu trees %-8zu dup %zu\n",
+        name, 100.0 * used / cap, 100.0 * ideal, longest, trees, dup);
+
+    free(count);
+    free(hashes);
+}
+
+static uint64_t old_bytes_hash(const unsigned char *p, size_t len)
+{
+    uint64_t hash = 0;
+    for (size_t i = 0; i < len; i++)
+        hash = 31 * hash + p[i];
+    return hash;
+}
+
+static void throughput(size_t len)
+{
+    const size_t total = (size_t) 1 << 28;
+    const size_t rounds = total / len;
+    unsigned char *buf = (unsigned char*) malloc(len + 64);
+    uint64_t sink = 0;
+    size_t i;
+
+    for (i = 0; i < len + 64; i++)
+        buf[i] = (unsigned char) (i * 131);
+
+    double results[2], cycles[2];
+    for (int which = 0; which < 2; which++) {
+        double start = now_sec();
+#if defined(__x86_64__) || defined(__i386__)
+        uint64_t tsc = __rdtsc();
+#endif
+        for (i = 0; i < rounds; i++) {
+            // 每次错开一个字节，避免编译器把循环外提
+            // 结果只累加，不参与下一次计算，测量的是吞吐量而不是延迟
+            const unsigned char *p = buf + (i & 63);
+            sink += which ? hash_bytes(p, len, 0) : old_bytes_hash(p, len);
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        cycles[which] = (double) (__rdtsc() - tsc);
+#else
+        cycles[which] = 0;
+#endif
+        results[which] = now_sec() - start;
+    }
+
+    printf("  len %-7zu 31*h+c %7.2f GB/s %6.2f B/cyc   hash_bytes %7.2f GB/s %6.2f B/cyc  %5.1f ns/key\n",
+        len, rounds * len / results[0] / 1e9, cycles[0] ? rounds * len / cycles[0] : 0,
+        rounds * len / results[1] / 1e9, cycles[1] ? rounds * len / cycles[1] : 0,
+        results[1] * 1e9 / rounds);
+
+    if (sink == 42)
+        printf("\n");
+    free(buf);
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+    const void **keys = (const void**) malloc(sizeof(void*) * n);
+    char *strs = (char*) malloc(n * 24);
+    int *ints = (int*) malloc(sizeof(int) * n);
+    size_t i;
+
+    printf("distribution, n=%zu\n", n);
+
+    for (i = 0; i < n; i++) {
+        snprintf(strs + i * 24, 24, "user:%zu", i);
+        keys[i] = strs + i * 24;
+    }
+    printf(" strings \"user:<i>\"\n");
+    distribution("31*h+c", old_str_hash, keys, n);
+    distribution("hm_str_hash", hm_str_hash, keys, n);
+
+    for (i = 0; i < n; i++) {
+        snprintf(strs + i * 24, 24, "%08zx", i * 0x10001);
+        keys[i] = strs + i * 24;
+    }
+    printf(" strings \"%%08x\" of i * 0x10001\n");
+    distribution("31*h+c", old_str_hash, keys, n);
+    distribution("hm_str_hash", hm_str_hash, keys, n);
+
+    for (i = 0; i < n; i++) {
+        ints[i] = (int) (i << 12);
+        keys[i] = ints + i;
+    }
+    printf(" ints i << 12\n");
+    distribution("identity", old_int_hash, keys, n);
+    distribution("hm_int_hash", hm_int_hash, keys, n);
+
+    for (i = 0; i < n; i++)
+        keys[i] = malloc(48);
+    printf(" pointers from malloc(48)\n");
+    distribution("address", old_ptr_hash, keys, n);
+    distribution("hm_ptr_hash", hm_ptr_hash, keys, n);
+    for (i = 0; i < n; i++)
+        free((void*) keys[i]);
+
+    printf("throughput\n");
+    static const size_t lens[] = { 4, 8, 16, 32, 64, 128, 256, 1024, 4096, 65536 };
+    for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++)
+        throughput(lens[i]);
+
+    free(keys);
+    free(strs);
+    free(ints);
+    return 0;
+}
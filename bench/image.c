@@ -0,0 +1,128 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "include/hashmap.h"
+#include "include/hash.h"
+
+/**
+  * save_hashmap 和 load_hashmap 的 benchmark
+  * 插入 n 个 8 字节的整数 key 和 8 字节的 value，保存到文件中，然后比较：
+  *   rebuild  重新 put_hashmap n 次，即没有快照时的启动方式
+  *   load     load_hashmap 映射文件
+  * 以及加载之后随机 get_hashmap 的吞吐量，和第一次修改每个桶时复制的开销
+  *
+  * 用法: image [n] [ops] [path]
+  */
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void init_map(struct hash_map *map)
+{
+    memset(map, 0, sizeof(struct hash_map));
+    map->hm_hash = hm_int64_hash;
+    map->hm_cmp = hm_int64_cmp;
+    map->hm_klen = hm_int64_klen;
+    map->hm_flags = HASHMAP_FLAG_KEYCOPY;
+}
+
+static double run_gets(struct hash_map *map, const uint64_t *keys, size_t n, size_t ops)
+{
+    unsigned int seed = 1;
+    size_t found = 0;
+
+    const double start = now_sec();
+    for (size_t i = 0; i < ops; i++) {
+        const uint64_t *v = (const uint64_t*) get_hashmap(map, keys + rand_r(&seed) % n);
+        found += v != NULL && *v != 0;
+    }
+    const double cost = now_sec() - start;
+    if (found != ops) {
+        fprintf(stderr, "lost %zu keys\n", ops - found);
+        exit(1);
+    }
+    return cost;
+}
+
+int main(int argc, char const *argv[])
+{
+    const size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+    const size_t ops = argc > 2 ? strtoul(argv[2], NULL, 0) : 4000000;
+    const char *path = argc > 3 ? argv[3] : "/tmp/hashmap.image";
+    struct hash_map map;
+    double start;
+
+    uint64_t *keys = (uint64_t*) malloc(sizeof(uint64_t) * n);
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = i;
+    }
+
+    start = now_sec();
+    init_map(&map);
+    set_hashmap(&map);
+    for (size_t i = 0; i < n; i++) {
+        uint64_t v = i + 1;
+        put_hashmap(&map, keys + i, &v, sizeof(v));
+    }
+    const double rebuild = now_sec() - start;
+    const double get_heap = run_gets(&map, keys, n, ops);
+
+    int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    start = now_sec();
+    if (fd == -1 || save_hashmap(&map, fd) == -1) {
+        fprintf(stderr, "failed to save %s\n", path);
+        return 1;
+    }
+    const double save = now_sec() - start;
+    const off_t length = lseek(fd, 0, SEEK_CUR);
+    close(fd);
+    free_hashmap(&map);
+#ifdef __GLIBC__
+    // 否则释放的节点会在下一次分配大块内存时合并，被计入 load 的耗时
+    malloc_trim(0);
+#endif
+
+    start = now_sec();
+    init_map(&map);
+    if (load_hashmap(&map, path) == -1) {
+        fprintf(stderr, "failed to load %s\n", path);
+        return 1;
+    }
+    const double load = now_sec() - start;
+    const double get_image = run_gets(&map, keys, n, ops);
+
+    // 每次 put 都落在还没有被复制的桶上时，测量复制桶的开销
+    start = now_sec();
+    for (size_t i = 0; i < n; i++) {
+        uint64_t v = i + 2;
+        put_hashmap(&map, keys + i, &v, sizeof(v));
+    }
+    const double thaw = now_sec() - start;
+    const double get_thawed = run_gets(&map, keys, n, ops);
+    free_hashmap(&map);
+    unlink(path);
+
+    printf("n=%zu, image %.1f MB\n", n, length / 1e6);
+    printf("  rebuild %8.2f ms   save %8.2f ms   load %8.3f ms\n",
+        rebuild * 1e3, save * 1e3, load * 1e3);
+    printf("  get: heap %6.1f ns/op   image %6.1f ns/op   thawed %6.1f ns/op\n",
+        get_heap * 1e9 / ops, get_image * 1e9 / ops, get_thawed * 1e9 / ops);
+    printf("  put after load (thaw) %6.1f ns/op\n", thaw * 1e9 / n);
+
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "include/hashmap.h"
+#include "include/hash.h"
+
+/**
+  * 侵入式接口的 benchmark
+  * 记录已经在调用者的数组中，比较三种插入方式：
+  *   copy      put_hashmap 保存 64 字节记录的副本
+  *   address   put_hashmap 只保存记录的地址，仍然为每个键值对分配节点
+  *   intrusive put_hashmap_node 直接链接记录中的 rb_node，不分配内存
+  * 然后用相同的 key 查找，最后逐个移除
+  *
+  * 用法: intrusive [n]
+  */
+
+struct record {
+    uint64_t id;
+    char payload[56];
+    struct rb_node node;
+};
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void init(struct hash_map *map)
+{
+    memset(map, 0, sizeof(*map));
+    map->hm_hash = hm_int64_hash;
+    map->hm_cmp = hm_int64_cmp;
+    if (set_hashmap(map) == NULL) {
+        fprintf(stderr, "failed to init hashmap\n");
+        exit(1);
+    }
+}
+
+static void run(const char *name, struct record *recs, size_t n, int mode)
+{
+    struct hash_map map;
+    size_t i, found = 0;
+
+    init(&map);
+    double t0 = now_sec();
+    for (i = 0; i < n; i++) {
+        struct record *r = recs + i;
+        if (mode == 0)
+            put_hashmap(&map, &r->id, r, offsetof(struct record, node));
+        else if (mode == 1)
+            put_hashmap(&map, &r->id, r, 0);
+        else
+            put_hashmap_node(&map, &r->node, &r->id, r, NULL);
+    }
+    double t1 = now_sec();
+    for (i = 0; i < n; i++) {
+        if (mode == 2) {
+            struct rb_node *node = get_hashmap_node(&map, &recs[i].id);
+            found += node != NULL && hashmap_entry(node, struct record, node)->id == i;
+        }
+        else {
+            struct record *r = (struct record*) get_hashmap(&map, &recs[i].id);
+            found += r != NULL && r->id == i;
+        }
+    }
+    double t2 = now_sec();
+    for (i = 0; i < n; i++) {
+        if (mode == 2)
+            remove_hashmap_node(&map, &recs[i].node);
+        else
+            remove_hashmap(&map, &recs[i].id);
+    }
+    double t3 = now_sec();
+
+    printf("%-9s n=%-9zu put %6.1f ns  get %6.1f ns  remove %6.1f ns  (%zu)\n", name, n,
+        (t1 - t0) * 1e9 / n, (t2 - t1) * 1e9 / n, (t3 - t2) * 1e9 / n, found);
+    free_hashmap(&map);
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 2000000;
+
+    struct record *recs = (struct record*) calloc(n, sizeof(struct record));
+    if (recs == NULL) {
+        fprintf(stderr, "failed to malloc %zu records\n", n);
+        return 1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        recs[i].id = i;
+    }
+
+    run("copy", recs, n, 0);
+    run("address", recs, n, 1);
+    run("intrusive", recs, n, 2);
+    free(recs);
+    return 0;
+}
@@ -0,0 +1,97 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "include/hashmap.h"
+#include "include/hash.h"
+
+/**
+  * HASHMAP_FLAG_KEYCOPY 的 benchmark
+  * 插入 n 个形如 "user:123456" 的短字符串，key 分别单独分配并打乱顺序，
+  * 模拟调用者的 key 分散在堆中的情况。然后用内容相同、地址不同的 key
+  * 随机查找 ops 次，比较保存 key 的指针和保存 key 的副本的吞吐量
+  * 查找用的 key 连续地排列在数组中，避免它们自己的 cache miss 掩盖差别
+  *
+  * 用法: keycopy [n] [ops]
+  */
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#define KEY_SIZE 24
+
+static void run(const char *name, unsigned int flags, char **keys, size_t n,
+    char (*lookup)[KEY_SIZE], size_t ops)
+{
+    struct hash_map map;
+    memset(&map, 0, sizeof(map));
+    map.hm_hash = hm_str_hash;
+    map.hm_cmp = hm_str_cmp;
+    map.hm_klen = hm_str_klen;
+    map.hm_flags = flags;
+
+    if (set_hashmap(&map) == NULL) {
+        fprintf(stderr, "failed to init hashmap\n");
+        exit(1);
+    }
+
+    double start = now_sec();
+    for (size_t i = 0; i < n; i++) {
+        put_hashmap(&map, keys[i], keys + i, 0);
+    }
+    double put = now_sec() - start;
+
+    start = now_sec();
+    size_t found = 0;
+    for (size_t i = 0; i < ops; i++) {
+        found += get_hashmap(&map, lookup[i]) != NULL;
+    }
+    double get = now_sec() - start;
+
+    printf("%-8s n=%-9zu put %7.1f ns/op   get %7.1f ns/op (%zu)\n", name, n,
+        put * 1e9 / n, get * 1e9 / ops, found);
+    free_hashmap(&map);
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+    size_t ops = argc > 2 ? strtoul(argv[2], NULL, 0) : 4000000;
+    unsigned int seed = 1;
+    char buf[32];
+
+    // 每个 key 单独分配，再打乱，使相邻的节点指向不相邻的 key
+    char **keys = (char**) malloc(sizeof(char*) * n);
+    for (size_t i = 0; i < n; i++) {
+        snprintf(buf, sizeof(buf), "user:%zu", i);
+        keys[i] = strdup(buf);
+    }
+    for (size_t i = n - 1; i > 0; i--) {
+        size_t j = ((size_t) rand_r(&seed) * RAND_MAX + rand_r(&seed)) % (i + 1);
+        char *t = keys[i];
+        keys[i] = keys[j];
+        keys[j] = t;
+    }
+
+    // 查找使用另一份 key，内容相同，地址不同
+    char (*lookup)[KEY_SIZE] = (char(*)[KEY_SIZE]) malloc(KEY_SIZE * ops);
+    for (size_t i = 0; i < ops; i++) {
+        strcpy(lookup[i], keys[((size_t) rand_r(&seed) * RAND_MAX + rand_r(&seed)) % n]);
+    }
+
+    run("pointer", 0, keys, n, lookup, ops);
+    run("keycopy", HASHMAP_FLAG_KEYCOPY, keys, n, lookup, ops);
+
+    for (size_t i = 0; i < n; i++) {
+        free(keys[i]);
+    }
+    free(keys);
+    free(lookup);
+    return 0;
+}
@@ -0,0 +1,116 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "include/hashmap.h"
+
+/**
+  * 覆盖写的 benchmark
+  * 先插入 n 个 key，然后执行 ops 次操作，其中 80% 是覆盖已存在的 key，
+  * 其余是查找。统计测量阶段的耗时，以及 malloc/free 的调用次数
+  * 
+  * 链接时需要 -Wl,--wrap=malloc -Wl,--wrap=free
+  * 
+  * 用法: overwrite [n] [ops]
+  */
+
+void* __real_malloc(size_t size);
+void __real_free(void *ptr);
+
+static size_t malloc_calls, free_calls;
+
+void* __wrap_malloc(size_t size)
+{
+    malloc_calls ++;
+    return __real_malloc(size);
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr != NULL)
+        free_calls ++;
+    __real_free(ptr);
+}
+
+static size_t long_hash(const void *p)
+{
+    return *((const size_t*) p) * 0x9e3779b97f4a7c15ull;
+}
+
+static int long_cmp(const void *p1, const void *p2)
+{
+    size_t a = *((const size_t*) p1), b = *((const size_t*) p2);
+    return a < b ? -1 : a > b;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const char *name, unsigned int type, unsigned int flags,
+    size_t *keys, size_t n, size_t ops)
+{
+    struct hash_map map;
+    memset(&map, 0, sizeof(map));
+    map.hm_hash = long_hash;
+    map.hm_cmp = long_cmp;
+    map.hm_type = type;
+    map.hm_flags = flags;
+
+    if (set_hashmap(&map) == NULL) {
+        fprintf(stderr, "failed to init hashmap\n");
+        exit(1);
+    }
+
+    size_t val[4] = { 0 };
+    for (size_t i = 0; i < n; i++) {
+        val[0] = i;
+        put_hashmap(&map, keys + i, val, sizeof(val));
+    }
+
+    unsigned int seed = 1;
+    size_t sum = 0;
+    malloc_calls = free_calls = 0;
+
+    double start = now_sec();
+    for (size_t i = 0; i < ops; i++) {
+        size_t k = rand_r(&seed) % n;
+        if (rand_r(&seed) % 10 < 8) {
+            val[0] = i;
+            put_hashmap(&map, keys + k, val, sizeof(val));
+        }
+        else {
+            size_t *p = (size_t*) get_hashmap(&map, keys + k);
+            sum += p ? p[0] : 0;
+        }
+    }
+    double cost = now_sec() - start;
+
+    printf("%-12s %8.1f ns/op  malloc %10zu  free %10zu  (%zu)\n", name,
+        cost * 1e9 / ops, malloc_calls, free_calls, sum & 1);
+
+    free_hashmap(&map);
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 100000;
+    size_t ops = argc > 2 ? strtoul(argv[2], NULL, 0) : 2000000;
+
+    size_t *keys = (size_t*) malloc(sizeof(size_t) * n);
+    for (size_t i = 0; i < n; i++)
+        keys[i] = i;
+
+    printf("n = %zu, ops = %zu, 80%% overwrite\n", n, ops);
+    run("chain", HASHMAP_TYPE_CHAIN, 0, keys, n, ops);
+    run("chain+slab", HASHMAP_TYPE_CHAIN, HASHMAP_FLAG_SLAB, keys, n, ops);
+    run("swiss", HASHMAP_TYPE_SWISS, 0, keys, n, ops);
+
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "include/hashmap.h"
+
+/**
+  * 一个写者、多个读者的 benchmark
+  * 写者不停地随机 put/remove，1, 2, 4 ... max 个读者同时随机查找，
+  * 比较读写锁保护的 hash_map 和 HASHMAP_FLAG_RCU 的读吞吐量
+  * 
+  * 用法: rcu [n] [ops 每个读者] [max 读者数]
+  */
+
+static size_t long_hash(const void *p)
+{
+    return *((const size_t*) p) * 0x9e3779b97f4a7c15ull;
+}
+
+static int long_cmp(const void *p1, const void *p2)
+{
+    size_t a = *((const size_t*) p1), b = *((const size_t*) p2);
+    return a < b ? -1 : a > b;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t *keys;
+static size_t n, ops;
+static int use_rcu, stop;
+
+static struct hash_map map;
+static pthread_rwlock_t rwlock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_barrier_t barrier;
+
+static void* run_reader(void *arg)
+{
+    unsigned int seed = (unsigned int) (size_t) arg;
+    size_t i, hit = 0;
+
+    pthread_barrier_wait(&barrier);
+    for (i = 0; i < ops; i++) {
+        size_t *key = keys + ((size_t) rand_r(&seed) * RAND_MAX + rand_r(&seed)) % n;
+        if (use_rcu) {
+            hit += get_hashmap(&map, key) != NULL;
+        }
+        else {
+            pthread_rwlock_rdlock(&rwlock);
+            hit += get_hashmap(&map, key) != NULL;
+            pthread_rwlock_unlock(&rwlock);
+        }
+    }
+    return (void*) hit;
+}
+
+static void* run_writer(void *arg)
+{
+    unsigned int seed = 12345;
+    size_t writes = 0;
+
+    pthread_barrier_wait(&barrier);
+    while (! __atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+        unsigned int r = rand_r(&seed);
+        size_t *key = keys + ((size_t) rand_r(&seed) * RAND_MAX + r) % n;
+
+        if (! use_rcu)
+            pthread_rwlock_wrlock(&rwlock);
+        if (r & 1)
+            put_hashmap(&map, key, key, 0);
+        else
+            remove_hashmap(&map, key);
+        if (! use_rcu)
+            pthread_rwlock_unlock(&rwlock);
+        writes ++;
+    }
+    return (void*) writes;
+}
+
+static double run(int rcu, int readers, size_t *writes)
+{
+    pthread_t tid[readers + 1];
+    void *ret;
+    int i;
+
+    memset(&map, 0, sizeof(map));
+    map.hm_hash = long_hash;
+    map.hm_cmp = long_cmp;
+    map.hm_flags = rcu ? HASHMAP_FLAG_RCU : 0;
+    if (set_hashmap(&map) == NULL) {
+        fprintf(stderr, "failed to init hashmap\n");
+        exit(1);
+    }
+    for (size_t k = 0; k < n; k += 2)
+        put_hashmap(&map, keys + k, keys + k, 0);
+
+    use_rcu = rcu;
+    stop = 0;
+    pthread_barrier_init(&barrier, NULL, readers + 2);
+    pthread_create(tid + readers, NULL, run_writer, NULL);
+    for (i = 0; i < readers; i++)
+        pthread_create(tid + i, NULL, run_reader, (void*) (size_t) (i + 1));
+
+    pthread_barrier_wait(&barrier);
+    double start = now_sec();
+    for (i = 0; i < readers; i++)
+        pthread_join(tid[i], NULL);
+    double cost = now_sec() - start;
+
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+    pthread_join(tid[readers], &ret);
+    *writes = (size_t) ret;
+
+    pthread_barrier_destroy(&barrier);
+    free_hashmap(&map);
+    return ops * readers / cost / 1e6;
+}
+
+int main(int argc, char const *argv[])
+{
+    n = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+    ops = argc > 2 ? strtoul(argv[2], NULL, 0) : 1000000;
+    int max = argc > 3 ? atoi(argv[3]) : 64;
+
+    keys = (size_t*) malloc(sizeof(size_t) * n);
+    for (size_t i = 0; i < n; i++)
+        keys[i] = i;
+
+    printf("n=%zu ops=%zu, 1 writer\n", n, ops);
+    printf("%-8s %16s %16s %8s\n", "readers", "rwlock Mreads/s", "rcu Mreads/s", "speedup");
+
+    for (int t = 1; t <= max; t <<= 1) {
+        size_t w1, w2;
+        double locked = run(0, t, &w1);
+        double rcu = run(1, t, &w2);
+        printf("%-8d %16.2f %16.2f %7.2fx  (writes %zu / %zu)\n", t, locked, rcu, rcu / locked, w1, w2);
+    }
+
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "include/hashmap.h"
+#include "include/hash.h"
+
+/**
+  * 多线程扩容的 benchmark
+  * 插入 n 个 key，记录耗时最长的一次 put_hashmap，也就是最后一次扩容的停顿，
+  * 比较不同的 hm_threads
+  *
+  * 用法: resize [n] [max threads]
+  */
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(uint64_t *keys, size_t n, int threads)
+{
+    struct hash_map map;
+    memset(&map, 0, sizeof(map));
+    map.hm_hash = hm_int64_hash;
+    map.hm_cmp = hm_int64_cmp;
+    map.hm_threads = threads;
+    if (set_hashmap(&map) == NULL) {
+        fprintf(stderr, "failed to init hashmap\n");
+        exit(1);
+    }
+
+    double worst = 0, start = now_sec();
+    for (size_t i = 0; i < n; i++) {
+        double t = now_sec();
+        put_hashmap(&map, keys + i, keys + i, 0);
+        t = now_sec() - t;
+        if (t > worst)
+            worst = t;
+    }
+    double cost = now_sec() - start;
+
+    printf("n=%-10zu threads %2d  total %8.1f ms  worst put %8.2f ms  (cap %zu)\n",
+        n, threads, cost * 1e3, worst * 1e3, map.hm_cap);
+    free_hashmap(&map);
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 8000000;
+    int max_threads = argc > 2 ? atoi(argv[2]) : 8;
+
+    uint64_t *keys = (uint64_t*) malloc(sizeof(uint64_t) * n);
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = i;
+    }
+
+    for (int t = 1; t <= max_threads; t *= 2) {
+        run(keys, n, t);
+    }
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "include/shardmap.h"
+#include "include/hash.h"
+
+/**
+  * sharded_hash_map 的 benchmark，比较一个加锁的大 hashmap (sm_bits = 0) 和 2^bits 个分片
+  * 每个线程在 [0, n) 中随机选择 key，80% get，10% put，10% remove，
+  * 从空表开始，期间会发生多次扩容
+  * 输出吞吐量，单次操作的最大耗时 (主要来自扩容和等锁)，以及各分片的统计
+  *
+  * 用法: sharded [threads] [ops per thread] [n] [bits]
+  */
+
+struct worker {
+    struct sharded_hash_map *map;
+    const uint64_t *keys;
+    size_t n;
+    size_t ops;
+    uint64_t seed;
+    double max_op;
+};
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void* work(void *arg)
+{
+    struct worker *w = (struct worker*) arg;
+    uint64_t rng = w->seed;
+
+    for (size_t i = 0; i < w->ops; i++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+
+        const uint64_t *key = w->keys + (rng >> 8) % w->n;
+        const unsigned int op = rng & 0xff;
+        double start = now_sec();
+        if (op < 204)
+            get_sharded_hashmap(w->map, key);
+        else if (op < 230)
+            put_sharded_hashmap(w->map, key, key, 0);
+        else
+            remove_sharded_hashmap(w->map, key);
+        double cost = now_sec() - start;
+        if (cost > w->max_op)
+            w->max_op = cost;
+    }
+    return NULL;
+}
+
+static void run(unsigned int bits, size_t threads, size_t ops, const uint64_t *keys, size_t n)
+{
+    struct sharded_hash_map map;
+    memset(&map, 0, sizeof(map));
+    map.sm_bits = bits;
+    map.sm_proto.hm_hash = hm_int64_hash;
+    map.sm_proto.hm_cmp = hm_int64_cmp;
+    if (set_sharded_hashmap(&map) == NULL) {
+        fprintf(stderr, "failed to init sharded_hash_map\n");
+        exit(1);
+    }
+
+    pthread_t *tids = (pthread_t*) malloc(sizeof(pthread_t) * threads);
+    struct worker *ws = (struct worker*) malloc(sizeof(struct worker) * threads);
+    size_t t;
+
+    double start = now_sec();
+    for (t = 0; t < threads; t++) {
+        ws[t] = (struct worker) { &map, keys, n, ops, hash_mix64(t + 1), 0 };
+        pthread_create(tids + t, NULL, work, ws + t);
+    }
+    double max_op = 0;
+    for (t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+        if (ws[t].max_op > max_op)
+            max_op = ws[t].max_op;
+    }
+    double cost = now_sec() - start;
+
+    size_t min_size = (size_t) -1, max_size = 0, resizes = 0, contended = 0;
+    for (size_t i = 0; i < ((size_t) 1 << bits); i++) {
+        struct shard_stats st;
+        stat_sharded_hashmap(&map, i, &st);
+        if (st.ss_map.hs_size < min_size)
+            min_size = st.ss_map.hs_size;
+        if (st.ss_map.hs_size > max_size)
+            max_size = st.ss_map.hs_size;
+        resizes += st.ss_map.hs_resizes;
+        contended += st.ss_contended;
+    }
+
+    printf("%-5zu shards  %zu threads  %7.2f Mops/s  max op %8.1f us  "
+        "shard size %zu..%zu  resizes %zu  contended %zu\n",
+        (size_t) 1 << bits, threads, threads * ops / cost / 1e6, max_op * 1e6,
+        min_size, max_size, resizes, contended);
+
+    free_sharded_hashmap(&map);
+    free(ws);
+    free(tids);
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t threads = argc > 1 ? strtoul(argv[1], NULL, 0) : 4;
+    size_t ops = argc > 2 ? strtoul(argv[2], NULL, 0) : 1000000;
+    size_t n = argc > 3 ? strtoul(argv[3], NULL, 0) : 1000000;
+    unsigned int bits = argc > 4 ? (unsigned int) strtoul(argv[4], NULL, 0) : 6;
+
+    if (threads == 0 || n == 0) {
+        fprintf(stderr, "usage: %s [threads] [ops per thread] [n] [bits]\n", argv[0]);
+        return 1;
+    }
+
+    uint64_t *keys = (uint64_t*) malloc(sizeof(uint64_t) * n);
+    if (keys == NULL) {
+        fprintf(stderr, "failed to malloc benchmark data\n");
+        return 1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = i;
+    }
+
+    run(0, threads, ops, keys, n);
+    run(bits, threads, ops, keys, n);
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include "include/hashmap.h"
+#include "include/hashmap.hpp"
+
+/**
+  * int 作为 key 时，比较 hash_map (通过函数指针调用 hm_hash 和 hm_cmp)
+  * 和 HashMap 模板 (hash 和比较被内联) 的插入和查找耗时
+  * 两者使用相同的 hash 算法、负载因子和桶结构
+  * 
+  * 用法: template [n] [ops]
+  */
+
+static size_t int_hash(const void *p)
+{
+    return (size_t) *((const int*) p) * 0x9e3779b97f4a7c15ull;
+}
+
+static int int_cmp(const void *p1, const void *p2)
+{
+    int a = *((const int*) p1), b = *((const int*) p2);
+    return a < b ? -1 : a > b;
+}
+
+struct IntHash
+{
+    size_t operator()(int key) const
+    {
+        return (size_t) key * 0x9e3779b97f4a7c15ull;
+    }
+};
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+    size_t ops = argc > 2 ? strtoul(argv[2], NULL, 0) : 10000000;
+
+    std::vector<int> keys(n), lookup(ops);
+    unsigned int seed = 1;
+    for (size_t i = 0; i < n; i++)
+        keys[i] = (int) i;
+    for (size_t i = 0; i < ops; i++)
+        lookup[i] = (int) (((size_t) rand_r(&seed) * RAND_MAX + rand_r(&seed)) % (n * 2));
+
+    struct hash_map map;
+    memset(&map, 0, sizeof(map));
+    map.hm_hash = int_hash;
+    map.hm_cmp = int_cmp;
+    if (set_hashmap(&map) == NULL) {
+        fprintf(stderr, "failed to init hashmap\n");
+        return 1;
+    }
+
+    double start = now_sec();
+    for (size_t i = 0; i < n; i++)
+        put_hashmap(&map, &keys[i], &keys[i], sizeof(int));
+    double c_put = now_sec() - start;
+
+    start = now_sec();
+    size_t c_found = 0;
+    for (size_t i = 0; i < ops; i++)
+        c_found += get_hashmap(&map, &lookup[i]) != NULL;
+    double c_get = now_sec() - start;
+
+    HashMap<int, int, IntHash> tmap;
+
+    start = now_sec();
+    for (size_t i = 0; i < n; i++)
+        tmap.put(keys[i], keys[i]);
+    double t_put = now_sec() - start;
+
+    start = now_sec();
+    size_t t_found = 0;
+    for (size_t i = 0; i < ops; i++)
+        t_found += tmap.get(lookup[i]) != nullptr;
+    double t_get = now_sec() - start;
+
+    printf("n=%zu ops=%zu (about half of the lookups miss)\n", n, ops);
+    printf("%-10s %12s %12s\n", "", "put ns/op", "get ns/op");
+    printf("%-10s %12.1f %12.1f (%zu)\n", "hash_map", c_put * 1e9 / n, c_get * 1e9 / ops, c_found);
+    printf("%-10s %12.1f %12.1f (%zu)\n", "HashMap", t_put * 1e9 / n, t_get * 1e9 / ops, t_found);
+    printf("%-10s %12.2fx %11.2fx\n", "speedup", c_put / t_put, c_get / t_get);
+
+    free_hashmap(&map);
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "include/hashmap.h"
+#include "include/hash.h"
+
+/**
+  * 红黑树的建立和拆分的 benchmark
+  * 每 group 个 key 的 hash 相同，桶中的节点数很快超过 tree_t，
+  * 之后的每次扩容都要拆分这些红黑树。记录插入 n 个 key 的总耗时，
+  * 耗时最长的一次 put_hashmap (即最后一次扩容)，以及扩容和转为红黑树的次数
+  *
+  * 用法: treeify [n]
+  */
+
+static size_t group = 1;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t group_hash(const void *key)
+{
+    return (size_t) hash_mix64(*((const uint64_t*) key) / group);
+}
+
+static void run(uint64_t *keys, size_t n)
+{
+    struct hash_map map;
+    struct hashmap_stats st;
+
+    memset(&map, 0, sizeof(map));
+    map.hm_hash = group_hash;
+    map.hm_cmp = hm_int64_cmp;
+    if (set_hashmap(&map) == NULL) {
+        fprintf(stderr, "failed to init hashmap\n");
+        exit(1);
+    }
+
+    double worst = 0, start = now_sec();
+    for (size_t i = 0; i < n; i++) {
+        double t = now_sec();
+        put_hashmap(&map, keys + i, keys + i, 0);
+        t = now_sec() - t;
+        if (t > worst)
+            worst = t;
+    }
+    double cost = now_sec() - start;
+
+    stat_hashmap(&map, &st);
+    printf("group %-4zu n=%-9zu put %7.1f ns/op  worst put %8.2f ms  resizes %zu  treeify %zu\n",
+        group, n, cost * 1e9 / n, worst * 1e3, st.hs_resizes, st.hs_treeify);
+    free_hashmap(&map);
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 4000000;
+
+    uint64_t *keys = (uint64_t*) malloc(sizeof(uint64_t) * n);
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = i;
+    }
+
+    static const size_t groups[] = { 1, 8, 64, 512 };
+    for (int g = 0; g < 4; g++) {
+        group = groups[g];
+        run(keys, n);
+    }
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "include/hashmap.h"
+#include "include/hash.h"
+
+/**
+  * TTL 的 benchmark，模拟 session 缓存
+  * 插入 n 个 TTL 随机分布在 [1, span] 毫秒的 session，然后时间以 1 毫秒为单位前进，
+  * 每个 tick 插入 n / span 个新的 session，并移除到期的 session，比较两种做法：
+  *   wheel  put_hashmap_ttl + 每个 tick 调用 expire_hashmap
+  *   scan   value 中保存到期时间，每 interval 个 tick 用 scan_hashmap 扫描全表
+  * 时钟由 benchmark 控制，不依赖真实时间，两种做法处理完全相同的操作序列
+  *
+  * 用法: ttl [n] [span] [interval]
+  */
+
+static uint64_t clock_now;
+
+static uint64_t fake_clock(void)
+{
+    return clock_now;
+}
+
+static uint64_t rng_state = 0x2545f4914f6cdd1dull;
+
+static uint64_t next_rand(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct scan_state {
+    const void **dead;
+    size_t n;
+};
+
+static void collect(void *key, void *value, void *arg)
+{
+    struct scan_state *st = (struct scan_state*) arg;
+    if (*((uint64_t*) value) <= clock_now)
+        st->dead[st->n ++] = key;
+}
+
+static void run(int wheel, uint64_t *keys, uint64_t *expires, size_t n,
+    size_t span, size_t interval)
+{
+    struct hash_map map;
+    memset(&map, 0, sizeof(map));
+    map.hm_hash = hm_int64_hash;
+    map.hm_cmp = hm_int64_cmp;
+    map.hm_clock = fake_clock;
+    if (set_hashmap(&map) == NULL) {
+        fprintf(stderr, "failed to init hashmap\n");
+        exit(1);
+    }
+
+    const void **dead = (const void**) malloc(sizeof(void*) * n * 2);
+    struct scan_state st = { dead, 0 };
+    const size_t ticks = span * 2, per_tick = n / span;
+    size_t next = 0, expired = 0, i;
+    double expire_cost = 0;
+
+    clock_now = 1;
+    rng_state = 0x2545f4914f6cdd1dull;
+    for (; next < n; next++) {
+        uint64_t ttl = 1 + next_rand() % span;
+        expires[next] = clock_now + ttl;
+        if (wheel)
+            put_hashmap_ttl(&map, keys + next, expires + next, 0, ttl);
+        else
+            put_hashmap(&map, keys + next, expires + next, 0);
+    }
+
+    for (size_t t = 0; t < ticks; t++) {
+        clock_now ++;
+        for (i = 0; i < per_tick; i++, next++) {
+            uint64_t ttl = 1 + next_rand() % span;
+            expires[next] = clock_now + ttl;
+            if (wheel)
+                put_hashmap_ttl(&map, keys + next, expires + next, 0, ttl);
+            else
+                put_hashmap(&map, keys + next, expires + next, 0);
+        }
+
+        double start = now_sec();
+        if (wheel) {
+            expired += expire_hashmap(&map, clock_now, 0);
+        }
+        else if (t % interval == 0) {
+            size_t cursor = 0;
+            st.n = 0;
+            do {
+                cursor = scan_hashmap(&map, cursor, 1024, collect, &st);
+            } while (cursor != 0);
+            for (i = 0; i < st.n; i++)
+                remove_hashmap(&map, st.dead[i]);
+            expired += st.n;
+        }
+        expire_cost += now_sec() - start;
+    }
+
+    printf("%-5s n=%-9zu span %-6zu expired %-9zu  expire %8.1f ns/entry  %8.1f ms total  (size %zu)\n",
+        wheel ? "wheel" : "scan", n, span, expired, expire_cost * 1e9 / (expired ? expired : 1),
+        expire_cost * 1e3, map.hm_size);
+    free_hashmap(&map);
+    free(dead);
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 200000;
+    size_t span = argc > 2 ? strtoul(argv[2], NULL, 0) : 10000;
+    size_t interval = argc > 3 ? strtoul(argv[3], NULL, 0) : 100;
+
+    if (span == 0 || interval == 0) {
+        fprintf(stderr, "usage: %s [n] [span] [interval]\n", argv[0]);
+        return 1;
+    }
+
+    // 初始的 n 个，加上 2 * span 个 tick 中每个 tick 插入的 n / span 个
+    const size_t total = n + (n / span) * span * 2;
+    uint64_t *keys = (uint64_t*) malloc(sizeof(uint64_t) * total);
+    uint64_t *expires = (uint64_t*) malloc(sizeof(uint64_t) * total);
+    if (keys == NULL || expires == NULL) {
+        fprintf(stderr, "failed to malloc benchmark data\n");
+        return 1;
+    }
+    for (size_t i = 0; i < total; i++) {
+        keys[i] = i;
+    }
+
+    run(1, keys, expires, n, span, interval);
+    run(0, keys, expires, n, span, interval);
+    free(expires);
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,516 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <memory.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "include/hashmap.h"
+#include "include/chashmap.h"
+#include "private/epoch.h"
+#include "private/util.h"
+
+#define _MALLOC(type, size) (type*) malloc(sizeof(type) * (size))
+
+#define _LOAD(p)        __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define _STORE(p, v)    __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define _CAS(p, e, v)   __atomic_compare_exchange_n(p, e, v, 0, \
+                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+
+/** 桶的头指针的最低位是锁 */
+#define _IS_LOCKED(p)   ((uintptr_t) (p) & 1)
+#define _LOCK(p)        ((struct chash_node*) ((uintptr_t) (p) | 1))
+#define _UNLOCK(p)      ((struct chash_node*) ((uintptr_t) (p) & ~(uintptr_t) 1))
+
+/** 已经搬迁到新表的桶的转发标记 */
+#define _FWD            (&fwd_node)
+
+
+struct chash_node {
+    void *key;
+    void *value;
+    size_t hash;
+    struct chash_node *next;
+};
+
+struct chash_table {
+    size_t cap;
+
+    /** 扩容时的新表，读者遇到转发标记时从这里继续查找 */
+    struct chash_table *next;
+
+    /** 还没有被认领的桶是 [0, transfer_index)，从高往低认领 */
+    size_t transfer_index;
+
+    /** 已经搬迁完成的桶的数量，达到 cap 时扩容结束 */
+    size_t transfer_done;
+
+    struct chash_node *bins[];
+};
+
+struct chash_counter {
+    long count;
+    char pad[64 - sizeof(long)];
+};
+
+static struct chash_node fwd_node;
+
+static unsigned int counter_seq;
+static __thread unsigned int counter_idx = -1;
+
+
+/**
+  * 等待其它线程释放桶的锁
+  * 持有锁的时间很短，先自旋，再让出 CPU
+  */
+static void backoff(unsigned int *spins)
+{
+    if (++ *spins < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+    else {
+        sched_yield();
+    }
+}
+
+static struct chash_table* new_table(size_t cap)
+{
+    struct chash_table *tab = (struct chash_table*) malloc(
+        sizeof(struct chash_table) + sizeof(struct chash_node*) * cap);
+    if (tab == NULL) {
+        return NULL;
+    }
+    memset(tab, 0, sizeof(struct chash_table) + sizeof(struct chash_node*) * cap);
+    tab->cap = cap;
+    return tab;
+}
+
+static struct chash_node* new_node(const void *key, size_t hash, const void *val)
+{
+    struct chash_node *node = _MALLOC(struct chash_node, 1);
+    if (node != NULL) {
+        node->key = (void*) key;
+        node->value = (void*) val;
+        node->hash = hash;
+        node->next = NULL;
+    }
+    return node;
+}
+
+/**
+  * 当前线程使用的计数器，线程第一次访问时轮流分配
+  */
+static inline struct chash_counter* get_counter(struct chash_map *map)
+{
+    if (counter_idx == (unsigned int) -1) {
+        counter_idx = __atomic_fetch_add(&counter_seq, 1, __ATOMIC_RELAXED)
+            % CHASHMAP_COUNTER_CELLS;
+    }
+    return map->cm_count + counter_idx;
+}
+
+size_t get_chashmap_size(struct chash_map *map)
+{
+    long sum = 0;
+    int i;
+    for (i = 0; i < CHASHMAP_COUNTER_CELLS; i ++) {
+        sum += __atomic_load_n(&map->cm_count[i].count, __ATOMIC_RELAXED);
+    }
+    return sum < 0 ? 0 : (size_t) sum;
+}
+
+struct chash_map* set_chashmap(struct chash_map *dst)
+{
+    struct chash_map *map = dst;
+    if (map == NULL) {
+        if ((map = _MALLOC(struct chash_map, 1)) == NULL)
+            return NULL;
+        memset(map, 0, sizeof(struct chash_map));
+    }
+
+    if (map->cm_max == 0 || map->cm_max > HASHMAP_MAX_CAPACITY)
+        map->cm_max = HASHMAP_MAX_CAPACITY;
+    else
+        map->cm_max = round_capacity(map->cm_max);
+
+    if (map->cm_cap == 0)
+        map->cm_cap = HASHMAP_DEF_CAPACITY;
+    else
+        map->cm_cap = round_capacity(map->cm_cap);
+    if (map->cm_cap > map->cm_max)
+        map->cm_cap = map->cm_max;
+
+    if (map->cm_load == 0)
+        map->cm_load = HASHMAP_DEF_LOAD_FACTOR;
+
+    if (map->cm_cmp == NULL) {
+        fprintf(stderr, "default compator selected\n");
+        map->cm_cmp = HASHMAP_DEF_COMPARE;
+    }
+    if (map->cm_hash == NULL) {
+        fprintf(stderr, "default hashcode selected\n");
+        map->cm_hash = HASHMAP_DEF_HASHCODE;
+    }
+
+    map->cm_count = _MALLOC(struct chash_counter, CHASHMAP_COUNTER_CELLS);
+    map->cm_tab = new_table(map->cm_cap);
+    if (map->cm_count == NULL || map->cm_tab == NULL) {
+        fprintf(stderr, "failed to malloc chash_map table for %zu capacity\n", map->cm_cap);
+        free(map->cm_count);
+        free(map->cm_tab);
+        map->cm_count = NULL;
+        map->cm_tab = NULL;
+        if (dst != map) free(map);
+        return NULL;
+    }
+    memset(map->cm_count, 0, sizeof(struct chash_counter) * CHASHMAP_COUNTER_CELLS);
+    pthread_mutex_init(&map->cm_lock, NULL);
+    return map;
+}
+
+/**
+  * 复制 head 到 run 之前的节点，按 hash & bit 分别插入 ln 和 hn 的头部
+  * @return 完成返回 0；分配失败返回 -1，此时已经复制的节点被释放，ln 和 hn 保持不变
+  */
+static int copy_prefix(struct chash_node *head, struct chash_node *run, size_t bit,
+    struct chash_node **ln, struct chash_node **hn)
+{
+    struct chash_node *l = *ln, *h = *hn, *p, *next;
+
+    for (p = head; p != run; p = p->next) {
+        struct chash_node *node = new_node(p->key, p->hash, p->value);
+        if (node == NULL)
+            goto fail;
+        if (p->hash & bit) {
+            node->next = h;
+            h = node;
+        }
+        else {
+            node->next = l;
+            l = node;
+        }
+    }
+    *ln = l;
+    *hn = h;
+    return 0;
+
+fail:
+    for (p = l; p != *ln; p = next) {
+        next = p->next;
+        free(p);
+    }
+    for (p = h; p != *hn; p = next) {
+        next = p->next;
+        free(p);
+    }
+    return -1;
+}
+
+/**
+  * 把旧表的第 i 个桶搬迁到新表的 i 和 i + cap 两个桶中
+  * 
+  * 正在遍历旧桶的读者不能受到影响，因此旧节点的 next 保持不变：
+  * 链表末尾去往同一个新桶的一段节点直接复用，前面的节点复制一份。
+  * 全部复制完成后才发布新桶，再把旧桶替换为转发标记，同时释放锁
+  * 复制时内存不足，就释放旧桶的锁，让其它线程继续访问它，稍后重新搬迁
+  */
+static void transfer_bin(struct chash_table *tab, struct chash_table *nt, size_t i)
+{
+    struct chash_node **bin = tab->bins + i;
+    struct chash_node *head, *run, *p, *ln, *hn;
+    const size_t bit = tab->cap;
+    size_t run_bit;
+    unsigned int spins = 0, fails = 0;
+
+    while (1) {
+        head = _LOAD(bin);
+        if (head == NULL) {
+            if (_CAS(bin, &head, _FWD))
+                return;
+            continue;
+        }
+        if (_IS_LOCKED(head) || ! _CAS(bin, &head, _LOCK(head))) {
+            backoff(&spins);
+            continue;
+        }
+
+        run = head;
+        run_bit = head->hash & bit;
+        for (p = head->next; p != NULL; p = p->next) {
+            size_t b = p->hash & bit;
+            if (b != run_bit) {
+                run_bit = b;
+                run = p;
+            }
+        }
+        ln = run_bit ? NULL : run;
+        hn = run_bit ? run : NULL;
+
+        if (copy_prefix(head, run, bit, &ln, &hn) == 0)
+            break;
+
+        // 还没有发布任何东西，释放锁之后旧桶保持原样
+        _STORE(bin, head);
+        if (fails ++ == 0)
+            fprintf(stderr, "failed to malloc chash_map node during transfer, retrying\n");
+        backoff(&spins);
+    }
+
+    _STORE(nt->bins + i, ln);
+    _STORE(nt->bins + i + bit, hn);
+    _STORE(bin, _FWD);
+
+    for (p = head; p != run; p = p->next) {
+        retire_epoch(p, NULL);
+    }
+}
+
+/**
+  * 认领并搬迁 tab 中还没有被认领的桶，直到全部被认领
+  * 完成最后一个区间的线程负责把新表设为当前表，并延迟回收旧表
+  * @return 新表
+  */
+static struct chash_table* help_transfer(struct chash_map *map, struct chash_table *tab)
+{
+    struct chash_table *nt = _LOAD(&tab->next);
+    size_t hi, lo, i;
+
+    while ((hi = _LOAD(&tab->transfer_index)) > 0) {
+        lo = hi > CHASHMAP_TRANSFER_STRIDE ? hi - CHASHMAP_TRANSFER_STRIDE : 0;
+        if (! _CAS(&tab->transfer_index, &hi, lo))
+            continue;
+
+        for (i = lo; i < hi; i ++)
+            transfer_bin(tab, nt, i);
+
+        if (__atomic_add_fetch(&tab->transfer_done, hi - lo, __ATOMIC_ACQ_REL) == tab->cap) {
+            _STORE(&map->cm_tab, nt);
+            retire_epoch(tab, NULL);
+        }
+    }
+    return nt;
+}
+
+/**
+  * 节点数量超过阈值时发起扩容，并参与搬迁
+  * 只有 tab 仍然是当前表，并且没有正在进行的扩容时才会发起
+  */
+static void try_resize(struct chash_map *map, struct chash_table *tab)
+{
+    if (tab->cap >= map->cm_max || get_chashmap_size(map) <= tab->cap * map->cm_load) {
+        return;
+    }
+
+    pthread_mutex_lock(&map->cm_lock);
+    if (_LOAD(&map->cm_tab) == tab && _LOAD(&tab->next) == NULL) {
+        struct chash_table *nt = new_table(tab->cap << 1);
+        if (nt == NULL) {
+            // 不扩容也能继续工作
+            fprintf(stderr, "failed to malloc chash_map table for %zu capacity\n", tab->cap << 1);
+        }
+        else {
+            tab->transfer_index = tab->cap;
+            tab->transfer_done = 0;
+            _STORE(&tab->next, nt);
+        }
+    }
+    pthread_mutex_unlock(&map->cm_lock);
+
+    if (_LOAD(&tab->next) != NULL) {
+        help_transfer(map, tab);
+    }
+}
+
+int put_chashmap(struct chash_map *map, const void *key, const void *val)
+{
+    const size_t hash = spread_hash(map->cm_hash(key));
+    struct chash_node *node = NULL, *head, *p, *last;
+    struct chash_node **bin;
+    struct chash_table *tab;
+    unsigned int spins = 0;
+    int ret, collide = 0;
+
+    enter_epoch();
+    tab = _LOAD(&map->cm_tab);
+
+    while (1) {
+        bin = tab->bins + (hash & (tab->cap - 1));
+        head = _LOAD(bin);
+
+        if (head == _FWD) {
+            tab = help_transfer(map, tab);
+            continue;
+        }
+        if (head == NULL) {
+            // 空桶不需要加锁
+            if (node == NULL && (node = new_node(key, hash, val)) == NULL) {
+                ret = -1;
+                break;
+            }
+            if (_CAS(bin, &head, node)) {
+                ret = 0;
+                break;
+            }
+            continue;
+        }
+        if (_IS_LOCKED(head) || ! _CAS(bin, &head, _LOCK(head))) {
+            backoff(&spins);
+            continue;
+        }
+
+        last = NULL;
+        for (p = head; p != NULL; p = p->next) {
+            if (p->hash == hash && map->cm_cmp(key, p->key) == 0)
+                break;
+            last = p;
+        }
+
+        if (p != NULL) {
+            _STORE(&p->value, (void*) val);
+            ret = 1;
+        }
+        else if (node == NULL && (node = new_node(key, hash, val)) == NULL) {
+            ret = -1;
+        }
+        else {
+            _STORE(&last->next, node);
+            collide = 1;
+            ret = 0;
+        }
+        _STORE(bin, head);
+        break;
+    }
+
+    if (ret == 0) {
+        __atomic_fetch_add(&get_counter(map)->count, 1, __ATOMIC_RELAXED);
+        // 汇总计数器需要读取所有的 cache line，只在发生碰撞时检查
+        if (collide)
+            try_resize(map, tab);
+    }
+    else if (node != NULL) {
+        // 没有被发布，可以直接释放
+        free(node);
+    }
+    leave_epoch();
+    return ret;
+}
+
+void* get_chashmap(struct chash_map *map, const void *key)
+{
+    const size_t hash = spread_hash(map->cm_hash(key));
+    struct chash_table *tab;
+    struct chash_node *p;
+    void *value = NULL;
+
+    enter_epoch();
+    tab = _LOAD(&map->cm_tab);
+
+    while (1) {
+        p = _UNLOCK(_LOAD(tab->bins + (hash & (tab->cap - 1))));
+        if (p == _FWD) {
+            tab = _LOAD(&tab->next);
+            continue;
+        }
+        for (; p != NULL; p = _LOAD(&p->next)) {
+            if (p->hash == hash && map->cm_cmp(key, p->key) == 0) {
+                value = _LOAD(&p->value);
+                break;
+            }
+        }
+        break;
+    }
+
+    leave_epoch();
+    return value;
+}
+
+int remove_chashmap(struct chash_map *map, const void *key)
+{
+    const size_t hash = spread_hash(map->cm_hash(key));
+    struct chash_node *head, *p, *prev;
+    struct chash_node **bin;
+    struct chash_table *tab;
+    unsigned int spins = 0;
+
+    enter_epoch();
+    tab = _LOAD(&map->cm_tab);
+
+    while (1) {
+        bin = tab->bins + (hash & (tab->cap - 1));
+        head = _LOAD(bin);
+
+        if (head == NULL) {
+            leave_epoch();
+            return 0;
+        }
+        if (head == _FWD) {
+            tab = help_transfer(map, tab);
+            continue;
+        }
+        if (_IS_LOCKED(head) || ! _CAS(bin, &head, _LOCK(head))) {
+            backoff(&spins);
+            continue;
+        }
+        break;
+    }
+
+    prev = NULL;
+    for (p = head; p != NULL; p = p->next) {
+        if (p->hash == hash && map->cm_cmp(key, p->key) == 0)
+            break;
+        prev = p;
+    }
+
+    // 被移除的节点的 next 保持不变，正在访问它的读者仍然可以继续前进
+    if (p != NULL) {
+        if (prev != NULL)
+            _STORE(&prev->next, p->next);
+        else
+            head = p->next;
+    }
+    _STORE(bin, head);
+
+    if (p != NULL) {
+        retire_epoch(p, NULL);
+        __atomic_fetch_sub(&get_counter(map)->count, 1, __ATOMIC_RELAXED);
+    }
+    leave_epoch();
+    return p != NULL;
+}
+
+void free_chashmap(struct chash_map *map)
+{
+    if (map == NULL || map->cm_tab == NULL) {
+        return;
+    }
+
+    struct chash_table *tab = map->cm_tab;
+    struct chash_node *p, *next;
+    size_t i;
+
+    for (i = 0; i < tab->cap; i ++) {
+        for (p = tab->bins[i]; p != NULL; p = next) {
+            next = p->next;
+            free(p);
+        }
+    }
+    free(tab);
+    free(map->cm_count);
+    pthread_mutex_destroy(&map->cm_lock);
+
+    map->cm_tab = NULL;
+    map->cm_count = NULL;
+    map->cm_cap = 0;
+}
+
+#undef _MALLOC
+#undef _LOAD
+#undef _STORE
+#undef _CAS
+#undef _IS_LOCKED
+#undef _LOCK
+#undef _UNLOCK
+#undef _FWD
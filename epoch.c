@@ -0,0 +1,264 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "private/epoch.h"
+
+/**
+  * 待回收链表的数量，分别对应最近的 3 个 epoch
+  */
+#define EPOCH_LIMBO         3
+
+/**
+  * 每个线程累计多少次 retire_epoch 之后，尝试推进一次全局 epoch
+  */
+#define EPOCH_ADVANCE_FREQ  64
+
+struct epoch_retired {
+    struct epoch_retired *next;
+    void *ptr;
+    void (*fn)(void*);
+};
+
+/**
+  * 每个线程一条记录，所有的记录组成单链表，只增不减
+  */
+struct epoch_record {
+    /** (本地 epoch << 1) | 是否处于临界区 */
+    size_t state;
+
+    /** 是否有线程正在使用这条记录 */
+    int used;
+
+    /** enter_epoch 的嵌套层数，只有所属线程访问 */
+    unsigned int depth;
+
+    struct epoch_record *next;
+
+    /** 待回收链表，以及链表中的内存被摘下时的 epoch */
+    struct epoch_retired *limbo[EPOCH_LIMBO];
+    size_t limbo_epoch[EPOCH_LIMBO];
+
+    size_t count;
+};
+
+static size_t global_epoch;
+static struct epoch_record *records;
+
+static pthread_key_t record_key;
+static pthread_once_t record_once = PTHREAD_ONCE_INIT;
+static __thread struct epoch_record *local_record;
+
+/**
+  * 无法分配记录的线程共用这条记录，而不是让整个进程退出
+  * 使用它的线程在临界区中以及修改待回收链表时持有 overflow_lock，
+  * 同一时间只有一个线程使用它。锁是递归的，允许嵌套的 enter_epoch
+  */
+static struct epoch_record overflow_record;
+static pthread_mutex_t overflow_lock;
+static __thread int local_overflow;
+
+
+static void release_record(void *arg)
+{
+    struct epoch_record *rec = (struct epoch_record*) arg;
+    __atomic_store_n(&rec->used, 0, __ATOMIC_RELEASE);
+}
+
+static void link_record(struct epoch_record *rec)
+{
+    rec->next = __atomic_load_n(&records, __ATOMIC_RELAXED);
+    while (! __atomic_compare_exchange_n(&records, &rec->next, rec, 0,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static void init_record_key(void)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_key_create(&record_key, release_record);
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&overflow_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    // 总是处于使用中，不会被 acquire_record 复用
+    overflow_record.used = 1;
+    link_record(&overflow_record);
+}
+
+static inline void lock_overflow(void)
+{
+    if (local_overflow)
+        pthread_mutex_lock(&overflow_lock);
+}
+
+static inline void unlock_overflow(void)
+{
+    if (local_overflow)
+        pthread_mutex_unlock(&overflow_lock);
+}
+
+/**
+  * 为当前线程找到一条记录，优先复用已经退出的线程留下的记录
+  */
+static struct epoch_record* acquire_record(void)
+{
+    struct epoch_record *rec;
+
+    pthread_once(&record_once, init_record_key);
+
+    for (rec = __atomic_load_n(&records, __ATOMIC_ACQUIRE); rec != NULL; rec = rec->next) {
+        int expect = 0;
+        if (__atomic_load_n(&rec->used, __ATOMIC_RELAXED) == 0 &&
+                __atomic_compare_exchange_n(&rec->used, &expect, 1, 0,
+                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            goto found;
+        }
+    }
+
+    // 记录会被多个线程频繁读取，按 cache line 对齐以免伪共享
+    if (posix_memalign((void**) &rec, 64, sizeof(struct epoch_record)) != 0) {
+        fprintf(stderr, "epoch: failed to alloc thread record, sharing the overflow record\n");
+        local_overflow = 1;
+        local_record = &overflow_record;
+        return &overflow_record;
+    }
+    memset(rec, 0, sizeof(struct epoch_record));
+    rec->used = 1;
+    link_record(rec);
+
+found:
+    pthread_setspecific(record_key, rec);
+    local_record = rec;
+    return rec;
+}
+
+static inline struct epoch_record* get_record(void)
+{
+    struct epoch_record *rec = local_record;
+    return rec != NULL ? rec : acquire_record();
+}
+
+void enter_epoch(void)
+{
+    struct epoch_record *rec = get_record();
+    lock_overflow();
+    if (rec->depth ++ == 0) {
+        size_t e = __atomic_load_n(&global_epoch, __ATOMIC_RELAXED);
+        __atomic_store_n(&rec->state, (e << 1) | 1, __ATOMIC_SEQ_CST);
+        // 之后对共享数据的读取不能被重排到 state 的写入之前
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+}
+
+void leave_epoch(void)
+{
+    struct epoch_record *rec = local_record;
+    if (-- rec->depth == 0) {
+        __atomic_store_n(&rec->state, rec->state & ~(size_t) 1, __ATOMIC_RELEASE);
+    }
+    unlock_overflow();
+}
+
+/**
+  * 如果所有处于临界区的线程都已经观察到了当前的全局 epoch，就把它加 1
+  */
+static void advance_epoch(void)
+{
+    size_t g = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+    struct epoch_record *rec;
+
+    for (rec = __atomic_load_n(&records, __ATOMIC_ACQUIRE); rec != NULL; rec = rec->next) {
+        size_t s = __atomic_load_n(&rec->state, __ATOMIC_SEQ_CST);
+        if ((s & 1) && (s >> 1) != g) {
+            return;
+        }
+    }
+    __atomic_compare_exchange_n(&global_epoch, &g, g + 1, 0,
+        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+static void free_limbo(struct epoch_retired *node)
+{
+    struct epoch_retired *next;
+    for (; node != NULL; node = next) {
+        next = node->next;
+        if (node->fn != NULL)
+            node->fn(node->ptr);
+        else
+            free(node->ptr);
+        free(node);
+    }
+}
+
+/**
+  * 回收 rec 中所有已经度过宽限期的链表
+  */
+static void reclaim_record(struct epoch_record *rec)
+{
+    size_t g = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+    int i;
+
+    for (i = 0; i < EPOCH_LIMBO; i ++) {
+        if (rec->limbo[i] != NULL && rec->limbo_epoch[i] + 2 <= g) {
+            // 先摘下整条链表，回收函数中可能再次调用 retire_epoch
+            struct epoch_retired *list = rec->limbo[i];
+            rec->limbo[i] = NULL;
+            free_limbo(list);
+        }
+    }
+}
+
+void retire_epoch(void *ptr, void (*fn)(void*))
+{
+    struct epoch_record *rec = get_record();
+    struct epoch_retired *node = (struct epoch_retired*) malloc(sizeof(struct epoch_retired));
+    if (node == NULL) {
+        // 无法安全地释放，只能泄漏
+        fprintf(stderr, "epoch: failed to alloc retired node, leaking %p\n", ptr);
+        return;
+    }
+    node->ptr = ptr;
+    node->fn = fn;
+    lock_overflow();
+
+    // 必须在 ptr 被摘下之后重新读取全局 epoch
+    size_t e = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+    int i = (int) (e % EPOCH_LIMBO);
+
+    if (rec->limbo_epoch[i] != e) {
+        // 这条链表属于 e - 3 或更早，已经可以回收
+        struct epoch_retired *list = rec->limbo[i];
+        rec->limbo[i] = NULL;
+        rec->limbo_epoch[i] = e;
+        free_limbo(list);
+    }
+    node->next = rec->limbo[i];
+    rec->limbo[i] = node;
+
+    if (++ rec->count % EPOCH_ADVANCE_FREQ == 0) {
+        advance_epoch();
+        reclaim_record(rec);
+    }
+    unlock_overflow();
+}
+
+void synchronize_epoch(void)
+{
+    struct epoch_record *rec = get_record();
+    size_t target = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST) + 2;
+
+    while (__atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST) < target) {
+        advance_epoch();
+        if (__atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST) < target)
+            sched_yield();
+    }
+    lock_overflow();
+    reclaim_record(rec);
+    unlock_overflow();
+}
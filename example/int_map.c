@@ -8,9 +8,9 @@
 
 #include "../include/hashmap.h"
 
-int int_hash(const void *p)
+size_t int_hash(const void *p)
 {
-    return *((int*) p);
+    return (size_t) *((int*) p);
 }
 
 int int_cmp(const void *p1, const void *p2)
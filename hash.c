@@ -0,0 +1,405 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/hash.h"
+
+/**
+  * 定义 HASH_SCALAR 可以强制使用标量实现，用于验证 SIMD 实现的结果
+  */
+#if defined(__SSE2__) && ! defined(HASH_SCALAR)
+#define HASH_SIMD 1
+#include <immintrin.h>
+#endif
+
+#define PRIME32_1   0x9e3779b1u
+#define PRIME32_2   0x85ebca77u
+#define PRIME32_3   0xc2b2ae3du
+#define PRIME64_1   0x9e3779b185ebca87ull
+#define PRIME64_2   0xc2b2ae3d27d4eb4full
+#define PRIME64_3   0x165667b19e3779f9ull
+#define PRIME64_4   0x85ebca77c2b2ae63ull
+#define PRIME64_5   0x27d4eb2f165667c5ull
+
+/**
+  * 长 key 每次处理一个 64 字节的条带，分成 8 个 64 位的累加器
+  * 每个条带使用的密钥向后错开 8 字节，16 个条带组成一块，
+  * 每块结束后打乱一次累加器
+  */
+#define HASH_STRIPE         64
+#define HASH_SECRET_SIZE    192
+#define HASH_BLOCK_STRIPES  ((HASH_SECRET_SIZE - HASH_STRIPE) / 8)
+#define HASH_BLOCK          (HASH_STRIPE * HASH_BLOCK_STRIPES)
+
+/** 超过这个长度的 key 使用条带累加 */
+#define HASH_SHORT_MAX      128
+
+static const unsigned char hash_secret[HASH_SECRET_SIZE] = {
+    0xdc, 0xa4, 0x85, 0x3a, 0x16, 0x6b, 0xe1, 0xc0, 0x7c, 0xc4, 0x43, 0xd4,
+    0x8d, 0xcd, 0x0a, 0x89, 0x61, 0x77, 0xc4, 0x6d, 0x8a, 0x9d, 0x88, 0xb3,
+    0x6a, 0xae, 0xf0, 0x28, 0xe5, 0x98, 0x03, 0x6a, 0x5e, 0x85, 0x8a, 0xe4,
+    0xec, 0x44, 0x83, 0x04, 0x30, 0x13, 0x87, 0x21, 0xea, 0xcf, 0x75, 0xf1,
+    0xfd, 0xc2, 0x02, 0x27, 0xf0, 0xee, 0x1c, 0x39, 0x12, 0xcb, 0x84, 0x47,
+    0xac, 0x8c, 0xaf, 0x4b, 0x8e, 0xf8, 0xa3, 0x83, 0x45, 0x74, 0x47, 0x35,
+    0x0e, 0xc9, 0xb6, 0xc6, 0x15, 0x2b, 0xcf, 0xd9, 0x1c, 0xe2, 0x5f, 0x6d,
+    0xc7, 0xac, 0x1f, 0x96, 0xf9, 0x11, 0x0f, 0xd5, 0x49, 0xab, 0x94, 0x00,
+    0xdc, 0xb6, 0xbe, 0xbd, 0x37, 0x1e, 0x21, 0xe3, 0x1a, 0x51, 0xf3, 0x4f,
+    0x27, 0x6c, 0xfe, 0x62, 0x74, 0x05, 0xdf, 0x9f, 0x32, 0x0b, 0xc3, 0x5a,
+    0x06, 0xb4, 0x65, 0x6b, 0x2c, 0x58, 0x50, 0x14, 0x91, 0xb7, 0x8e, 0x88,
+    0xc7, 0xfc, 0x30, 0x7a, 0x6e, 0x57, 0x15, 0x6a, 0xba, 0xf5, 0x40, 0x55,
+    0xe9, 0xd3, 0x96, 0x90, 0x55, 0xf0, 0xce, 0x16, 0x99, 0x48, 0x87, 0x06,
+    0x4b, 0xf1, 0xf8, 0x2c, 0x03, 0xe1, 0x2c, 0x6e, 0x3b, 0x26, 0xc9, 0xc9,
+    0x6d, 0xaa, 0x9f, 0x0a, 0x0b, 0x92, 0xff, 0xd6, 0xc1, 0x8d, 0x99, 0xdb,
+    0x97, 0x26, 0x19, 0x53, 0xd7, 0x18, 0xcd, 0xc7, 0x9b, 0x9b, 0xea, 0x73,
+};
+
+/**
+  * 按小端序读取，在大端机器上 hash 的值不同，但质量相同
+  */
+static inline uint64_t read64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t read32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+  * 128 位乘积的高 64 位和低 64 位相异或
+  */
+static inline uint64_t mum(uint64_t a, uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t) a * b;
+    return (uint64_t) r ^ (uint64_t) (r >> 64);
+#else
+    uint64_t ha = a >> 32, la = (uint32_t) a, hb = b >> 32, lb = (uint32_t) b;
+    uint64_t hh = ha * hb, hl = ha * lb, lh = la * hb, ll = la * lb;
+    uint64_t mid = (ll >> 32) + (uint32_t) hl + (uint32_t) lh;
+    uint64_t lo = (mid << 32) | (uint32_t) ll;
+    uint64_t hi = hh + (hl >> 32) + (lh >> 32) + (mid >> 32);
+    return lo ^ hi;
+#endif
+}
+
+static inline uint64_t avalanche(uint64_t h)
+{
+    h ^= h >> 37;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+/**
+  * 0 到 16 字节：读出首尾两个可能重叠的字，做一次 128 位乘法
+  */
+static inline uint64_t hash_short(const unsigned char *p, size_t len, uint64_t seed)
+{
+    uint64_t a, b;
+
+    if (len >= 8) {
+        a = read64(p);
+        b = read64(p + len - 8);
+    }
+    else if (len >= 4) {
+        a = read32(p);
+        b = read32(p + len - 4);
+    }
+    else if (len > 0) {
+        // 输入太少，让两个乘数都依赖它，乘积才能充分混合
+        a = ((uint64_t) p[0] << 16) | ((uint64_t) p[len >> 1] << 8) | p[len - 1];
+        b = a;
+    }
+    else {
+        a = b = 0;
+    }
+    // 两个乘数都混入密钥，否则 b 和 seed 都为 0 时乘积总是 0
+    uint64_t h = mum(a ^ read64(hash_secret), b ^ seed ^ read64(hash_secret + 32));
+    return mum(h ^ read64(hash_secret + 8) ^ len, h ^ read64(hash_secret + 40));
+}
+
+/**
+  * 17 到 128 字节：每 32 字节分成两条互不依赖的乘法链，
+  * 剩下的部分和最后 16 字节单独处理
+  */
+static uint64_t hash_medium(const unsigned char *p, size_t len, uint64_t seed)
+{
+    const unsigned char *q = p;
+    size_t left = len;
+    uint64_t s1 = seed, s2 = seed ^ read64(hash_secret + 56);
+
+    while (left > 32) {
+        s1 = mum(read64(q) ^ read64(hash_secret + 16), read64(q + 8) ^ s1);
+        s2 = mum(read64(q + 16) ^ read64(hash_secret + 48), read64(q + 24) ^ s2);
+        q += 32;
+        left -= 32;
+    }
+    if (left > 16)
+        s1 = mum(read64(q) ^ read64(hash_secret + 16), read64(q + 8) ^ s1);
+
+    return mum(read64(hash_secret + 8) ^ len ^ s2,
+        mum(read64(p + len - 16) ^ read64(hash_secret + 24), read64(p + len - 8) ^ s1));
+}
+
+/** 累加器的初始值 */
+static const uint64_t hash_init_acc[8] __attribute__((aligned(32))) = {
+    PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3,
+    PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1,
+};
+
+/**
+  * 下面每种实现都完整地处理所有的条带，累加器始终留在寄存器中，
+  * 最后才写回 acc：
+  *   dk = data ^ secret ^ seed
+  *   acc[i ^ 1] += data[i]
+  *   acc[i] += lo32(dk[i]) * hi32(dk[i])
+  * 每处理完一块，打乱一次累加器：
+  *   acc = (acc ^ (acc >> 47) ^ secret) * PRIME32_1
+  * 最后一个条带总是输入的最后 64 字节
+  * 
+  * seed 和密钥一起参与乘法，因此不同 seed 下的碰撞互不相关
+  */
+#ifndef HASH_SIMD
+
+static inline void stripe_scalar(uint64_t *acc, const unsigned char *data,
+    const unsigned char *key, uint64_t seed)
+{
+    for (int i = 0; i < 8; i++) {
+        uint64_t dv = read64(data + i * 8);
+        uint64_t dk = dv ^ read64(key + i * 8) ^ seed;
+        acc[i ^ 1] += dv;
+        acc[i] += (dk & 0xffffffffu) * (dk >> 32);
+    }
+}
+
+static void stripes_scalar(uint64_t *acc, const unsigned char *p, size_t len, uint64_t seed)
+{
+    const size_t blocks = (len - 1) / HASH_BLOCK;
+    const unsigned char *end_key = hash_secret + HASH_SECRET_SIZE - HASH_STRIPE;
+    size_t b, s, stripes;
+
+    memcpy(acc, hash_init_acc, sizeof(hash_init_acc));
+
+    for (b = 0; b < blocks; b++) {
+        for (s = 0; s < HASH_BLOCK_STRIPES; s++)
+            stripe_scalar(acc, p + b * HASH_BLOCK + s * HASH_STRIPE, hash_secret + s * 8, seed);
+        for (int i = 0; i < 8; i++) {
+            uint64_t a = acc[i];
+            a ^= a >> 47;
+            a ^= read64(end_key + i * 8);
+            acc[i] = a * PRIME32_1;
+        }
+    }
+
+    stripes = ((len - 1) - blocks * HASH_BLOCK) / HASH_STRIPE;
+    for (s = 0; s < stripes; s++)
+        stripe_scalar(acc, p + blocks * HASH_BLOCK + s * HASH_STRIPE, hash_secret + s * 8, seed);
+    stripe_scalar(acc, p + len - HASH_STRIPE, end_key - 7, seed);
+}
+
+#else
+
+static inline void stripe_sse2(__m128i *x, const unsigned char *data,
+    const unsigned char *key, __m128i seed)
+{
+    for (int i = 0; i < 4; i++) {
+        __m128i dv = _mm_loadu_si128((const __m128i*) data + i);
+        __m128i dk = _mm_xor_si128(dv, _mm_xor_si128(_mm_loadu_si128((const __m128i*) key + i), seed));
+        // 每个 64 位的 lane 中，低 32 位乘以高 32 位
+        __m128i prod = _mm_mul_epu32(dk, _mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1)));
+        // 交换相邻的两个 lane
+        __m128i swap = _mm_shuffle_epi32(dv, _MM_SHUFFLE(1, 0, 3, 2));
+        x[i] = _mm_add_epi64(x[i], _mm_add_epi64(prod, swap));
+    }
+}
+
+static void stripes_sse2(uint64_t *acc, const unsigned char *p, size_t len, uint64_t seed)
+{
+    const size_t blocks = (len - 1) / HASH_BLOCK;
+    const unsigned char *end_key = hash_secret + HASH_SECRET_SIZE - HASH_STRIPE;
+    const __m128i prime = _mm_set1_epi32((int) PRIME32_1);
+    const __m128i vseed = _mm_set1_epi64x((long long) seed);
+    __m128i x[4];
+    size_t b, s, stripes;
+    int i;
+
+    for (i = 0; i < 4; i++)
+        x[i] = _mm_load_si128((const __m128i*) hash_init_acc + i);
+
+    for (b = 0; b < blocks; b++) {
+        for (s = 0; s < HASH_BLOCK_STRIPES; s++)
+            stripe_sse2(x, p + b * HASH_BLOCK + s * HASH_STRIPE, hash_secret + s * 8, vseed);
+        for (i = 0; i < 4; i++) {
+            __m128i a = x[i];
+            a = _mm_xor_si128(a, _mm_srli_epi64(a, 47));
+            a = _mm_xor_si128(a, _mm_loadu_si128((const __m128i*) end_key + i));
+            // SSE2 没有 64 位乘法，拆成高低两个 32 位分别乘
+            __m128i lo = _mm_mul_epu32(a, prime);
+            __m128i hi = _mm_mul_epu32(_mm_srli_epi64(a, 32), prime);
+            x[i] = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+        }
+    }
+
+    stripes = ((len - 1) - blocks * HASH_BLOCK) / HASH_STRIPE;
+    for (s = 0; s < stripes; s++)
+        stripe_sse2(x, p + blocks * HASH_BLOCK + s * HASH_STRIPE, hash_secret + s * 8, vseed);
+    stripe_sse2(x, p + len - HASH_STRIPE, end_key - 7, vseed);
+
+    for (i = 0; i < 4; i++)
+        _mm_store_si128((__m128i*) acc + i, x[i]);
+}
+
+__attribute__((target("avx2")))
+static inline void stripe_avx2(__m256i *x, const unsigned char *data,
+    const unsigned char *key, __m256i seed)
+{
+    for (int i = 0; i < 2; i++) {
+        __m256i dv = _mm256_loadu_si256((const __m256i*) data + i);
+        __m256i dk = _mm256_xor_si256(dv, _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) key + i), seed));
+        __m256i prod = _mm256_mul_epu32(dk, _mm256_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1)));
+        __m256i swap = _mm256_shuffle_epi32(dv, _MM_SHUFFLE(1, 0, 3, 2));
+        x[i] = _mm256_add_epi64(x[i], _mm256_add_epi64(prod, swap));
+    }
+}
+
+__attribute__((target("avx2")))
+static void stripes_avx2(uint64_t *acc, const unsigned char *p, size_t len, uint64_t seed)
+{
+    const size_t blocks = (len - 1) / HASH_BLOCK;
+    const unsigned char *end_key = hash_secret + HASH_SECRET_SIZE - HASH_STRIPE;
+    const __m256i prime = _mm256_set1_epi32((int) PRIME32_1);
+    const __m256i vseed = _mm256_set1_epi64x((long long) seed);
+    __m256i x[2];
+    size_t b, s, stripes;
+    int i;
+
+    for (i = 0; i < 2; i++)
+        x[i] = _mm256_load_si256((const __m256i*) hash_init_acc + i);
+
+    for (b = 0; b < blocks; b++) {
+        for (s = 0; s < HASH_BLOCK_STRIPES; s++)
+            stripe_avx2(x, p + b * HASH_BLOCK + s * HASH_STRIPE, hash_secret + s * 8, vseed);
+        for (i = 0; i < 2; i++) {
+            __m256i a = x[i];
+            a = _mm256_xor_si256(a, _mm256_srli_epi64(a, 47));
+            a = _mm256_xor_si256(a, _mm256_loadu_si256((const __m256i*) end_key + i));
+            __m256i lo = _mm256_mul_epu32(a, prime);
+            __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), prime);
+            x[i] = _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+        }
+    }
+
+    stripes = ((len - 1) - blocks * HASH_BLOCK) / HASH_STRIPE;
+    for (s = 0; s < stripes; s++)
+        stripe_avx2(x, p + blocks * HASH_BLOCK + s * HASH_STRIPE, hash_secret + s * 8, vseed);
+    stripe_avx2(x, p + len - HASH_STRIPE, end_key - 7, vseed);
+
+    for (i = 0; i < 2; i++)
+        _mm256_store_si256((__m256i*) acc + i, x[i]);
+}
+
+#endif
+
+/**
+  * 超过 128 字节：条带累加，然后把 8 个累加器两两相乘折叠
+  */
+static uint64_t hash_long(const unsigned char *p, size_t len, uint64_t seed)
+{
+    uint64_t acc[8] __attribute__((aligned(32)));
+
+#ifdef HASH_SIMD
+    if (__builtin_cpu_supports("avx2"))
+        stripes_avx2(acc, p, len, seed);
+    else
+        stripes_sse2(acc, p, len, seed);
+#else
+    stripes_scalar(acc, p, len, seed);
+#endif
+
+    uint64_t h = len * PRIME64_1;
+    for (int i = 0; i < 4; i++) {
+        h += mum(acc[2 * i] ^ read64(hash_secret + 11 + 16 * i),
+            acc[2 * i + 1] ^ read64(hash_secret + 19 + 16 * i));
+    }
+    return avalanche(h);
+}
+
+uint64_t hash_bytes(const void *data, size_t len, uint64_t seed)
+{
+    const unsigned char *p = (const unsigned char*) data;
+
+    if (len <= 16)
+        return hash_short(p, len, seed);
+    if (len <= HASH_SHORT_MAX)
+        return hash_medium(p, len, seed);
+    return hash_long(p, len, seed);
+}
+
+size_t hm_int_hash(const void *key)
+{
+    return (size_t) hash_mix64((uint32_t) *((const int*) key));
+}
+
+int hm_int_cmp(const void *one, const void *two)
+{
+    int a = *((const int*) one), b = *((const int*) two);
+    return a < b ? -1 : a > b;
+}
+
+size_t hm_int_klen(const void *key)
+{
+    return sizeof(int);
+}
+
+size_t hm_int64_hash(const void *key)
+{
+    return (size_t) hash_mix64((uint64_t) *((const int64_t*) key));
+}
+
+int hm_int64_cmp(const void *one, const void *two)
+{
+    int64_t a = *((const int64_t*) one), b = *((const int64_t*) two);
+    return a < b ? -1 : a > b;
+}
+
+size_t hm_int64_klen(const void *key)
+{
+    return sizeof(int64_t);
+}
+
+size_t hm_ptr_hash(const void *key)
+{
+    return (size_t) hash_mix64((uintptr_t) key);
+}
+
+int hm_ptr_cmp(const void *one, const void *two)
+{
+    return one < two ? -1 : one > two;
+}
+
+size_t hm_str_hash(const void *key)
+{
+    return (size_t) hash_bytes(key, strlen((const char*) key), 0);
+}
+
+int hm_str_cmp(const void *one, const void *two)
+{
+    return strcmp((const char*) one, (const char*) two);
+}
+
+size_t hm_str_klen(const void *key)
+{
+    return strlen((const char*) key) + 1;
+}
+
+size_t hm_str_seed_hash(const void *key, size_t seed)
+{
+    return (size_t) hash_bytes(key, strlen((const char*) key), seed);
+}
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+
+#include "include/hashmap.h"
+#include "include/hashcache.h"
+#include "private/list.h"
+
+#define _MALLOC(t, n) (t*) malloc(sizeof(t) * (n))
+#define _IS_CLOCK(cache) ((cache)->hc_flags & HASHCACHE_FLAG_CLOCK)
+#define _ENTRY(p, member) hashmap_entry(p, struct cache_entry, member)
+
+/**
+  * 缓存的条目，value 的副本紧跟在后面
+  * node 通过 put_hashmap_node 链接到 hc_map 中，lru 链接到 hc_lru 中
+  */
+struct cache_entry
+{
+    struct rb_node node;
+    struct list_node lru;
+
+    /** 计入 hc_bytes 的字节数 */
+    size_t bytes;
+
+    /** HASHCACHE_FLAG_CLOCK 的访问位 */
+    unsigned char ref;
+};
+
+struct hash_cache* set_hashcache(struct hash_cache *dst)
+{
+    struct hash_cache *cache = dst;
+    if (cache == NULL) {
+        if ((cache = _MALLOC(struct hash_cache, 1)) == NULL)
+            return NULL;
+        memset(cache, 0, sizeof(struct hash_cache));
+    }
+
+    struct hash_map *map = &(cache->hc_map);
+    if (map->hm_type != HASHMAP_TYPE_CHAIN ||
+            (map->hm_flags & (HASHMAP_FLAG_KEYCOPY | HASHMAP_FLAG_RCU))) {
+        fprintf(stderr, "hash_cache needs HASHMAP_TYPE_CHAIN without KEYCOPY and RCU\n");
+        goto fail;
+    }
+    if ((cache->hc_lru = _MALLOC(struct list, 1)) == NULL) {
+        fprintf(stderr, "failed to malloc hash_cache list\n");
+        goto fail;
+    }
+    memset(cache->hc_lru, 0, sizeof(struct list));
+
+    if (set_hashmap(map) == NULL) {
+        free(cache->hc_lru);
+        cache->hc_lru = NULL;
+        goto fail;
+    }
+    cache->hc_bytes = 0;
+    cache->hc_evictions = 0;
+    return cache;
+
+fail:
+    if (dst == NULL)
+        free(cache);
+    return NULL;
+}
+
+/**
+  * 从 hashmap 和链表中摘下条目，并更新 hc_bytes，不释放内存
+  */
+static void unlink_entry(struct hash_cache *cache, struct cache_entry *entry)
+{
+    remove_hashmap_node(&(cache->hc_map), &(entry->node));
+    unlink_list(cache->hc_lru, &(entry->lru));
+    cache->hc_bytes -= entry->bytes;
+}
+
+static inline int is_full(struct hash_cache *cache)
+{
+    return (cache->hc_max_count != 0 && cache->hc_map.hm_size > cache->hc_max_count) ||
+        (cache->hc_max_bytes != 0 && cache->hc_bytes > cache->hc_max_bytes);
+}
+
+/**
+  * 从表尾开始淘汰，直到不超过容量，keep 是刚刚插入的条目，不会被淘汰
+  * CLOCK 模式下，访问位为 1 的条目清除访问位后放回表头，
+  * 每个条目最多被跳过一次，因此一次淘汰最多检查 size + 2 个条目
+  */
+static void evict_entries(struct hash_cache *cache, struct cache_entry *keep)
+{
+    struct list *lru = cache->hc_lru;
+
+    while (is_full(cache)) {
+        struct cache_entry *victim = _ENTRY(lru->ls_tail, lru);
+        if (victim == keep && lru->ls_head == lru->ls_tail) {
+            break;
+        }
+        // 其它条目都被放回表头之后，keep 可能排到表尾
+        if (victim == keep || victim->ref) {
+            victim->ref = 0;
+            move_list_head(lru, &(victim->lru));
+            continue;
+        }
+
+        unlink_entry(cache, victim);
+        cache->hc_evictions ++;
+        if (cache->hc_evict != NULL)
+            cache->hc_evict(victim->node.key, victim->node.value, cache->hc_arg);
+        free(victim);
+    }
+}
+
+int put_hashcache(struct hash_cache *cache, const void *key,
+    const void *val, size_t val_t)
+{
+    if (cache == NULL || cache->hc_lru == NULL) {
+        return -1;
+    }
+
+    const size_t mem_t = sizeof(struct cache_entry) + val_t;
+    struct cache_entry *entry = (struct cache_entry*) malloc(mem_t);
+    if (entry == NULL) {
+        fprintf(stderr, "failed to malloc cache entry\n");
+        return -1;
+    }
+    if (val_t != 0) {
+        val = memcpy(entry + 1, val, val_t);
+    }
+    entry->bytes = mem_t;
+    entry->ref = 0;
+
+    struct rb_node *old = NULL;
+    const int ret = put_hashmap_node(&(cache->hc_map), &(entry->node), key, val, &old);
+    if (ret == -1) {
+        free(entry);
+        return -1;
+    }
+    if (old != NULL) {
+        struct cache_entry *prev = _ENTRY(old, node);
+        unlink_list(cache->hc_lru, &(prev->lru));
+        cache->hc_bytes -= prev->bytes;
+        free(prev);
+    }
+
+    link_list_head(cache->hc_lru, &(entry->lru));
+    cache->hc_bytes += entry->bytes;
+    evict_entries(cache, entry);
+    return ret;
+}
+
+void* get_hashcache(struct hash_cache *cache, const void *key)
+{
+    if (cache == NULL || cache->hc_lru == NULL) {
+        return NULL;
+    }
+
+    struct rb_node *node = get_hashmap_node(&(cache->hc_map), key);
+    if (node == NULL) {
+        return NULL;
+    }
+
+    // 访问位已经是 1 时不写，避免弄脏 cache line
+    struct cache_entry *entry = _ENTRY(node, node);
+    if (! _IS_CLOCK(cache))
+        move_list_head(cache->hc_lru, &(entry->lru));
+    else if (entry->ref == 0)
+        entry->ref = 1;
+    return node->value;
+}
+
+int remove_hashcache(struct hash_cache *cache, const void *key)
+{
+    if (cache == NULL || cache->hc_lru == NULL) {
+        return -1;
+    }
+
+    struct rb_node *node = get_hashmap_node(&(cache->hc_map), key);
+    if (node == NULL) {
+        return 0;
+    }
+
+    struct cache_entry *entry = _ENTRY(node, node);
+    unlink_entry(cache, entry);
+    free(entry);
+    return 1;
+}
+
+size_t get_hashcache_size(struct hash_cache *cache)
+{
+    return cache == NULL ? 0 : cache->hc_map.hm_size;
+}
+
+void free_hashcache(struct hash_cache *cache)
+{
+    if (cache == NULL || cache->hc_lru == NULL) {
+        return;
+    }
+
+    // hashmap 只会摘下条目，先释放它，再沿着链表释放条目
+    free_hashmap(&(cache->hc_map));
+
+    struct list_node *next, *p = cache->hc_lru->ls_head;
+    for (; p != NULL; p = next) {
+        next = p->next;
+        free(_ENTRY(p, lru));
+    }
+    free(cache->hc_lru);
+    cache->hc_lru = NULL;
+    cache->hc_bytes = 0;
+}
+
+#undef _MALLOC
+#undef _IS_CLOCK
+#undef _ENTRY
@@ -2,50 +2,386 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
 #include <memory.h>
+#include <time.h>
 
+#ifdef __linux__
+#include <sys/random.h>
+#endif
 
 #include "include/hashmap.h"
 #include "include/rbtree.h"
+#include "include/hash.h"
+#include "private/swiss.h"
+#include "private/slab.h"
+#include "private/util.h"
+#include "private/epoch.h"
+#include "private/parallel.h"
+#include "private/image.h"
+#include "private/wheel.h"
 
 struct map_entry
 {
-    int size;
+    size_t size;
     struct rb_node *rbtree;
 };
 
 static int resize_hashmap(struct hash_map *map);
-static void un_rbtree(struct rb_node **root);
-static void to_rbtree(struct rb_node **root, int (*cmp)(const void*, const void*));
+static int reseed_chain(struct hash_map *map);
+static void rehash_step(struct hash_map *map);
+static void shrink_auto(struct hash_map *map);
+static int build_rbtree(struct rb_node **root, int (*cmp)(const void*, const void*));
+static int link_node(struct hash_map *map, struct map_entry *entry,
+    struct rb_node *node, struct rb_node *last, struct rb_node *new_node);
+static int unlink_node(struct hash_map *map, struct rb_node *node);
+static void to_rbtree(struct hash_map *map, struct rb_node **root);
+
+#define _MALLOC(t, n) ((t*) malloc(sizeof(t) * (n)))
+#define _REALLOC(t, p, n) (t*) realloc(p, sizeof(t) * (n))
+#define _IS_RBTREE(t) is_rbtree(t)
+#define _PREFETCH(p) __builtin_prefetch(p)
+#define _PREFETCH_DIST 8
+#define _BATCH_GROUP 16
+#define _IS_RCU(map) ((map)->hm_flags & HASHMAP_FLAG_RCU)
+#define _PUBLISH(p, v) __atomic_store_n(&(p), v, __ATOMIC_RELEASE)
+#define _ACQUIRE(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define _IS_KEYCOPY(map) ((map)->hm_flags & HASHMAP_FLAG_KEYCOPY)
+#define _IS_SEEDED(map) ((map)->hm_flags & HASHMAP_FLAG_SEED)
+/** key 的副本占用的空间，向上对齐到 8 字节，保证 value 的副本是对齐的 */
+#define _KEY_AREA(n) (((size_t) (n) + 7) & ~(size_t) 7)
+/** 调用者通过 put_hashmap_node 提供的节点的 rb_node.slab，这样的节点不会被释放 */
+#define _USER_NODE 0xfe
+
+/**
+  * value 的副本的位置，它排在 key 的副本之后
+  */
+static inline void* node_data(struct rb_node *node)
+{
+    return (char*) (node + 1) + _KEY_AREA(node->key_c);
+}
+
+/**
+  * 节点的定时器，它排在 value 的副本之后，只有 node->ttl 不为 0 时有效
+  * 这样的节点的 val_c 就是副本的长度，不会包含 slab 多出来的空间
+  */
+static inline struct hm_timer* node_timer(struct rb_node *node)
+{
+    return (struct hm_timer*) ((char*) node_data(node) + _KEY_AREA(node->val_c));
+}
+
+/**
+  * TTL 使用的时钟，参考 hash_map.hm_clock
+  */
+static uint64_t map_clock(struct hash_map *map)
+{
+    if (map->hm_clock != NULL)
+        return map->hm_clock();
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static inline int is_expired(struct hash_map *map, struct rb_node *node)
+{
+    return node->ttl && node_timer(node)->expire <= map_clock(map);
+}
+
+/**
+  * 重新设置已经在时间轮中的定时器，expire 为 0 时取消，节点不再有 TTL
+  */
+static void reset_timer(struct hash_map *map, struct rb_node *node, uint64_t expire)
+{
+    struct hm_timer *timer = node_timer(node);
+
+    del_timer(map->hm_wheel, timer);
+    if (expire == 0) {
+        node->ttl = 0;
+        return;
+    }
+    timer->expire = expire;
+    add_timer(map->hm_wheel, timer);
+}
+
+/**
+  * 计算 key 在 hashmap 中使用的 hash，参考 HASHMAP_FLAG_SEED
+  */
+static inline size_t hash_key(struct hash_map *map, const void *key)
+{
+    size_t hash;
+
+    if (! _IS_SEEDED(map))
+        return spread_hash(map->hm_hash(key));
+    if (map->hm_seed_hash != NULL)
+        hash = map->hm_seed_hash(key, map->hm_seed);
+    else
+        hash = (size_t) hash_mix64((uint64_t) map->hm_hash(key) ^ map->hm_seed);
+    return spread_hash(hash);
+}
+
+/**
+  * 选择一个随机的种子，优先使用系统的随机数
+  * 否则混合时间、地址和计数器，至少保证不同的 hashmap 使用不同的种子
+  */
+static size_t random_seed(const void *salt)
+{
+    static size_t counter;
+    size_t seed = 0;
+
+#ifdef __linux__
+    if (getrandom(&seed, sizeof(seed), GRND_NONBLOCK) == (ssize_t) sizeof(seed) && seed != 0)
+        return seed;
+#endif
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    seed = (size_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+    seed ^= (size_t) (uintptr_t) salt;
+    seed ^= __atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED) << 20;
+    return (size_t) hash_mix64(seed) | 1;
+}
+
+/**
+  * 开启 HASHMAP_FLAG_KEYCOPY 时得到 key 的长度，否则为 0
+  */
+static inline size_t key_length(struct hash_map *map, const void *key)
+{
+    return _IS_KEYCOPY(map) ? map->hm_klen(key) : 0;
+}
+
+/**
+  * 判断 node 是否保存着 key
+  * klen 不为 0 时，节点中是 key 的副本，只需要比较长度和字节
+  */
+static inline int match_node(struct hash_map *map, struct rb_node *node,
+    const void *key, size_t klen, size_t hash)
+{
+    if (hash != node->hash)
+        return 0;
+    if (klen != 0)
+        return klen == node->key_c && memcmp(key, node + 1, klen) == 0;
+    return map->hm_cmp(key, node->key) == 0;
+}
+
+/**
+  * 为键值对分配新节点
+  * slab 不为 NULL 时从 slab 中分配 (开启 HASHMAP_FLAG_SLAB)，否则使用 malloc
+  * klen 不为 0 时，key 的副本和 value 的副本依次放在节点后面
+  * timed 不为 0 时，再在最后留出定时器的空间，由调用者设置，参考 node_timer
+  */
+static struct rb_node* alloc_node(struct hm_slab *slab, const void *key, size_t klen,
+    size_t hash, const void *val, size_t val_t, int timed)
+{
+    const size_t mem_t = sizeof(struct rb_node) + _KEY_AREA(klen) +
+        (timed ? _KEY_AREA(val_t) + sizeof(struct hm_timer) : val_t);
+    unsigned char cls = 0;
+    struct rb_node *node;
+
+    if (slab == NULL)
+        node = (struct rb_node*) malloc(mem_t);
+    else
+        node = (struct rb_node*) alloc_slab(slab, mem_t, &cls);
+    if (node == NULL) {
+        return NULL;
+    }
+
+    set_rb_node(node, key, hash, val, 0);
+    if (klen != 0) {
+        node->key = memcpy(node + 1, key, klen);
+        node->key_c = (unsigned short) klen;
+    }
+    if (val_t != 0) {
+        node->value = memcpy(node_data(node), val, val_t);
+        node->val_c = val_t > UINT_MAX ? 0 : (unsigned int) val_t;
+    }
+
+    node->slab = cls;
+    node->ttl = timed != 0;
+    if (slab != NULL && cls != SLAB_LARGE && ! timed)
+        node->val_c = slab_block_size(cls) - (mem_t - val_t);
+    return node;
+}
+
+/**
+  * 开启 HASHMAP_FLAG_RCU 时，读者可能还在访问被摘下的节点，延迟到宽限期之后释放
+  * 调用者的节点只是被摘下，由调用者负责回收，节点的定时器在这里取消
+  */
+static void free_node(struct hash_map *map, struct rb_node *node)
+{
+    if (node->ttl)
+        del_timer(map->hm_wheel, node_timer(node));
+    if (node->slab == _USER_NODE) {
+        node->part = NULL;
+        return;
+    }
+    if (_IS_RCU(map))
+        retire_epoch(node, NULL);
+    else if (map->hm_slab == NULL)
+        free(node);
+    else
+        free_slab(map->hm_slab, node, node->slab);
+}
+
+/**
+  * 原地更新已经存在的节点
+  * 只有 value 的副本放得下时才会更新，否则需要重新分配节点
+  * 节点保存着 key 的副本时，key 保持不变
+  * *注意* val 可能指向节点自己的副本，因此使用 memmove
+  * @return 完成返回 0，放不下返回 -1
+  */
+static int update_node(struct rb_node *node, const void *key,
+    const void *val, size_t val_t)
+{
+    if (val_t > node->val_c) {
+        return -1;
+    }
+    if (node->key_c == 0)
+        _PUBLISH(node->key, (void*) key);
+    _PUBLISH(node->value, val_t == 0 ? (void*) val : memmove(node_data(node), val, val_t));
+    return 0;
+}
+
+/**
+  * 找到 hash 对应的桶
+  * 渐进式扩容期间，还没有搬迁的桶仍然在旧表中
+  * 每个节点只会出现在其中一张表里
+  */
+static inline struct map_entry* find_entry(struct hash_map *map, size_t hash)
+{
+    if (map->hm_old != NULL) {
+        size_t i = hash & (map->hm_old_cap - 1);
+        if (i >= map->hm_move)
+            return map->hm_old + i;
+    }
+    return map->hm_tab + (hash & (map->hm_cap - 1));
+}
+
+/**
+  * 桶 i 是否还在 load_hashmap 映射的文件中，没有被复制成节点
+  * 映射存在期间不会扩容，桶和文件中的桶一一对应
+  */
+static inline int is_frozen(struct hash_map *map, size_t i)
+{
+    struct map_image *img = map->hm_image;
+    return img != NULL && img->im_left != 0 && ! (img->im_thawed[i >> 3] & (1u << (i & 7)));
+}
+
+/**
+  * 在映射的文件中查找 key，和 HASHMAP_FLAG_KEYCOPY 一样只比较长度和字节
+  */
+static struct image_record* find_image(struct hash_map *map, size_t i,
+    const void *key, size_t hash)
+{
+    const size_t klen = key_length(map, key);
+    struct image_record *rec = NULL;
+
+    while ((rec = next_image(map->hm_image, i, rec)) != NULL) {
+        if (rec->hash == hash && rec->klen == klen && memcmp(image_key(rec), key, klen) == 0)
+            break;
+    }
+    return rec;
+}
+
+/**
+  * 把桶 i 中的记录复制成普通的节点，即 copy-on-write
+  * 先复制完整个桶再链接，分配失败时这个桶仍然留在文件中
+  */
+static int thaw_entry(struct hash_map *map, size_t i)
+{
+    struct map_image *img = map->hm_image;
+    struct map_entry *entry = map->hm_tab + i;
+    struct image_record *rec = NULL;
+    struct rb_node *head = NULL, *node;
+    size_t count = 0;
+
+    while ((rec = next_image(img, i, rec)) != NULL) {
+        const size_t vlen = rec->vlen == IMAGE_NULL_VALUE ? 0 : rec->vlen;
+        node = alloc_node(map->hm_slab, image_key(rec), rec->klen, rec->hash, image_value(rec), vlen, 0);
+        if (node == NULL) {
+            fprintf(stderr, "failed to malloc new rb_node\n");
+            for (; head != NULL; head = node) {
+                node = head->part;
+                free_node(map, head);
+            }
+            return -1;
+        }
+        node->part = head;
+        head = node;
+        count ++;
+    }
+
+    entry->rbtree = head;
+    entry->size = count;
+    if (count >= map->tree_t)
+        to_rbtree(map, &(entry->rbtree));
+
+    img->im_thawed[i >> 3] |= 1u << (i & 7);
+    img->im_left --;
+    return 0;
+}
+
+/**
+  * 复制所有还在文件中的桶，用于扩容等需要整张表的操作
+  */
+static int thaw_image(struct hash_map *map)
+{
+    struct map_image *img = map->hm_image;
+    if (img == NULL) {
+        return 0;
+    }
+    for (size_t i = 0; i < img->im_cap && img->im_left != 0; i++) {
+        if (is_frozen(map, i) && thaw_entry(map, i) == -1)
+            return -1;
+    }
+    return 0;
+}
 
-#define _MALLOC(t, n) (t*) malloc(sizeof(t) * n)
-#define _REALLOC(t, p, n) (t*) realloc(p, sizeof(t) * n)
-#define _IS_RBTREE(t) (t && t->color == RB_BLK)
+/**
+  * 解除映射，hashmap 中不能再有位于文件中的键值对
+  */
+static void drop_image(struct hash_map *map)
+{
+    if (map->hm_image != NULL) {
+        close_image(map->hm_image);
+        free(map->hm_image);
+        map->hm_image = NULL;
+    }
+}
 
 struct hash_map* set_hashmap(struct hash_map *dst)
 {
     struct hash_map *map = dst;
-    if (map == NULL && (map = _MALLOC(struct hash_map, 1)) == NULL) {
-        return NULL;
+    if (map == NULL) {
+        if ((map = _MALLOC(struct hash_map, 1)) == NULL)
+            return NULL;
+        memset(map, 0, sizeof(struct hash_map));
     }
 
+    /* 将 capacity 和 max capacity 调整为 2 的整次幂 */
+    if (map->hm_max == 0 || map->hm_max > HASHMAP_MAX_CAPACITY)
+        map->hm_max = HASHMAP_MAX_CAPACITY;
+    else
+        map->hm_max = round_capacity(map->hm_max);
+
     if (map->hm_cap == 0) 
         map->hm_cap = HASHMAP_DEF_CAPACITY;
-    else {
-        /* 将 capacity 调整为 2 的整次幂 */
-        unsigned int n = map->hm_cap - 1;
-        n |= n >> 1;
-        n |= n >> 2;
-        n |= n >> 4;
-        n |= n >> 8;
-        n |= n >> 16;
-        map->hm_cap = n + 1;
-    }
+    else
+        map->hm_cap = round_capacity(map->hm_cap);
+    if (map->hm_cap > map->hm_max)
+        map->hm_cap = map->hm_max;
 
     map->hm_size = 0;
 
     if (map->hm_load == 0) 
         map->hm_load = HASHMAP_DEF_LOAD_FACTOR;
+    if (map->hm_min_load < 0) {
+        map->hm_min_load = 0;
+    }
+    else if (map->hm_min_load > map->hm_load / 4) {
+        fprintf(stderr, "hm_min_load adjusted to %g\n", map->hm_load / 4);
+        map->hm_min_load = map->hm_load / 4;
+    }
     if (map->tree_t == 0)
         map->tree_t = HASHMAP_DEF_TREE_THRESHOLD;
     if (map->untr_t == 0)
@@ -60,9 +396,65 @@ struct hash_map* set_hashmap(struct hash_map *dst)
         map->hm_hash = HASHMAP_DEF_HASHCODE;
     }
 
+    if (map->hm_flags & HASHMAP_FLAG_RCU) {
+        const unsigned int unsupported = HASHMAP_FLAG_INCREMENTAL | HASHMAP_FLAG_SLAB;
+        if (map->hm_type == HASHMAP_TYPE_SWISS) {
+            fprintf(stderr, "HASHMAP_FLAG_RCU ignored by swiss table\n");
+            map->hm_flags &= ~HASHMAP_FLAG_RCU;
+        }
+        else if (map->hm_flags & unsupported) {
+            fprintf(stderr, "HASHMAP_FLAG_RCU ignores incremental rehash and slab\n");
+            map->hm_flags &= ~unsupported;
+        }
+        if (_IS_RCU(map)) {
+            map->tree_t = (unsigned int) -1;
+            if (map->hm_min_load != 0) {
+                fprintf(stderr, "HASHMAP_FLAG_RCU ignores hm_min_load\n");
+                map->hm_min_load = 0;
+            }
+        }
+    }
+    if (map->hm_flags & HASHMAP_FLAG_KEYCOPY) {
+        if (map->hm_type == HASHMAP_TYPE_SWISS) {
+            fprintf(stderr, "HASHMAP_FLAG_KEYCOPY ignored by swiss table\n");
+            map->hm_flags &= ~HASHMAP_FLAG_KEYCOPY;
+        }
+        else if (map->hm_klen == NULL) {
+            fprintf(stderr, "HASHMAP_FLAG_KEYCOPY requires hm_klen\n");
+            if (dst != map) free(map);
+            return NULL;
+        }
+    }
+    map->hm_seq = 0;
+    map->hm_image = NULL;
+    map->hm_resizes = map->hm_treeify = map->hm_untreeify = 0;
+    map->hm_reseeds = map->hm_reseed_size = 0;
+    if (_IS_SEEDED(map) && map->hm_seed == 0)
+        map->hm_seed = random_seed(map);
+    memset(&map->hm_ops, 0, sizeof(map->hm_ops));
+
+    if (map->hm_type == HASHMAP_TYPE_SWISS) {
+        if (set_swiss(map) == -1) {
+            fprintf(stderr, "failed to malloc swiss table for %zu capacity\n", map->hm_cap);
+            if (dst != map) free(map);
+            return NULL;
+        }
+        return map;
+    }
+
+    if (map->hm_flags & HASHMAP_FLAG_SLAB) {
+        if ((map->hm_slab = _MALLOC(struct hm_slab, 1)) == NULL) {
+            fprintf(stderr, "failed to malloc hash_map slab\n");
+            if (dst != map) free(map);
+            return NULL;
+        }
+        memset(map->hm_slab, 0, sizeof(struct hm_slab));
+    }
 
     if (map->hm_tab == NULL && (map->hm_tab = _MALLOC(struct map_entry, map->hm_cap)) == NULL) {
-        fprintf(stderr, "failed to malloc hash_map table for %d capacity\n", map->hm_cap);
+        fprintf(stderr, "failed to malloc hash_map table for %zu capacity\n", map->hm_cap);
+        free(map->hm_slab);
+        map->hm_slab = NULL;
         if (dst != map) free(map);
         return NULL;
     }
@@ -71,31 +463,70 @@ struct hash_map* set_hashmap(struct hash_map *dst)
     return map;
 }
 
+/**
+  * 释放 tab[from, to) 中所有的节点
+  * 节点来自 slab 时，它们会由 clear_slab 一次性释放，这里只需要释放 rb_link，再清空桶
+  */
+static void clear_entries(struct hash_map *map, struct map_entry *tab, size_t from, size_t to)
+{
+    if (map->hm_slab != NULL) {
+        for (size_t i = from; i < to; i++) {
+            if (_IS_RBTREE(tab[i].rbtree))
+                un_rbtree(&(tab[i].rbtree));
+        }
+        memset(tab + from, 0, sizeof(struct map_entry) * (to - from));
+        return;
+    }
+
+    for (size_t i = from; i < to; i++) {
+        struct map_entry *entry = tab + i;
+        struct rb_node *node = entry->rbtree, *next;
+
+        // 红黑树先拆成链表，调用者的节点不能被释放，统一交给 free_node
+        if (_IS_RCU(map))
+            _PUBLISH(entry->rbtree, NULL);
+        else if (_IS_RBTREE(node))
+            un_rbtree(&node);
+        for (; node != NULL; node = next) {
+            next = node->part;
+            free_node(map, node);
+        }
+        entry->size = 0;
+        entry->rbtree = NULL;
+    }
+}
+
 void clear_hashmap(struct hash_map *map)
 {
     if (map == NULL) {
         return;
     }
 
+    if (map->hm_type == HASHMAP_TYPE_SWISS) {
+        clear_swiss(map);
+        return;
+    }
+
     map->hm_size = 0;
 
-    for (int i = 0; i < map->hm_cap; i++) {
-        struct map_entry *entry = map->hm_tab + i;
-        struct rb_node *node = entry->rbtree;
+    // 渐进式扩容还没有结束，旧表中剩下的桶也需要释放
+    if (map->hm_old != NULL) {
+        clear_entries(map, map->hm_old, map->hm_move, map->hm_old_cap);
+        free(map->hm_old);
+        map->hm_old = NULL;
+        map->hm_old_cap = 0;
+        map->hm_move = 0;
+    }
 
-        if (_IS_RBTREE(node)) {
-            free_rbtree(node);
-        }
-        else {
-            struct rb_node *next;
-            while (node != NULL) {
-                next = node->part;
-                free(node);
-                node = next;
-            }
-        }
-        entry->size = 0;
-        entry->rbtree = NULL;
+    clear_entries(map, map->hm_tab, 0, map->hm_cap);
+    drop_image(map);
+
+    if (map->hm_wheel != NULL) {
+        set_wheel(map->hm_wheel, map->hm_wheel->tw_now);
+    }
+
+    if (map->hm_slab != NULL) {
+        clear_slab(map->hm_slab);
     }
 }
 
@@ -105,8 +536,17 @@ void free_hashmap(struct hash_map *map)
         return;
     }
 
-    clear_hashmap(map);
-    free(map->hm_tab);
+    if (map->hm_type == HASHMAP_TYPE_SWISS) {
+        free_swiss(map);
+    }
+    else {
+        clear_hashmap(map);
+        free(map->hm_tab);
+        free(map->hm_slab);
+        map->hm_slab = NULL;
+        free(map->hm_wheel);
+        map->hm_wheel = NULL;
+    }
 
     // 保留 load_factor, tree_t, untr_t 
     map->hm_tab = NULL;
@@ -114,179 +554,849 @@ void free_hashmap(struct hash_map *map)
     map->hm_cap = 0;
 }
 
+/**
+  * 下面的 get_hashed, put_hashed 和 remove_hashed 使用已经计算好的 hash，
+  * 它们不会推进渐进式扩容，由调用者负责
+  */
+/**
+  * HASHMAP_FLAG_RCU 的读者，不加锁，可以和唯一的写者并发
+  * 扩容时节点会被重新链接，读者可能因此错过要找的节点，
+  * 所以没找到时检查 hm_seq，如果期间发生过扩容就重试
+  */
+static void* get_rcu(struct hash_map *map, const void *key, size_t hash)
+{
+    struct map_entry *tab;
+    struct rb_node *node;
+    size_t seq, cap;
+    const size_t klen = key_length(map, key);
+    void *value = NULL;
+
+    enter_epoch();
+    do {
+        seq = _ACQUIRE(map->hm_seq);
+
+        // 先读容量再读表，扩大时写者按相反的顺序发布，下标不会越界，参考 publish_table
+        cap = _ACQUIRE(map->hm_cap);
+        tab = _ACQUIRE(map->hm_tab);
+
+        node = _ACQUIRE(tab[hash & (cap - 1)].rbtree);
+        for (; node != NULL; node = _ACQUIRE(node->part)) {
+            // 节点中的 key 副本在发布之后不会改变，否则 key 可能被写者替换
+            if (klen != 0 ? match_node(map, node, key, klen, hash) :
+                    hash == node->hash && map->hm_cmp(key, _ACQUIRE(node->key)) == 0) {
+                value = _ACQUIRE(node->value);
+                goto out;
+            }
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || __atomic_load_n(&map->hm_seq, __ATOMIC_RELAXED) != seq);
+out:
+    leave_epoch();
+    return value;
+}
+
+#ifdef HASHMAP_STATS
+/**
+  * 和 get_rbtree2 相同，同时统计比较过的节点数
+  */
+static struct rb_node* get_rbtree_counted(struct hash_map *map, struct rb_node *head,
+    const void *key, size_t hash)
+{
+    struct rb_link *link = rbtree_root(head);
+    size_t probes = 0;
+    int cmp;
+
+    for (; link != NULL; link = cmp < 0 ? link->left : link->right) {
+        struct rb_node *node = link->node;
+        probes ++;
+        if (hash != node->hash)
+            cmp = hash < node->hash ? -1 : 1;
+        else if ((cmp = map->hm_cmp(key, node->key)) == 0)
+            break;
+    }
+    _STAT_ADD(map, probes, probes);
+    return link ? link->node : NULL;
+}
+#endif
+
+/**
+  * 在链表或者红黑树中查找 key 所在的节点
+  * 不处理 swiss、HASHMAP_FLAG_RCU 和映射的文件，由调用者区分
+  */
+static struct rb_node* find_node(struct hash_map *map, const void *key, size_t hash)
+{
+    struct rb_node *node = find_entry(map, hash)->rbtree;
+
+    if (_IS_RBTREE(node)) {
+#ifdef HASHMAP_STATS
+        return get_rbtree_counted(map, node, key, hash);
+#else
+        return get_rbtree2(node, key, hash, map->hm_cmp);
+#endif
+    }
+
+    const size_t klen = key_length(map, key);
+    size_t probes = 0;
+    while (node && ! match_node(map, node, key, klen, hash)) {
+        node = node->part;
+        probes ++;
+    }
+    _STAT_ADD(map, probes, probes + (node != NULL));
+    return node;
+}
+
+static void* get_hashed(struct hash_map *map, const void *key, size_t hash)
+{
+    _STAT_ADD(map, gets, 1);
+
+    if (map->hm_type == HASHMAP_TYPE_SWISS) {
+        void *value = get_swiss(map, key, hash);
+        _STAT_ADD(map, hits, value != NULL);
+        return value;
+    }
+    if (_IS_RCU(map)) {
+        void *value = get_rcu(map, key, hash);
+        _STAT_ADD(map, hits, value != NULL);
+        return value;
+    }
+    if (is_frozen(map, hash & (map->hm_cap - 1))) {
+        struct image_record *rec = find_image(map, hash & (map->hm_cap - 1), key, hash);
+        _STAT_ADD(map, hits, rec != NULL);
+        return rec ? image_value(rec) : NULL;
+    }
+
+    // 惰性过期，参考 put_hashmap_ttl
+    struct rb_node *node = find_node(map, key, hash);
+    if (node != NULL && is_expired(map, node)) {
+        unlink_node(map, node);
+        free_node(map, node);
+        node = NULL;
+    }
+    _STAT_ADD(map, hits, node != NULL);
+    return node ? node->value : NULL;
+}
+
+/**
+  * 侵入式接口不支持的 hashmap，参考 put_hashmap_node
+  */
+static int check_intrusive(struct hash_map *map)
+{
+    if (map->hm_type == HASHMAP_TYPE_SWISS || (map->hm_flags & (HASHMAP_FLAG_KEYCOPY | HASHMAP_FLAG_RCU))) {
+        fprintf(stderr, "intrusive nodes need HASHMAP_TYPE_CHAIN without KEYCOPY and RCU\n");
+        return -1;
+    }
+    return 0;
+}
+
 void* get_hashmap(struct hash_map *map, const void *key)
 {
     if (map == NULL) {
         return NULL;
     }
 
-    // hashcode 和其高 16 位相异或，得到 hash
+    if (map->hm_old != NULL) {
+        rehash_step(map);
+    }
+
+    return get_hashed(map, key, hash_key(map, key));
+}
+
+struct rb_node* get_hashmap_node(struct hash_map *map, const void *key)
+{
+    if (map == NULL || check_intrusive(map) == -1) {
+        return NULL;
+    }
+
+    if (map->hm_old != NULL) {
+        rehash_step(map);
+    }
+
+    _STAT_ADD(map, gets, 1);
+    struct rb_node *node = find_node(map, key, hash_key(map, key));
+    _STAT_ADD(map, hits, node != NULL);
+    return node;
+}
+
+/**
+  * expire 不为 0 时，键值对在这个时刻过期，参考 put_hashmap_ttl
+  */
+static int put_hashed(struct hash_map *map, const void *key, size_t hash,
+    const void *val, size_t val_t, uint64_t expire)
+{
+    _STAT_ADD(map, puts, 1);
 
-    int hash = map->hm_hash(key);
-    hash ^= (unsigned int) hash >> 16;
+    if (map->hm_type == HASHMAP_TYPE_SWISS) {
+        return put_swiss(map, key, hash, val, val_t);
+    }
 
-    struct rb_node *node = map->hm_tab[hash & (map->hm_cap - 1)].rbtree;
+    const size_t klen = key_length(map, key);
+    if (klen > HASHMAP_MAX_KEY_COPY) {
+        fprintf(stderr, "key of %zu bytes is too long to copy\n", klen);
+        return -1;
+    }
+    if (is_frozen(map, hash & (map->hm_cap - 1)) &&
+            thaw_entry(map, hash & (map->hm_cap - 1)) == -1) {
+        return -1;
+    }
 
-    if (_IS_RBTREE(node)) {
+    struct map_entry *entry = find_entry(map, hash);
+    struct rb_node *node = entry->rbtree, *last = NULL;
+    const int is_tree = _IS_RBTREE(node);
+
+    /* 先查找 key 是否已经存在
+     * 如果是链表，last 指向 node 的前一个节点
+     */
+    if (is_tree) {
         node = get_rbtree2(node, key, hash, map->hm_cmp);
     }
     else {
-        while (node && (hash != node->hash || map->hm_cmp(key, node->key))) {
+        while (node && ! match_node(map, node, key, klen, hash)) {
+            last = node;
             node = node->part;
         }
     }
-    return node ? node->value : NULL;
-}
 
-int put_hashmap(struct hash_map *map, const void *key, const void *val, size_t val_t)
-{
-    if (map == NULL) {
-        return -1;
-    }
+    // 已经过期但还没有被移除的 key 视为不存在，直接替换它
+    const int stale = node != NULL && is_expired(map, node);
 
-    int hash = map->hm_hash(key);
-    hash ^= (unsigned int) hash >> 16;
+    /* key 已经存在，并且旧节点放得下新的 value，
+     * 直接原地更新，不需要分配新节点
+     * 开启 HASHMAP_FLAG_RCU 时，读者可能正在读副本，只能原地替换 value 的地址
+     * 需要 TTL 时，旧节点还必须有定时器
+     */
+    if (node != NULL && (val_t == 0 || ! _IS_RCU(map)) && (expire == 0 || node->ttl) &&
+            update_node(node, key, val, val_t) == 0) {
+        if (node->ttl)
+            reset_timer(map, node, expire);
+        return ! stale;
+    }
 
-    struct rb_node *new_node = new_rb_node(key, hash, val, val_t);
+    struct rb_node *new_node = alloc_node(map->hm_slab, key, klen, hash, val, val_t, expire != 0);
     if (new_node == NULL) {
         fprintf(stderr, "failed to malloc new rb_node\n");
         return -1;
     }
+    // 先放入时间轮，链接失败时由 free_node 取消
+    if (expire != 0) {
+        struct hm_timer *timer = node_timer(new_node);
+        timer->expire = expire;
+        timer->owner = new_node;
+        add_timer(map->hm_wheel, timer);
+    }
 
-    struct map_entry *entry = map->hm_tab + (hash & (map->hm_cap - 1));
-    struct rb_node *node = entry->rbtree;
+    const int ret = link_node(map, entry, node, last, new_node);
+    if (ret == -1)
+        free_node(map, new_node);
+    else if (ret == 1)
+        free_node(map, node);
+    return ret == 1 ? ! stale : ret;
+}
+
+/**
+  * 把 new_node 链接到 entry 中，node 是 key 相同的旧节点，last 是链表中 node 的前一个节点
+  * 旧节点被替换下来，由调用者释放；否则按需转为红黑树、更换种子和扩容
+  * @return 新插入返回 0，替换了旧节点返回 1，分配 rb_link 失败返回 -1
+  */
+static int link_node(struct hash_map *map, struct map_entry *entry,
+    struct rb_node *node, struct rb_node *last, struct rb_node *new_node)
+{
+    const int is_tree = _IS_RBTREE(entry->rbtree);
 
     /* 下面分两种情况，
-     * entry 为红黑树根节点时，放到红黑树中
-     * 否则，添加到链表中
-     * *注意* 执行完之后，entry 是旧节点
+     * entry 为红黑树时，放到红黑树中，如果 key 已存在，让旧节点的 rb_link 指向新节点
+     * 否则，添加到链表的尾部，或者替换掉链表中的旧节点
      */
-    if (_IS_RBTREE(node)) {
-        node = put_rbtree(&(entry->rbtree), new_node, map->hm_cmp);
+    if (is_tree) {
+        if (node != NULL) {
+            node_rblink(node)->node = new_node;
+            new_node->part = node->part;
+        }
+        else if (put_rbtree(&(entry->rbtree), new_node, map->hm_cmp) == -1) {
+            fprintf(stderr, "failed to malloc new rb_link\n");
+            return -1;
+        }
     }
     else {
-        struct rb_node *last = NULL;
-        while (node && (hash != node->hash || map->hm_cmp(key, node->key))) {
-            last = node;
-            node = node->part;
-        }
-        // 插入新元素或更新新元素
         if (node != NULL) 
             new_node->part = node->part;
         if (last != NULL)
-            last->part = new_node;
+            _PUBLISH(last->part, new_node);
         else 
-            entry->rbtree = new_node;
+            _PUBLISH(entry->rbtree, new_node);
     }
 
     if (node != NULL) {
-        free(node);
         return 1;
     }
 
     map->hm_size ++;
     entry->size ++;
     if (! _IS_RBTREE(entry->rbtree) && entry->size >= map->tree_t) {
-            to_rbtree(&(entry->rbtree), map->hm_cmp);
+            to_rbtree(map, &(entry->rbtree));
+    }
+
+    /* 桶的长度不正常，说明 key 可能是被刻意构造的，更换种子重新散列
+     * 距离上一次更换种子，hashmap 的大小至少要翻倍
+     */
+    if (entry->size >= HASHMAP_RESEED_CHAIN && _IS_SEEDED(map) && ! _IS_RCU(map) &&
+            map->hm_size >= map->hm_reseed_size * 2) {
+        reseed_chain(map);
     }
 
     // 如果需要，对 hashmap 扩容
     if (resize_hashmap(map) == -1) {
-        fprintf(stderr, "failed to resize_hashmap to %u capacity\n", 
+        fprintf(stderr, "failed to resize_hashmap to %zu capacity\n", 
             map->hm_cap << 1);
     }
 
     return 0;
 }
 
-
-static int resize_hashmap(struct hash_map *map)
+int put_hashmap(struct hash_map *map, const void *key, const void *val, size_t val_t)
 {
-    /**
-      * 未达到负载因子，或者 hashmap 已经达到最大时，不进行扩容
-      */
-    if (map->hm_size <= (int) (map->hm_cap * map->hm_load) || 
-        map->hm_size >= HASHMAP_MAX_CAPACITY) {
-        return 0;
+    if (map == NULL) {
+        return -1;
     }
 
-    const int old_cap = map->hm_cap;
-    const int new_cap = old_cap << 1;
-    struct map_entry* new_tab = _REALLOC(struct map_entry, map->hm_tab, new_cap);
+    if (map->hm_old != NULL) {
+        rehash_step(map);
+    }
 
-    if (new_tab == NULL) {
+    return put_hashed(map, key, hash_key(map, key), val, val_t, 0);
+}
+
+int put_hashmap_ttl(struct hash_map *map, const void *key,
+    const void *val, size_t val_t, uint64_t ttl)
+{
+    if (map == NULL) {
+        return -1;
+    }
+    if (ttl == 0) {
+        return put_hashmap(map, key, val, val_t);
+    }
+    if (map->hm_type == HASHMAP_TYPE_SWISS || _IS_RCU(map) || val_t > UINT_MAX) {
+        fprintf(stderr, "ttl needs HASHMAP_TYPE_CHAIN without RCU\n");
         return -1;
     }
 
-    map->hm_cap = new_cap;
-    map->hm_tab = new_tab;
+    const uint64_t now = map_clock(map);
+    if (map->hm_wheel == NULL) {
+        if ((map->hm_wheel = _MALLOC(struct timer_wheel, 1)) == NULL) {
+            fprintf(stderr, "failed to malloc hash_map timer wheel\n");
+            return -1;
+        }
+        set_wheel(map->hm_wheel, now);
+    }
 
-    /* 接下来遍历每一个节点，进行再散列 */
+    if (map->hm_old != NULL) {
+        rehash_step(map);
+    }
 
-    for (int i = 0; i < old_cap; i++) {
-        struct map_entry *lo_entry = new_tab + i;
-        struct rb_node *node = lo_entry->rbtree;
+    return put_hashed(map, key, hash_key(map, key), val, val_t, now + ttl);
+}
 
-        if (_IS_RBTREE(node)) {
-            un_rbtree(&node);
-        }
+size_t expire_hashmap(struct hash_map *map, uint64_t now, size_t budget)
+{
+    if (map == NULL || map->hm_wheel == NULL) {
+        return 0;
+    }
 
-        /* 根据 “旧 index 和新 index 是否相同”
-         * 把链表拆分成 2 条新链表，新 index 为 i 和 i + old_cap
-         */
-        struct rb_node *lo_head = NULL, *lo_tail = NULL;
-        struct rb_node *hi_head = NULL, *hi_tail = NULL;
-        int lo_count = 0, hi_count = 0;
-        struct rb_node *next;
+    struct hm_timer *timer;
+    size_t n = 0;
 
-        while (node) {
-            next = node->part;
-            node->part = NULL;
+    // 定时器已经离开时间轮，清除 ttl，free_node 不再取消它
+    while ((budget == 0 || n < budget) && (timer = next_expired(map->hm_wheel, now)) != NULL) {
+        struct rb_node *node = (struct rb_node*) timer->owner;
+        node->ttl = 0;
+        unlink_node(map, node);
+        free_node(map, node);
+        n ++;
+    }
+    return n;
+}
 
-            if (node->hash & old_cap) {
-                if (hi_head == NULL)
-                    hi_head = node;
-                else
-                    hi_tail->part = node;
-                hi_tail = node;
-                hi_count ++;
-            }
-            else {
-                if (lo_head == NULL)
-                    lo_head = node;
-                else
-                    lo_tail->part = node;
-                lo_tail = node;
-                lo_count ++;
-            }
-            node = next;
+int put_hashmap_node(struct hash_map *map, struct rb_node *node,
+    const void *key, const void *val, struct rb_node **old)
+{
+    if (map == NULL || node == NULL || check_intrusive(map) == -1) {
+        return -1;
+    }
+
+    if (map->hm_old != NULL) {
+        rehash_step(map);
+    }
+
+    _STAT_ADD(map, puts, 1);
+
+    const size_t hash = hash_key(map, key);
+    struct map_entry *entry = find_entry(map, hash);
+    struct rb_node *prev = entry->rbtree, *last = NULL;
+
+    if (_IS_RBTREE(prev)) {
+        prev = get_rbtree2(prev, key, hash, map->hm_cmp);
+    }
+    else {
+        while (prev && ! match_node(map, prev, key, 0, hash)) {
+            last = prev;
+            prev = prev->part;
+        }
+    }
+
+    set_rb_node(node, key, hash, val, 0);
+    node->slab = _USER_NODE;
+
+    // 被替换的节点来自 put_hashmap 时，仍然由 hashmap 释放
+    const int ret = link_node(map, entry, prev, last, node);
+    if (old != NULL)
+        *old = ret == 1 && prev->slab == _USER_NODE ? prev : NULL;
+    if (ret == 1)
+        free_node(map, prev);
+    return ret;
+}
+
+
+/**
+  * 拆分红黑树，中序遍历得到的两条链表仍然有序，直接建树，耗时为 O(n)
+  * 开启 HASHMAP_FLAG_RCU 时不会有红黑树，因此不需要考虑读者
+  */
+static size_t split_tree(struct hash_map *map, struct rb_node *root,
+    struct map_entry *lo_entry, struct map_entry *hi_entry, size_t old_cap)
+{
+    struct rb_node *lo, *hi;
+    struct rb_link *spare = NULL;
+    size_t lo_count, hi_count, treeify = 0;
+
+    // 拆分出来的 rb_link 足够建立两棵树，不需要重新分配
+    split_rbtree(root, old_cap, &lo, &lo_count, &hi, &hi_count, &spare);
+
+    if (lo_count >= map->tree_t) {
+        lo = make_rbtree(lo, lo_count, &spare);
+        treeify ++;
+    }
+    if (hi_count >= map->tree_t) {
+        hi = make_rbtree(hi, hi_count, &spare);
+        treeify ++;
+    }
+    free_rblinks(spare);
+    lo_entry->rbtree = lo;
+    lo_entry->size = lo_count;
+    hi_entry->rbtree = hi;
+    hi_entry->size = hi_count;
+    return treeify;
+}
+
+/**
+  * 根据 “旧 index 和新 index 是否相同”，把 src 中的节点拆分到 lo 和 hi 两个桶
+  * lo 的新 index 和旧 index 相同，hi 的新 index 为旧 index + old_cap
+  * *注意* src 可以和 lo 是同一个桶
+  * @return 转为红黑树的桶的数量，由调用者累加到 hm_treeify
+  */
+static size_t split_entry(struct hash_map *map, struct map_entry *src, 
+    struct map_entry *lo_entry, struct map_entry *hi_entry, size_t old_cap)
+{
+    struct rb_node *node = src->rbtree;
+
+    if (_IS_RBTREE(node)) {
+        return split_tree(map, node, lo_entry, hi_entry, old_cap);
+    }
+
+    struct rb_node *lo_head = NULL, *lo_tail = NULL;
+    struct rb_node *hi_head = NULL, *hi_tail = NULL;
+    size_t lo_count = 0, hi_count = 0;
+    struct rb_node *next;
+
+    /* 开启 HASHMAP_FLAG_RCU 时，读者可能正在访问这些节点
+     * 节点只会指向原链表中排在它后面的节点，不会形成环
+     */
+    while (node) {
+        next = node->part;
+        _PUBLISH(node->part, NULL);
+
+        if (node->hash & old_cap) {
+            if (hi_head == NULL)
+                hi_head = node;
+            else
+                _PUBLISH(hi_tail->part, node);
+            hi_tail = node;
+            hi_count ++;
+        }
+        else {
+            if (lo_head == NULL)
+                lo_head = node;
+            else
+                _PUBLISH(lo_tail->part, node);
+            lo_tail = node;
+            lo_count ++;
         }
-        struct map_entry *hi_entry = new_tab + i + old_cap;
+        node = next;
+    }
+
+    lo_entry->rbtree = lo_head;
+    lo_entry->size = lo_count;
+    hi_entry->rbtree = hi_head;
+    hi_entry->size = hi_count;
+
+    // 如果长度过长，转为红黑树
+    size_t treeify = 0;
+    if (lo_count >= map->tree_t)
+        treeify += build_rbtree(&(lo_entry->rbtree), map->hm_cmp);
+    if (hi_count >= map->tree_t)
+        treeify += build_rbtree(&(hi_entry->rbtree), map->hm_cmp);
+    return treeify;
+}
+
+/**
+  * split_table 的参数，每个线程负责一段连续的桶
+  */
+struct split_task {
+    struct hash_map *map;
+    struct map_entry *src;
+    struct map_entry *dst;
+    size_t old_cap;
+    size_t treeify[PARALLEL_MAX_THREADS];
+};
+
+static void split_range(void *arg, int id, int nthreads)
+{
+    struct split_task *task = (struct split_task*) arg;
+    const size_t old_cap = task->old_cap;
+    const size_t from = old_cap / nthreads * id;
+    const size_t to = id == nthreads - 1 ? old_cap : old_cap / nthreads * (id + 1);
+    size_t treeify = 0;
+
+    for (size_t i = from; i < to; i++) {
+        treeify += split_entry(task->map, task->src + i,
+            task->dst + i, task->dst + i + old_cap, old_cap);
+    }
+    task->treeify[id] = treeify;
+}
+
+/**
+  * 把 src 的每个桶拆分到 dst 中对应的两个桶，src 可以和 dst 相同
+  * 桶 i 只会拆分到 i 和 i + old_cap，互不相关，
+  * 因此容量足够大时，按 hm_threads 把桶平均分给多个线程
+  */
+static void split_table(struct hash_map *map, struct map_entry *src,
+    struct map_entry *dst, size_t old_cap)
+{
+    struct split_task task;
+    int nthreads = 1;
+
+    if (map->hm_threads > 1 && old_cap >= HASHMAP_PARALLEL_RESIZE)
+        nthreads = parallel_threads(map->hm_threads);
+
+    task.map = map;
+    task.src = src;
+    task.dst = dst;
+    task.old_cap = old_cap;
+    if (nthreads == 1)
+        split_range(&task, 0, 1);
+    else
+        run_parallel(nthreads, split_range, &task);
+
+    for (int i = 0; i < nthreads; i++) {
+        map->hm_treeify += task.treeify[i];
+    }
+}
 
-        lo_entry->rbtree = lo_head;
-        lo_entry->size = lo_count;
-        hi_entry->rbtree = hi_head;
-        hi_entry->size = hi_count;
+/**
+  * 开启 HASHMAP_FLAG_RCU 时，同时替换表和容量
+  * 读者先读容量再读表，扩大时先发布表再发布容量，读者看到的容量不会大于表的容量
+  * 缩小时没有安全的顺序：读者可能先读到旧的大容量，再读到新的小表，下标越界，
+  * 因此开启 HASHMAP_FLAG_RCU 时不允许缩容，cap 不会小于 hm_cap
+  */
+static void publish_table(struct hash_map *map, struct map_entry *tab, size_t cap)
+{
+    _PUBLISH(map->hm_tab, tab);
+    _PUBLISH(map->hm_cap, cap);
+}
 
-        // 如果长度过长，转为红黑树
-        if (lo_count >= map->tree_t) 
-            to_rbtree(&(lo_entry->rbtree), map->hm_cmp);
-        if (hi_count >= map->tree_t) 
-            to_rbtree(&(hi_entry->rbtree), map->hm_cmp);
+/**
+  * 开启 HASHMAP_FLAG_RCU 时的扩容
+  * 旧表可能正在被读者访问，不能使用 realloc，而是拆分到新表之后延迟释放
+  * 拆分期间 hm_seq 为奇数，读者没找到时会重试
+  */
+static int resize_rcu(struct hash_map *map, size_t new_cap)
+{
+    struct map_entry *old_tab = map->hm_tab;
+    const size_t old_cap = map->hm_cap;
+    struct map_entry *new_tab = (struct map_entry*) calloc(new_cap, sizeof(struct map_entry));
+    if (new_tab == NULL) {
+        return -1;
     }
+
+    __atomic_store_n(&map->hm_seq, map->hm_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    split_table(map, old_tab, new_tab, old_cap);
+    publish_table(map, new_tab, new_cap);
+    map->hm_resizes ++;
+
+    _PUBLISH(map->hm_seq, map->hm_seq + 1);
+    retire_epoch(old_tab, NULL);
     return 0;
 }
 
-int remove_hashmap(struct hash_map *map, const void *key)
+static int resize_hashmap(struct hash_map *map)
+{
+    /**
+      * 未达到负载因子，或者 hashmap 已经达到最大时，不进行扩容
+      * 渐进式扩容还没有结束时，也不会开始新一轮扩容
+      */
+    if (map->hm_size <= (size_t) ((double) map->hm_cap * map->hm_load) || 
+        map->hm_cap >= map->hm_max || map->hm_old != NULL) {
+        return 0;
+    }
+    if (thaw_image(map) == -1) {
+        return -1;
+    }
+
+    const size_t old_cap = map->hm_cap;
+    const size_t new_cap = old_cap << 1;
+
+    if (map->hm_flags & HASHMAP_FLAG_INCREMENTAL) {
+        /* 新表和旧表同时存在，之后每次操作都会搬迁一部分桶
+         * 使用 calloc 是因为对于大块内存，它通常不需要真的逐字节清零
+         */
+        struct map_entry *new_tab = (struct map_entry*) calloc(new_cap, sizeof(struct map_entry));
+        if (new_tab == NULL) {
+            return -1;
+        }
+        map->hm_old = map->hm_tab;
+        map->hm_old_cap = old_cap;
+        map->hm_move = 0;
+        map->hm_cap = new_cap;
+        map->hm_tab = new_tab;
+        map->hm_resizes ++;
+        return 0;
+    }
+
+    if (_IS_RCU(map)) {
+        return resize_rcu(map, new_cap);
+    }
+
+    struct map_entry* new_tab = _REALLOC(struct map_entry, map->hm_tab, new_cap);
+
+    if (new_tab == NULL) {
+        return -1;
+    }
+
+    map->hm_cap = new_cap;
+    map->hm_tab = new_tab;
+    map->hm_resizes ++;
+
+    /* 接下来遍历每一个节点，进行再散列 */
+    split_table(map, new_tab, new_tab, old_cap);
+    return 0;
+}
+
+/**
+  * 渐进式扩容时，搬迁旧表中的一部分桶
+  * 最多搬迁 HASHMAP_REHASH_STEP 个非空的桶，
+  * 为了避免遇到大段的空桶，最多只检查 10 倍数量的空桶
+  * 全部搬迁完成后，释放旧表
+  */
+static void rehash_step(struct hash_map *map)
+{
+    const size_t old_cap = map->hm_old_cap;
+    struct map_entry *old_tab = map->hm_old;
+    struct map_entry *new_tab = map->hm_tab;
+    size_t i = map->hm_move;
+    int moved = 0, empty = 0;
+
+    while (i < old_cap && moved < HASHMAP_REHASH_STEP) {
+        struct map_entry *entry = old_tab + i;
+        if (entry->rbtree != NULL) {
+            map->hm_treeify += split_entry(map, entry, new_tab + i, new_tab + i + old_cap, old_cap);
+            moved ++;
+        }
+        else if (++ empty >= HASHMAP_REHASH_STEP * 10) {
+            i ++;
+            break;
+        }
+        i ++;
+    }
+    map->hm_move = i;
+
+    if (i == old_cap) {
+        free(old_tab);
+        map->hm_old = NULL;
+        map->hm_old_cap = 0;
+        map->hm_move = 0;
+    }
+}
+
+/**
+  * 把所有的节点搬到容量为 new_cap 的新表，可以扩大也可以缩小
+  * 节点不会重新分配，hash 也不需要重新计算
+  * 开启 HASHMAP_FLAG_RCU 时，旧表延迟释放，搬迁期间 hm_seq 为奇数
+  */
+static int rebuild_table(struct hash_map *map, size_t new_cap)
+{
+    if (thaw_image(map) == -1) {
+        return -1;
+    }
+    while (map->hm_old != NULL) {
+        rehash_step(map);
+    }
+
+    struct map_entry *old_tab = map->hm_tab;
+    const size_t old_cap = map->hm_cap;
+    struct map_entry *new_tab = (struct map_entry*) calloc(new_cap, sizeof(struct map_entry));
+    if (new_tab == NULL) {
+        return -1;
+    }
+
+    if (_IS_RCU(map)) {
+        __atomic_store_n(&map->hm_seq, map->hm_seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+
+    /* 节点插入到新桶的头部
+     * 开启 HASHMAP_FLAG_RCU 时，读者可能正在访问这些节点，
+     * 已经搬迁的节点只会指向同样已经搬迁的节点，不会形成环
+     */
+    for (size_t i = 0; i < old_cap; i++) {
+        struct rb_node *node = old_tab[i].rbtree, *next;
+        if (_IS_RBTREE(node))
+            un_rbtree(&node);
+
+        for (; node != NULL; node = next) {
+            struct map_entry *dst = new_tab + (node->hash & (new_cap - 1));
+            next = node->part;
+            _PUBLISH(node->part, dst->rbtree);
+            dst->rbtree = node;
+            dst->size ++;
+        }
+    }
+    for (size_t i = 0; i < new_cap; i++) {
+        if (new_tab[i].size >= map->tree_t)
+            to_rbtree(map, &(new_tab[i].rbtree));
+    }
+    map->hm_resizes ++;
+
+    if (_IS_RCU(map)) {
+        publish_table(map, new_tab, new_cap);
+        _PUBLISH(map->hm_seq, map->hm_seq + 1);
+        retire_epoch(old_tab, NULL);
+    }
+    else {
+        free(old_tab);
+        map->hm_tab = new_tab;
+        map->hm_cap = new_cap;
+    }
+    return 0;
+}
+
+/**
+  * 能够容纳 n 个键值对而不需要扩容的最小容量，不超过 hm_max
+  */
+static size_t fit_capacity(struct hash_map *map, size_t n)
+{
+    size_t cap = HASHMAP_DEF_CAPACITY;
+    while (cap < map->hm_max && (double) cap * map->hm_load < (double) n)
+        cap <<= 1;
+    return cap < map->hm_max ? cap : map->hm_max;
+}
+
+static int resize_to(struct hash_map *map, size_t new_cap)
+{
+    if (map->hm_type == HASHMAP_TYPE_SWISS)
+        return resize_swiss(map, new_cap);
+    return rebuild_table(map, new_cap);
+}
+
+/**
+  * 移除键值对之后，如果负载低于 hm_min_load，
+  * 缩小到负载不超过 hm_load / 2 的最小容量，参考 hm_min_load
+  * 渐进式扩容还没有结束时不会缩容，开启 HASHMAP_FLAG_RCU 时也不会，参考 publish_table
+  */
+static void shrink_auto(struct hash_map *map)
+{
+    if (map->hm_min_load == 0 || map->hm_old != NULL || _IS_RCU(map) ||
+            (double) map->hm_size >= (double) map->hm_cap * map->hm_min_load) {
+        return;
+    }
+
+    const size_t new_cap = fit_capacity(map, map->hm_size * 2);
+    if (new_cap < map->hm_cap && resize_to(map, new_cap) == -1) {
+        fprintf(stderr, "failed to shrink hash_map to %zu capacity\n", new_cap);
+    }
+}
+
+int reserve_hashmap(struct hash_map *map, size_t n)
+{
+    if (map == NULL) {
+        return -1;
+    }
+
+    const size_t new_cap = fit_capacity(map, n);
+    if (new_cap <= map->hm_cap) {
+        return 0;
+    }
+    if (resize_to(map, new_cap) == -1) {
+        fprintf(stderr, "failed to reserve hash_map to %zu capacity\n", new_cap);
+        return -1;
+    }
+    return 0;
+}
+
+int shrink_hashmap(struct hash_map *map)
 {
     if (map == NULL) {
         return -1;
     }
-    
-    int hash = map->hm_hash(key);
-    hash ^= (unsigned int) hash >> 16;
+    if (_IS_RCU(map)) {
+        fprintf(stderr, "shrink_hashmap does not support HASHMAP_FLAG_RCU\n");
+        return -1;
+    }
+
+    const size_t new_cap = fit_capacity(map, map->hm_size);
+    if (new_cap >= map->hm_cap) {
+        return 0;
+    }
+    if (resize_to(map, new_cap) == -1) {
+        fprintf(stderr, "failed to shrink hash_map to %zu capacity\n", new_cap);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+  * 从 entry 中摘下一个节点之后，更新计数，按需把红黑树转回链表，以及自动缩容
+  */
+static void shrink_entry(struct hash_map *map, struct map_entry *entry)
+{
+    map->hm_size --;
+    entry->size --;
+    if (_IS_RBTREE(entry->rbtree) && entry->size <= map->untr_t) {
+        un_rbtree(&(entry->rbtree));
+        map->hm_untreeify ++;
+    }
+    shrink_auto(map);
+}
+
+static int remove_hashed(struct hash_map *map, const void *key, size_t hash)
+{
+    _STAT_ADD(map, removes, 1);
+
+    if (map->hm_type == HASHMAP_TYPE_SWISS) {
+        if (remove_swiss(map, key, hash) == 0)
+            return 0;
+        shrink_auto(map);
+        return 1;
+    }
 
-    struct map_entry *entry = map->hm_tab + (hash & (map->hm_cap - 1));
+    // key 不在文件中时，不需要复制这个桶
+    const size_t i = hash & (map->hm_cap - 1);
+    if (is_frozen(map, i)) {
+        if (find_image(map, i, key, hash) == NULL)
+            return 0;
+        if (thaw_entry(map, i) == -1)
+            return -1;
+    }
+
+    struct map_entry *entry = find_entry(map, hash);
     struct rb_node *node = entry->rbtree;
 
     /** 接下来分两种情况，一种
@@ -299,17 +1409,18 @@ int remove_hashmap(struct hash_map *map, const void *key)
         node = remove_rbtree2(&(entry->rbtree), key, hash, map->hm_cmp);
     }
     else {
+        const size_t klen = key_length(map, key);
         struct rb_node *last = NULL;
-        while (node && (hash != node->hash || map->hm_cmp(key, node->key))) {
+        while (node && ! match_node(map, node, key, klen, hash)) {
             last = node;
             node = node->part;
         }
-        // 更新链表
+        // 更新链表，被移除的节点的 part 保持不变，正在访问它的读者可以继续前进
         if (node) {
             if (last)
-                last->part = node->part;
+                _PUBLISH(last->part, node->part);
             else 
-                entry->rbtree = node->part;
+                _PUBLISH(entry->rbtree, node->part);
         }
     }
 
@@ -317,69 +1428,1258 @@ int remove_hashmap(struct hash_map *map, const void *key)
         return 0;
     }
 
-    free(node);
-
-    map->hm_size --;
-    entry->size --;
-    if (! _IS_RBTREE(entry->rbtree) && entry->size <= HASHMAP_DEF_UNTREE_THRESHOLD) {
-        un_rbtree(&(entry->rbtree));
-    }
+    free_node(map, node);
+    shrink_entry(map, entry);
     return 1;
 }
 
+int remove_hashmap(struct hash_map *map, const void *key)
+{
+    if (map == NULL) {
+        return -1;
+    }
+
+    if (map->hm_old != NULL) {
+        rehash_step(map);
+    }
+
+    return remove_hashed(map, key, hash_key(map, key));
+}
 
-static void un_rbtree(struct rb_node **root)
+int remove_hashmap_node(struct hash_map *map, struct rb_node *node)
 {
-    struct rb_node *p, *node, *tail;
-    node = tail = *root;
+    if (map == NULL || node == NULL || check_intrusive(map) == -1) {
+        return -1;
+    }
 
-    while (node) {
-        if ((p = node->left) != NULL) {
-            node->left = NULL;
-            p->part = NULL;
-            tail->part = p;
-            tail = p;
-        }
-        if ((p = node->right) != NULL) {
-            node->right = NULL;
-            p->part = NULL;
-            tail->part = p;
-            tail = p;
-        }
-        node->color = RB_RED;
-        node = node->part;
+    if (map->hm_old != NULL) {
+        rehash_step(map);
     }
+
+    _STAT_ADD(map, removes, 1);
+    return unlink_node(map, node);
 }
 
-static void to_rbtree(struct rb_node **root, int (*cmp)(const void*, const void*))
+/**
+  * 把已知的节点从它所在的桶中摘下，不释放节点
+  * @return 节点在 hashmap 中返回 1，否则返回 0
+  */
+static int unlink_node(struct hash_map *map, struct rb_node *node)
 {
-    struct rb_node *node, *next = *root;
-    while ((node = next) != NULL) {
-        next = node->part;
-        node->part = NULL;
+    // 节点的 hash 在更换种子时会被更新，总是指向它所在的桶
+    struct map_entry *entry = find_entry(map, node->hash);
+    struct rb_node *p = entry->rbtree, *last = NULL;
+
+    // 红黑树中的节点通过 part 直接找到自己的 rb_link，不需要查找
+    if (_IS_RBTREE(p)) {
+        struct rb_link *link = node_rblink(node);
+        if (link == NULL || link->node != node)
+            return 0;
+        remove_rbtree_node(&(entry->rbtree), link);
+    }
+    else {
+        while (p && p != node) {
+            last = p;
+            p = p->part;
+        }
+        if (p == NULL)
+            return 0;
+        if (last)
+            last->part = node->part;
+        else
+            entry->rbtree = node->part;
+    }
+
+    node->part = NULL;
+    shrink_entry(map, entry);
+    return 1;
+}
+
+
+/**
+  * 批量操作的前两个阶段：
+  * 先计算一组 key 的 hash，并预取它们的桶；
+  * 等桶到达之后，再预取每个桶的首个节点
+  * 这样同一组 key 的 cache miss 可以重叠，而不是一个接一个地等待
+  */
+static void prefetch_group(struct hash_map *map, const void *const *keys, 
+    size_t n, size_t *hashes)
+{
+    size_t i;
 
-        put_rbtree(root, node, cmp);
+    /* 开启 HASHMAP_FLAG_RCU 时，读者看到的 hm_tab 和 hm_cap 可能不匹配，
+     * 只能在 get_rcu 中按顺序读取，因此不做预取
+     */
+    for (i = 0; i < n; i++) {
+        hashes[i] = hash_key(map, keys[i]);
+        if (map->hm_type == HASHMAP_TYPE_SWISS)
+            prefetch_swiss(map, hashes[i]);
+        else if (! _IS_RCU(map))
+            _PREFETCH(find_entry(map, hashes[i]));
+    }
+    if (map->hm_type == HASHMAP_TYPE_SWISS || _IS_RCU(map)) {
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        _PREFETCH(find_entry(map, hashes[i])->rbtree);
     }
 }
 
-int get_hashmap_size(struct hash_map *map)
+/**
+  * 渐进式扩容时，批量操作中的每个 key 都和单次操作一样推进一步
+  * 每组 key 计算桶的地址之前完成，这样批量插入期间开始的扩容也会被推进
+  */
+static void rehash_batch(struct hash_map *map, size_t n)
 {
-    return map ? map->hm_size : 0;
+    for (size_t i = 0; i < n && map->hm_old != NULL; i++) {
+        rehash_step(map);
+    }
 }
 
+size_t get_hashmap_batch(struct hash_map *map, const void *const *keys, 
+    size_t n, void **values)
+{
+    if (map == NULL || keys == NULL || values == NULL) {
+        return 0;
+    }
+
+    size_t hashes[_BATCH_GROUP], found = 0;
 
-int read_hashmap(struct hash_map *map, struct map_iterator *iter)
+    for (size_t base = 0; base < n; base += _BATCH_GROUP) {
+        const size_t m = n - base < _BATCH_GROUP ? n - base : _BATCH_GROUP;
+        const void *const *group = keys + base;
+        size_t i;
+
+        rehash_batch(map, m);
+        prefetch_group(map, group, m, hashes);
+
+        /* 第三个阶段：首个节点到达之后，预取它的 key，
+         * hash 相同的链表节点大概率就是要找的节点
+         * 红黑树的桶中保存的是打了标记的 head，预取根节点对应的 rb_node，查找时首先比较它
+         */
+        if (map->hm_type != HASHMAP_TYPE_SWISS && ! _IS_RCU(map)) {
+            for (i = 0; i < m; i++) {
+                struct rb_node *node = find_entry(map, hashes[i])->rbtree;
+                if (_IS_RBTREE(node))
+                    _PREFETCH(rbtree_root(node)->node);
+                else if (node != NULL && node->hash == hashes[i])
+                    _PREFETCH(node->key);
+            }
+        }
+
+        // 最后一个阶段，依次完成查找
+        for (i = 0; i < m; i++) {
+            void *value = get_hashed(map, group[i], hashes[i]);
+            values[base + i] = value;
+            found += value != NULL;
+        }
+    }
+    return found;
+}
+
+int put_hashmap_batch(struct hash_map *map, const void *const *keys, 
+    const void *const *vals, size_t val_t, size_t n)
 {
-    if (map == NULL || iter == NULL) {
+    if (map == NULL || keys == NULL || vals == NULL) {
         return -1;
     }
 
-    
+    size_t hashes[_BATCH_GROUP];
+    int added = 0, ret;
 
+    for (size_t base = 0; base < n; base += _BATCH_GROUP) {
+        const size_t m = n - base < _BATCH_GROUP ? n - base : _BATCH_GROUP;
 
-    return 0;
+        rehash_batch(map, m);
+        prefetch_group(map, keys + base, m, hashes);
+
+        /* 插入可能触发扩容，之前预取的地址因此失效，
+         * 但这只会影响性能，不影响正确性
+         * 插入也可能更换种子，这时剩下的 hash 需要重新计算
+         */
+        const size_t reseeds = map->hm_reseeds;
+        for (size_t i = 0; i < m; i++) {
+            if (map->hm_reseeds != reseeds)
+                hashes[i] = hash_key(map, keys[base + i]);
+            ret = put_hashed(map, keys[base + i], hashes[i], vals[base + i], val_t, 0);
+            if (ret == -1) {
+                return -1;
+            }
+            added += ret == 0;
+        }
+    }
+    return added;
+}
+
+size_t remove_hashmap_batch(struct hash_map *map, const void *const *keys, size_t n)
+{
+    if (map == NULL || keys == NULL) {
+        return 0;
+    }
+
+    size_t hashes[_BATCH_GROUP], removed = 0;
+
+    for (size_t base = 0; base < n; base += _BATCH_GROUP) {
+        const size_t m = n - base < _BATCH_GROUP ? n - base : _BATCH_GROUP;
+
+        rehash_batch(map, m);
+        prefetch_group(map, keys + base, m, hashes);
+
+        for (size_t i = 0; i < m; i++) {
+            removed += remove_hashed(map, keys[base + i], hashes[i]) == 1;
+        }
+    }
+    return removed;
+}
+
+/**
+  * build_hashmap_bulk 的共享状态
+  * 桶按下标被划分为 parts 个连续的区间，每个区间由一个线程独占地建立
+  */
+struct bulk_build {
+    struct hash_map *map;
+    const void *const *keys;
+    const void *const *vals;
+    size_t n;
+
+    /** 新表和它的容量，区间 p 包含的桶为 [p << shift, (p + 1) << shift) */
+    struct map_entry *tab;
+    size_t cap;
+    size_t parts;
+    int shift;
+
+    /** 每个 key 的 hash，以及按区间排好的 key 的下标 */
+    size_t *hashes;
+    size_t *order;
+
+    /** hist[id * parts + p] 先是线程 id 的输入中属于区间 p 的数量，
+      * 前缀和之后是它们在 order 中的起始位置
+      * start[p] 是区间 p 在 order 中的起始位置
+      */
+    size_t *hist;
+    size_t *start;
+
+    /** 下一个等待建立的区间，线程通过原子操作领取 */
+    size_t next;
+
+    /** 每个线程私有的 slab，没有开启 HASHMAP_FLAG_SLAB 时为 NULL */
+    struct hm_slab *slabs;
+
+    /** 每个线程新插入的节点数，以及转为红黑树的桶数 */
+    size_t added[PARALLEL_MAX_THREADS];
+    size_t treeify[PARALLEL_MAX_THREADS];
+    int error;
+};
+
+static inline size_t bulk_part(struct bulk_build *b, size_t hash)
+{
+    return (hash & (b->cap - 1)) >> b->shift;
+}
+
+/** 第一步：计算线程 id 负责的这部分输入的 hash，并统计它们属于哪个区间 */
+static void bulk_hash(void *arg, int id, int nthreads)
+{
+    struct bulk_build *b = (struct bulk_build*) arg;
+    const size_t from = b->n * id / nthreads, to = b->n * (id + 1) / nthreads;
+    size_t *hist = b->hist + (size_t) id * b->parts;
+
+    for (size_t i = from; i < to; i++) {
+        b->hashes[i] = hash_key(b->map, b->keys[i]);
+        hist[bulk_part(b, b->hashes[i])] ++;
+    }
+}
+
+/** 第二步：把同一部分输入的下标分散到各个区间，同一区间内保持输入的顺序 */
+static void bulk_scatter(void *arg, int id, int nthreads)
+{
+    struct bulk_build *b = (struct bulk_build*) arg;
+    const size_t from = b->n * id / nthreads, to = b->n * (id + 1) / nthreads;
+    size_t *hist = b->hist + (size_t) id * b->parts;
+
+    for (size_t i = from; i < to; i++) {
+        b->order[hist[bulk_part(b, b->hashes[i])] ++] = i;
+    }
+}
+
+/**
+  * 第三步：逐个领取区间，把其中的键值对插入到对应的桶
+  * 区间之间没有共享的桶，因此不需要加锁
+  * 重复的 key 按输入的顺序覆盖，结果和依次调用 put_hashmap 相同
+  */
+static void bulk_link(void *arg, int id, int nthreads)
+{
+    struct bulk_build *b = (struct bulk_build*) arg;
+    struct hash_map *map = b->map;
+    struct hm_slab *slab = b->slabs ? b->slabs + id : NULL;
+    size_t p;
+
+    while ((p = __atomic_fetch_add(&b->next, 1, __ATOMIC_RELAXED)) < b->parts) {
+        if (__atomic_load_n(&b->error, __ATOMIC_RELAXED))
+            return;
+
+        for (size_t j = b->start[p]; j < b->start[p + 1]; j++) {
+            const size_t i = b->order[j], hash = b->hashes[i];
+            const void *key = b->keys[i];
+            const size_t klen = key_length(map, key);
+            if (klen > HASHMAP_MAX_KEY_COPY) {
+                fprintf(stderr, "key of %zu bytes is too long to copy\n", klen);
+                __atomic_store_n(&b->error, 1, __ATOMIC_RELAXED);
+                return;
+            }
+
+            struct map_entry *entry = b->tab + (hash & (b->cap - 1));
+            struct rb_node *node = entry->rbtree;
+            while (node && ! match_node(map, node, key, klen, hash))
+                node = node->part;
+            if (node != NULL) {
+                update_node(node, key, b->vals[i], 0);
+                continue;
+            }
+
+            if ((node = alloc_node(slab, key, klen, hash, b->vals[i], 0, 0)) == NULL) {
+                fprintf(stderr, "failed to malloc new rb_node\n");
+                __atomic_store_n(&b->error, 1, __ATOMIC_RELAXED);
+                return;
+            }
+            node->part = entry->rbtree;
+            entry->rbtree = node;
+            entry->size ++;
+            b->added[id] ++;
+        }
+
+        const size_t to = (p + 1) << b->shift;
+        for (size_t i = p << b->shift; i < to; i++) {
+            if (b->tab[i].size >= map->tree_t)
+                b->treeify[id] += build_rbtree(&(b->tab[i].rbtree), map->hm_cmp);
+        }
+    }
+    (void) nthreads;
+}
+
+/** 建立失败时，释放新表中所有的节点，hashmap 本身没有被修改过 */
+static void bulk_abort(struct bulk_build *b, int nthreads)
+{
+    if (b->slabs != NULL) {
+        for (size_t i = 0; i < b->cap; i++) {
+            if (_IS_RBTREE(b->tab[i].rbtree))
+                un_rbtree(&(b->tab[i].rbtree));
+        }
+        for (int t = 0; t < nthreads; t++)
+            clear_slab(b->slabs + t);
+    }
+    else {
+        for (size_t i = 0; i < b->cap; i++) {
+            struct rb_node *node = b->tab[i].rbtree, *next;
+            if (_IS_RBTREE(node))
+                un_rbtree(&node);
+            for (; node != NULL; node = next) {
+                next = node->part;
+                free(node);
+            }
+        }
+    }
+}
+
+int build_hashmap_bulk(struct hash_map *map, const void *const *keys,
+    const void *const *vals, size_t n, int nthreads)
+{
+    if (map == NULL || keys == NULL || vals == NULL) {
+        return -1;
+    }
+
+    /* swiss table 的探测序列会跨越区间，非空的 hashmap 需要和已有的节点合并，
+     * 这两种情况按顺序插入
+     */
+    if (map->hm_type == HASHMAP_TYPE_SWISS || map->hm_size != 0) {
+        return put_hashmap_batch(map, keys, vals, 0, n);
+    }
+    // hashmap 是空的，文件中的桶也都是空的
+    drop_image(map);
+    while (map->hm_old != NULL) {
+        rehash_step(map);
+    }
+    _STAT_ADD(map, puts, n);
+
+    // 每个线程至少处理 1024 个键值对，否则创建线程的开销得不偿失
+    nthreads = parallel_threads(nthreads);
+    if ((size_t) nthreads > n / 1024 + 1)
+        nthreads = (int) (n / 1024 + 1);
+
+    struct bulk_build b;
+    memset(&b, 0, sizeof(b));
+    b.map = map;
+    b.keys = keys;
+    b.vals = vals;
+    b.n = n;
+    b.cap = fit_capacity(map, n);
+    if (b.cap < map->hm_cap)
+        b.cap = map->hm_cap;
+
+    // 区间的数量是线程数的若干倍，使得各个线程的负载比较均衡
+    b.parts = round_capacity((size_t) nthreads * 8);
+    if (b.parts > b.cap)
+        b.parts = b.cap;
+    while (((size_t) 1 << b.shift) < b.cap / b.parts)
+        b.shift ++;
+
+    b.tab = (struct map_entry*) calloc(b.cap, sizeof(struct map_entry));
+    b.hashes = _MALLOC(size_t, n);
+    b.order = _MALLOC(size_t, n);
+    b.hist = (size_t*) calloc((size_t) nthreads * b.parts, sizeof(size_t));
+    b.start = _MALLOC(size_t, b.parts + 1);
+    if (map->hm_slab != NULL)
+        b.slabs = (struct hm_slab*) calloc(nthreads, sizeof(struct hm_slab));
+
+    int ret = -1;
+    if (b.tab == NULL || b.hashes == NULL || b.order == NULL || b.hist == NULL ||
+            b.start == NULL || (map->hm_slab != NULL && b.slabs == NULL)) {
+        fprintf(stderr, "failed to malloc hash_map table for %zu capacity\n", b.cap);
+        goto out;
+    }
+
+    run_parallel(nthreads, bulk_hash, &b);
+
+    // 前缀和：区间 p 在前，同一个区间内线程 id 小的在前
+    size_t offset = 0;
+    for (size_t p = 0; p < b.parts; p++) {
+        b.start[p] = offset;
+        for (int t = 0; t < nthreads; t++) {
+            const size_t count = b.hist[(size_t) t * b.parts + p];
+            b.hist[(size_t) t * b.parts + p] = offset;
+            offset += count;
+        }
+    }
+    b.start[b.parts] = offset;
+
+    run_parallel(nthreads, bulk_scatter, &b);
+    run_parallel(nthreads, bulk_link, &b);
+
+    if (b.error) {
+        bulk_abort(&b, nthreads);
+        goto out;
+    }
+
+    size_t added = 0;
+    for (int t = 0; t < nthreads; t++) {
+        added += b.added[t];
+        map->hm_treeify += b.treeify[t];
+        if (b.slabs != NULL)
+            merge_slab(map->hm_slab, b.slabs + t);
+    }
+    if (b.cap != map->hm_cap)
+        map->hm_resizes ++;
+
+    // hashmap 是空的，读者无论看到新表还是旧表都是正确的
+    if (_IS_RCU(map)) {
+        struct map_entry *old_tab = map->hm_tab;
+        publish_table(map, b.tab, b.cap);
+        retire_epoch(old_tab, NULL);
+    }
+    else {
+        free(map->hm_tab);
+        map->hm_tab = b.tab;
+        map->hm_cap = b.cap;
+    }
+    map->hm_size = added;
+    b.tab = NULL;
+    ret = added > INT_MAX ? INT_MAX : (int) added;
+
+out:
+    free(b.tab);
+    free(b.hashes);
+    free(b.order);
+    free(b.hist);
+    free(b.start);
+    free(b.slabs);
+    return ret;
+}
+
+/**
+  * 把链表转为红黑树：先排序，再用有序的链表直接建树，
+  * 不需要逐个插入和旋转
+  * 分配 rb_link 失败时，桶仍然是 (排好序的) 链表，只是查找变慢
+  * @return 转为红黑树返回 1，否则返回 0
+  */
+static int build_rbtree(struct rb_node **root, int (*cmp)(const void*, const void*))
+{
+    struct rb_node *node;
+    size_t n = 0;
+
+    for (node = *root; node != NULL; node = node->part)
+        n ++;
+    *root = make_rbtree(sort_rblist(*root, cmp), n, NULL);
+    return _IS_RBTREE(*root);
+}
+
+static void to_rbtree(struct hash_map *map, struct rb_node **root)
+{
+    map->hm_treeify += build_rbtree(root, map->hm_cmp);
+}
+
+size_t get_hashmap_size(struct hash_map *map)
+{
+    return map ? map->hm_size : 0;
+}
+
+void read_lock_hashmap(struct hash_map *map)
+{
+    enter_epoch();
+}
+
+void read_unlock_hashmap(struct hash_map *map)
+{
+    leave_epoch();
+}
+
+
+static inline struct rb_node* first_node(struct map_entry *entry)
+{
+    struct rb_node *node = entry->rbtree;
+    return _IS_RBTREE(node) ? first_rbtree(node) : node;
+}
+
+static inline struct rb_node* next_node(struct map_entry *entry, struct rb_node *node)
+{
+    return _IS_RBTREE(entry->rbtree) ? next_rbtree(node) : node->part;
+}
+
+/**
+  * HASHMAP_TYPE_CHAIN 的迭代器
+  * offset 是当前的桶，tag 是当前的节点，红黑树按中序遍历
+  * 进入一个桶时，预取后面的桶，以及下一个桶的首个节点
+  */
+static int has_next_chain(struct map_iterator *iter, void *p)
+{
+    struct hash_map *map = (struct hash_map*) p;
+    struct map_entry *tab = map->hm_tab;
+    const size_t cap = map->hm_cap;
+    size_t i = iter->offset;
+    struct rb_node *node = (struct rb_node*) iter->tag;
+
+    if (node != NULL && (node = next_node(tab + i, node)) == NULL) {
+        i ++;
+    }
+    while (node == NULL && i < cap) {
+        if (i + _PREFETCH_DIST < cap)
+            _PREFETCH(tab + i + _PREFETCH_DIST);
+        if (i + 1 < cap)
+            _PREFETCH(tab[i + 1].rbtree);
+        if ((node = first_node(tab + i)) == NULL)
+            i ++;
+    }
+
+    iter->offset = i;
+    iter->tag = node;
+    if (node == NULL) {
+        iter->key = iter->value = NULL;
+        return 0;
+    }
+
+    // 预取链表中的下一个节点，或者红黑树中的下一个 rb_link
+    if (_IS_RBTREE(tab[i].rbtree)) {
+        struct rb_link *link = node_rblink(node);
+        _PREFETCH(link->right != NULL ? link->right : (void*) link->parent_color);
+    }
+    else {
+        _PREFETCH(node->part);
+    }
+    iter->key = node->key;
+    iter->value = node->value;
+    return 1;
+}
+
+/**
+  * HASHMAP_TYPE_SWISS 的迭代器
+  * offset 是当前 slot 的下标，tag 是当前的 slot
+  */
+static int has_next_swiss(struct map_iterator *iter, void *p)
+{
+    struct hash_map *map = (struct hash_map*) p;
+    size_t i = iter->offset;
+
+    if (iter->tag != NULL) {
+        i ++;
+    }
+    struct swiss_slot *slot = next_swiss(map, &i);
+
+    iter->offset = i;
+    iter->tag = slot;
+    if (slot == NULL) {
+        iter->key = iter->value = NULL;
+        return 0;
+    }
+    iter->key = slot->key;
+    iter->value = slot->value;
+    return 1;
+}
+
+int read_hashmap(struct hash_map *map, struct map_iterator *iter)
+{
+    if (map == NULL || iter == NULL) {
+        return -1;
+    }
+
+    /* 渐进式扩容期间，get_hashmap 也会搬迁节点，
+     * 为了让迭代器不受影响，这里一次性完成搬迁
+     * 如果不希望出现停顿，请使用 scan_hashmap
+     */
+    while (map->hm_old != NULL) {
+        rehash_step(map);
+    }
+    if (thaw_image(map) == -1) {
+        return -1;
+    }
+
+    memset(iter, 0, sizeof(struct map_iterator));
+    if (map->hm_type == HASHMAP_TYPE_SWISS)
+        iter->has_next = has_next_swiss;
+    else
+        iter->has_next = has_next_chain;
+    return 0;
+}
+
+/**
+  * 访问一个桶中的所有节点
+  */
+static void scan_entry(struct map_entry *entry, 
+    void (*fn)(void *key, void *value, void *arg), void *arg)
+{
+    struct rb_node *node = first_node(entry);
+    while (node != NULL) {
+        fn(node->key, node->value, arg);
+        node = next_node(entry, node);
+    }
+}
+
+/**
+  * 访问文件中一个桶的所有记录，不需要复制这个桶
+  */
+static void scan_image(struct map_image *img, size_t i,
+    void (*fn)(void *key, void *value, void *arg), void *arg)
+{
+    struct image_record *rec = NULL;
+    while ((rec = next_image(img, i, rec)) != NULL) {
+        fn(image_key(rec), image_value(rec), arg);
+    }
+}
+
+/**
+  * 把游标的高位当作最低位，加 1 后得到下一个游标
+  * 这样遍历的顺序和容量无关：容量翻倍后，桶 i 拆分成 i 和 i + cap，
+  * 它们在新的顺序中恰好相邻，已经访问过的桶不会再被跳过或遗漏
+  */
+static size_t rev_bits(size_t v)
+{
+    size_t s = sizeof(v) * 8, mask = ~((size_t) 0);
+    while ((s >>= 1) > 0) {
+        mask ^= (mask << s);
+        v = ((v >> s) & mask) | ((v << s) & ~mask);
+    }
+    return v;
+}
+
+size_t scan_hashmap(struct hash_map *map, size_t cursor, size_t count,
+    void (*fn)(void *key, void *value, void *arg), void *arg)
+{
+    if (map == NULL || fn == NULL) {
+        return 0;
+    }
+
+    size_t v = cursor, m0;
+    do {
+        if (map->hm_type == HASHMAP_TYPE_SWISS) {
+            m0 = map->hm_cap - 1;
+            scan_swiss(map, v & m0, fn, arg);
+        }
+        else if (map->hm_old == NULL) {
+            m0 = map->hm_cap - 1;
+            if (is_frozen(map, v & m0))
+                scan_image(map->hm_image, v & m0, fn, arg);
+            else
+                scan_entry(map->hm_tab + (v & m0), fn, arg);
+        }
+        else {
+            /* 渐进式扩容期间，以较小的旧表为准推进游标
+             * 已经搬迁的桶，需要访问新表中所有由它拆分出来的桶
+             */
+            m0 = map->hm_old_cap - 1;
+            const size_t m1 = map->hm_cap - 1;
+
+            if ((v & m0) >= map->hm_move) {
+                scan_entry(map->hm_old + (v & m0), fn, arg);
+            }
+            else {
+                size_t w = v;
+                do {
+                    scan_entry(map->hm_tab + (w & m1), fn, arg);
+                    w = (((w | m0) + 1) & ~m0) | (w & m0);
+                } while (w & (m0 ^ m1));
+            }
+        }
+
+        v |= ~m0;
+        v = rev_bits(rev_bits(v) + 1);
+    } while (v != 0 && count-- > 1);
+
+    return v;
+}
+
+/**
+  * 用新的种子重新计算每个节点的 hash，原地重新散列
+  * 所有节点先摘成一条链表，再逐个放回桶中，不需要分配内存
+  */
+static int reseed_chain(struct hash_map *map)
+{
+    struct rb_node *all = NULL, *node, *next;
+    size_t i;
+
+    if (thaw_image(map) == -1) {
+        return -1;
+    }
+
+    while (map->hm_old != NULL) {
+        rehash_step(map);
+    }
+    map->hm_seed = random_seed(map);
+
+    for (i = 0; i < map->hm_cap; i++) {
+        struct map_entry *entry = map->hm_tab + i;
+        if (_IS_RBTREE(entry->rbtree))
+            un_rbtree(&(entry->rbtree));
+        for (node = entry->rbtree; node != NULL; node = next) {
+            next = node->part;
+            node->part = all;
+            all = node;
+        }
+        entry->rbtree = NULL;
+        entry->size = 0;
+    }
+
+    for (node = all; node != NULL; node = next) {
+        struct map_entry *entry;
+        next = node->part;
+        node->hash = hash_key(map, node->key);
+        entry = map->hm_tab + (node->hash & (map->hm_cap - 1));
+        node->part = entry->rbtree;
+        entry->rbtree = node;
+        entry->size ++;
+    }
+
+    for (i = 0; i < map->hm_cap; i++) {
+        if (map->hm_tab[i].size >= map->tree_t)
+            to_rbtree(map, &(map->hm_tab[i].rbtree));
+    }
+
+    map->hm_reseeds ++;
+    map->hm_reseed_size = map->hm_size;
+    return 0;
+}
+
+int reseed_hashmap(struct hash_map *map)
+{
+    if (map == NULL || ! _IS_SEEDED(map) || _IS_RCU(map)) {
+        return -1;
+    }
+
+    if (map->hm_type == HASHMAP_TYPE_SWISS) {
+        const size_t seed = map->hm_seed;
+        map->hm_seed = random_seed(map);
+        if (rehash_swiss(map, hash_key) == -1) {
+            fprintf(stderr, "failed to malloc swiss table for reseeding\n");
+            map->hm_seed = seed;
+            return -1;
+        }
+        map->hm_reseeds ++;
+        map->hm_reseed_size = map->hm_size;
+        return 0;
+    }
+
+    return reseed_chain(map);
+}
+
+/**
+  * 填写节点对应的记录，key 和 value 的地址通过 key 和value 返回
+  * value 只保存了地址时无法写入文件，返回 -1
+  */
+static int node_record(struct hash_map *map, struct rb_node *node,
+    struct image_record *rec, const void **key, const void **value)
+{
+    const size_t klen = node->key_c ? node->key_c : map->hm_klen(node->key);
+    if (klen > HASHMAP_MAX_KEY_COPY) {
+        fprintf(stderr, "key of %zu bytes is too long to save\n", klen);
+        return -1;
+    }
+
+    rec->hash = node->hash;
+    rec->klen = (uint32_t) klen;
+    *key = node->key;
+    *value = node->value;
+
+    if (node->value == NULL)
+        rec->vlen = IMAGE_NULL_VALUE;
+    else if (node->value == node_data(node) && node->val_c != 0)
+        rec->vlen = node->val_c;
+    else {
+        fprintf(stderr, "value saved by address (val_t is 0) can not be saved\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int slot_record(struct hash_map *map, struct swiss_slot *slot,
+    struct image_record *rec, const void **key, const void **value)
+{
+    const size_t klen = map->hm_klen(slot->key);
+    if (klen > HASHMAP_MAX_KEY_COPY || slot->val_t >= IMAGE_NULL_VALUE) {
+        fprintf(stderr, "key or value is too long to save\n");
+        return -1;
+    }
+    if (slot->value != NULL && slot->val_t == 0) {
+        fprintf(stderr, "value saved by address (val_t is 0) can not be saved\n");
+        return -1;
+    }
+
+    rec->hash = slot->hash;
+    rec->klen = (uint32_t) klen;
+    rec->vlen = slot->value == NULL ? IMAGE_NULL_VALUE : (uint32_t) slot->val_t;
+    *key = slot->key;
+    *value = slot->value;
+    return 0;
+}
+
+static void write_record(struct image_writer *w, struct image_record *rec,
+    const void *key, const void *value)
+{
+    static const unsigned char zero[8];
+
+    write_image(w, rec, sizeof(struct image_record));
+    write_image(w, key, rec->klen);
+    write_image(w, zero, image_pad(rec->klen) - rec->klen);
+    if (rec->vlen != IMAGE_NULL_VALUE) {
+        write_image(w, value, rec->vlen);
+        write_image(w, zero, image_pad(rec->vlen) - rec->vlen);
+    }
+}
+
+/**
+  * HASHMAP_TYPE_CHAIN 的桶和文件中的桶一一对应，可以按桶的顺序直接写出
+  * off 为 NULL 时只统计每个桶的记录的长度，保存在 sizes 中
+  */
+static int save_chain(struct hash_map *map, struct image_writer *w, uint64_t *sizes)
+{
+    struct image_record rec;
+    const void *key, *value;
+
+    for (size_t i = 0; i < map->hm_cap; i++) {
+        struct map_entry *entry = map->hm_tab + i;
+
+        // 还在文件中的桶，原样复制它的记录
+        if (is_frozen(map, i)) {
+            struct image_record *r = NULL;
+            while ((r = next_image(map->hm_image, i, r)) != NULL) {
+                const size_t size = image_record_size(r->klen, r->vlen);
+                if (sizes != NULL)
+                    sizes[i] += size;
+                else
+                    write_image(w, r, size);
+            }
+            continue;
+        }
+
+        for (struct rb_node *node = first_node(entry); node != NULL; node = next_node(entry, node)) {
+            if (node_record(map, node, &rec, &key, &value) == -1)
+                return -1;
+            if (sizes != NULL)
+                sizes[i] += image_record_size(rec.klen, rec.vlen);
+            else
+                write_record(w, &rec, key, value);
+        }
+    }
+    return 0;
+}
+
+/**
+  * HASHMAP_TYPE_SWISS 的 slot 不按桶排列，按文件中的桶对 slot 计数排序
+  * 同时统计每个桶的记录的长度，保存在 sizes 中
+  * @return 按桶排列的 slot 的下标，出错返回 NULL
+  */
+static size_t* sort_swiss(struct hash_map *map, uint64_t *sizes, size_t cap)
+{
+    struct image_record rec;
+    const void *key, *value;
+    struct swiss_slot *slot;
+    size_t offset, i;
+
+    size_t *count = (size_t*) calloc(cap + 1, sizeof(size_t));
+    size_t *order = _MALLOC(size_t, map->hm_size + 1);
+    if (count == NULL || order == NULL) {
+        fprintf(stderr, "failed to malloc %zu slots for saving\n", map->hm_size);
+        goto fail;
+    }
+
+    for (offset = 0; (slot = next_swiss(map, &offset)) != NULL; offset ++) {
+        if (slot_record(map, slot, &rec, &key, &value) == -1)
+            goto fail;
+        sizes[rec.hash & (cap - 1)] += image_record_size(rec.klen, rec.vlen);
+        count[(rec.hash & (cap - 1)) + 1] ++;
+    }
+    for (i = 0; i < cap; i++) {
+        count[i + 1] += count[i];
+    }
+    for (offset = 0; (slot = next_swiss(map, &offset)) != NULL; offset ++) {
+        order[count[slot->hash & (cap - 1)] ++] = offset;
+    }
+    free(count);
+    return order;
+
+fail:
+    free(count);
+    free(order);
+    return NULL;
+}
+
+int save_hashmap(struct hash_map *map, int fd)
+{
+    if (map == NULL || fd < 0) {
+        return -1;
+    }
+    if (map->hm_klen == NULL) {
+        fprintf(stderr, "save_hashmap requires hm_klen\n");
+        return -1;
+    }
+    while (map->hm_old != NULL) {
+        rehash_step(map);
+    }
+
+    const int swiss = map->hm_type == HASHMAP_TYPE_SWISS;
+    const size_t cap = swiss ? fit_capacity(map, map->hm_size) : map->hm_cap;
+    struct image_writer *w = _MALLOC(struct image_writer, 1);
+    uint64_t *off = (uint64_t*) calloc(cap + 1, sizeof(uint64_t));
+    size_t *order = NULL;
+    int ret = -1;
+
+    if (w == NULL || off == NULL) {
+        fprintf(stderr, "failed to malloc %zu buckets for saving\n", cap);
+        goto out;
+    }
+    w->iw_fd = fd;
+    w->iw_error = 0;
+    w->iw_used = 0;
+
+    // 第一遍统计每个桶的记录的长度，off[i + 1] 暂时保存桶 i 的长度
+    if (swiss) {
+        if ((order = sort_swiss(map, off + 1, cap)) == NULL)
+            goto out;
+    }
+    else if (save_chain(map, NULL, off + 1) == -1) {
+        goto out;
+    }
+
+    off[0] = sizeof(struct image_header) + (cap + 1) * sizeof(uint64_t);
+    for (size_t i = 0; i < cap; i++) {
+        off[i + 1] += off[i];
+    }
+
+    struct image_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.ih_magic, IMAGE_MAGIC, sizeof(hdr.ih_magic));
+    hdr.ih_version = IMAGE_VERSION;
+    hdr.ih_endian = IMAGE_ENDIAN;
+    hdr.ih_word = sizeof(size_t);
+    hdr.ih_flags = map->hm_flags & HASHMAP_FLAG_SEED;
+    hdr.ih_seed = _IS_SEEDED(map) ? map->hm_seed : 0;
+    hdr.ih_size = map->hm_size;
+    hdr.ih_cap = cap;
+    hdr.ih_length = off[cap];
+
+    write_image(w, &hdr, sizeof(hdr));
+    write_image(w, off, (cap + 1) * sizeof(uint64_t));
+
+    // 第二遍按桶的顺序写出记录
+    if (swiss) {
+        struct image_record rec;
+        const void *key, *value;
+        for (size_t i = 0; i < map->hm_size; i++) {
+            size_t offset = order[i];
+            slot_record(map, next_swiss(map, &offset), &rec, &key, &value);
+            write_record(w, &rec, key, value);
+        }
+    }
+    else {
+        save_chain(map, w, NULL);
+    }
+    ret = flush_image(w);
+
+out:
+    free(w);
+    free(off);
+    free(order);
+    return ret;
+}
+
+/**
+  * 检查前面若干条记录的 hash，及早发现 hm_hash 和保存时不同的错误
+  * 只检查少量的桶，耗时和 hashmap 的大小无关
+  */
+static int check_image(struct hash_map *map)
+{
+    struct map_image *img = map->hm_image;
+    int checked = 0;
+
+    for (size_t i = 0; i < img->im_cap && i < 64 && checked < 8; i++) {
+        struct image_record *rec = NULL;
+        while ((rec = next_image(img, i, rec)) != NULL && checked < 8) {
+            if (hash_key(map, image_key(rec)) != rec->hash) {
+                fprintf(stderr, "hm_hash differs from the one used to save the image\n");
+                return -1;
+            }
+            checked ++;
+        }
+    }
+    return 0;
+}
+
+int load_hashmap(struct hash_map *map, const char *path)
+{
+    struct image_header hdr;
+
+    if (map == NULL || path == NULL) {
+        return -1;
+    }
+    if (map->hm_type == HASHMAP_TYPE_SWISS) {
+        fprintf(stderr, "hashmap image can not be loaded by swiss table\n");
+        return -1;
+    }
+    if (map->hm_klen == NULL) {
+        fprintf(stderr, "load_hashmap requires hm_klen\n");
+        return -1;
+    }
+
+    struct map_image *img = _MALLOC(struct map_image, 1);
+    if (img == NULL) {
+        return -1;
+    }
+    if (open_image(img, path, &hdr) == -1) {
+        free(img);
+        return -1;
+    }
+
+    if (map->hm_flags & HASHMAP_FLAG_RCU) {
+        fprintf(stderr, "HASHMAP_FLAG_RCU ignored by loaded hashmap\n");
+    }
+    map->hm_flags &= ~(HASHMAP_FLAG_RCU | HASHMAP_FLAG_SEED);
+    map->hm_flags |= HASHMAP_FLAG_KEYCOPY | (hdr.ih_flags & HASHMAP_FLAG_SEED);
+    map->hm_cap = 0;
+    map->hm_tab = NULL;
+    map->hm_slab = NULL;
+    if (set_hashmap(map) == NULL) {
+        close_image(img);
+        free(img);
+        return -1;
+    }
+    map->hm_seed = hdr.ih_seed;
+    if (map->hm_max < img->im_cap)
+        map->hm_max = img->im_cap;
+
+    /* 使用 calloc 而不是 set_hashmap 中的 memset，
+     * 大块内存由系统按页清零，没有访问过的桶不会占用物理内存
+     */
+    struct map_entry *tab = (struct map_entry*) calloc(img->im_cap, sizeof(struct map_entry));
+    if (tab == NULL) {
+        fprintf(stderr, "failed to malloc hash_map table for %zu capacity\n", img->im_cap);
+        close_image(img);
+        free(img);
+        free_hashmap(map);
+        return -1;
+    }
+    free(map->hm_tab);
+    map->hm_tab = tab;
+    map->hm_cap = img->im_cap;
+    map->hm_size = hdr.ih_size;
+    map->hm_image = img;
+
+    if (check_image(map) == -1) {
+        free_hashmap(map);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+  * 统计一棵红黑树，根节点的深度为 1
+  * 节点的深度就是查找它需要比较的次数；空的子节点的深度减 1，
+  * 是查找一个落在那里的不存在的 key 需要比较的次数
+  */
+static void stat_tree(struct rb_link *link, size_t depth,
+    size_t *hit, size_t *miss, size_t *max_depth)
+{
+    if (link == NULL) {
+        *miss += depth - 1;
+        return;
+    }
+    *hit += depth;
+    if (depth > *max_depth)
+        *max_depth = depth;
+    stat_tree(link->left, depth + 1, hit, miss, max_depth);
+    stat_tree(link->right, depth + 1, hit, miss, max_depth);
+}
+
+/**
+  * 统计 tab[from, to) 中的桶
+  * hit 累加查找每个 key 的比较次数，miss 累加每个桶中查找不存在的 key 的期望比较次数
+  */
+static void stat_entries(struct map_entry *tab, size_t from, size_t to,
+    struct hashmap_stats *stats, size_t *hit, double *miss)
+{
+    for (size_t i = from; i < to; i++) {
+        struct map_entry *entry = tab + i;
+        struct rb_node *node;
+        size_t n = 0;
+
+        for (node = first_node(entry); node != NULL; node = next_node(entry, node)) {
+            n ++;
+            stats->hs_node_bytes += sizeof(struct rb_node) + _KEY_AREA(node->key_c);
+            if (node->ttl)
+                stats->hs_node_bytes += sizeof(struct hm_timer);
+            if (node->value == node_data(node))
+                stats->hs_value_bytes += node->val_c;
+        }
+
+        stats->hs_chain[n < HASHMAP_STATS_CHAIN ? n : HASHMAP_STATS_CHAIN - 1] ++;
+        if (n == 0)
+            continue;
+        stats->hs_used ++;
+
+        if (_IS_RBTREE(entry->rbtree)) {
+            size_t tree_miss = 0;
+            stats->hs_trees ++;
+            stats->hs_node_bytes += n * sizeof(struct rb_link);
+            stat_tree(rbtree_root(entry->rbtree), 1, hit, &tree_miss, &stats->hs_tree_depth);
+            *miss += (double) tree_miss / (n + 1);
+        }
+        else {
+            // 链表中第 k 个节点需要比较 k 次，不存在的 key 需要比较整个链表
+            *hit += n * (n + 1) / 2;
+            *miss += n;
+        }
+    }
+}
+
+/**
+  * 统计还在文件中的桶，stat_entries 已经把它们当作空桶统计过了
+  * 记录不占用堆内存，不计入 hs_node_bytes 和 hs_value_bytes
+  */
+static void stat_image(struct hash_map *map, struct hashmap_stats *stats,
+    size_t *hit, double *miss)
+{
+    for (size_t i = 0; i < map->hm_cap; i++) {
+        struct image_record *rec = NULL;
+        size_t n = 0;
+
+        if (! is_frozen(map, i))
+            continue;
+        while ((rec = next_image(map->hm_image, i, rec)) != NULL)
+            n ++;
+        if (n == 0)
+            continue;
+
+        stats->hs_chain[0] --;
+        stats->hs_chain[n < HASHMAP_STATS_CHAIN ? n : HASHMAP_STATS_CHAIN - 1] ++;
+        stats->hs_used ++;
+        *hit += n * (n + 1) / 2;
+        *miss += n;
+    }
+}
+
+int stat_hashmap(struct hash_map *map, struct hashmap_stats *stats)
+{
+    if (map == NULL || stats == NULL) {
+        return -1;
+    }
+
+    memset(stats, 0, sizeof(struct hashmap_stats));
+    stats->hs_size = map->hm_size;
+    stats->hs_resizes = map->hm_resizes;
+    stats->hs_treeify = map->hm_treeify;
+    stats->hs_untreeify = map->hm_untreeify;
+    stats->hs_reseeds = map->hm_reseeds;
+    stats->hs_ops = map->hm_ops;
+
+    if (map->hm_type == HASHMAP_TYPE_SWISS) {
+        stat_swiss(map, stats);
+        return 0;
+    }
+
+    size_t hit = 0;
+    double miss = 0;
+
+    stats->hs_cap = map->hm_cap;
+    stats->hs_table_bytes = map->hm_cap * sizeof(struct map_entry);
+    stat_entries(map->hm_tab, 0, map->hm_cap, stats, &hit, &miss);
+    if (map->hm_image != NULL) {
+        stat_image(map, stats, &hit, &miss);
+    }
+
+    // 渐进式扩容期间，旧表中还没有搬迁的桶也是 hashmap 的一部分
+    if (map->hm_old != NULL) {
+        stats->hs_cap += map->hm_old_cap - map->hm_move;
+        stats->hs_table_bytes += map->hm_old_cap * sizeof(struct map_entry);
+        stat_entries(map->hm_old, map->hm_move, map->hm_old_cap, stats, &hit, &miss);
+    }
+
+    stats->hs_hit_probe = map->hm_size ? (double) hit / map->hm_size : 0;
+    stats->hs_miss_probe = stats->hs_cap ? miss / stats->hs_cap : 0;
+    return 0;
+}
+
+void debug_hashmap(struct hash_map *map)
+{
+    struct hashmap_stats st;
+    const struct hashmap_counters *ops = &st.hs_ops;
+    const int swiss = map != NULL && map->hm_type == HASHMAP_TYPE_SWISS;
+
+    if (stat_hashmap(map, &st) == -1) {
+        printf("hashmap: NULL\n");
+        return;
+    }
+
+    printf("hashmap: %s, size %zu, capacity %zu, used %zu (%.1f%%)\n",
+        swiss ? "swiss" : "chain", st.hs_size, st.hs_cap, st.hs_used,
+        st.hs_cap ? 100.0 * st.hs_used / st.hs_cap : 0);
+
+    printf("  %s:", swiss ? "probe groups" : "chain length");
+    for (int i = 0; i < HASHMAP_STATS_CHAIN; i++) {
+        if (st.hs_chain[i] != 0)
+            printf(" %d%s=%zu", i, i == HASHMAP_STATS_CHAIN - 1 ? "+" : "", st.hs_chain[i]);
+    }
+    printf("\n");
+
+    if (! swiss)
+        printf("  trees: %zu, max depth %zu\n", st.hs_trees, st.hs_tree_depth);
+    printf("  probes: hit %.2f, miss %.2f\n", st.hs_hit_probe, st.hs_miss_probe);
+    printf("  resizes: %zu, treeify %zu, untreeify %zu, reseeds %zu\n",
+        st.hs_resizes, st.hs_treeify, st.hs_untreeify, st.hs_reseeds);
+    printf("  bytes: table %zu, nodes %zu, values %zu, %.1f per entry\n",
+        st.hs_table_bytes, st.hs_node_bytes, st.hs_value_bytes,
+        st.hs_size ? (double) (st.hs_table_bytes + st.hs_node_bytes + st.hs_value_bytes) / st.hs_size : 0);
+
+    if (ops->gets + ops->puts + ops->removes != 0) {
+        printf("  ops: get %zu (hit %.1f%%, %.2f probes), put %zu, remove %zu\n",
+            ops->gets, ops->gets ? 100.0 * ops->hits / ops->gets : 0,
+            ops->gets ? (double) ops->probes / ops->gets : 0, ops->puts, ops->removes);
+    }
 }
 
 #undef _MALLOC
 #undef _REALLOC
-#undef _IS_RBTREE
\ No newline at end of file
+#undef _IS_RBTREE
+#undef _PREFETCH
+#undef _PREFETCH_DIST
+#undef _BATCH_GROUP
+#undef _IS_RCU
+#undef _PUBLISH
+#undef _ACQUIRE
+#undef _IS_KEYCOPY
+#undef _KEY_AREA
+#undef _IS_SEEDED
+#undef _USER_NODE
@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "private/image.h"
+
+int open_image(struct map_image *img, const char *path, struct image_header *hdr)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(struct image_header)) {
+        fprintf(stderr, "%s is not a hashmap image\n", path);
+        close(fd);
+        return -1;
+    }
+
+    /* 可读可写的私有映射：读者直接使用文件的页，
+     * 调用者修改 get_hashmap 返回的 value 时，内核只复制被修改的页
+     */
+    void *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "failed to mmap %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    memcpy(hdr, base, sizeof(struct image_header));
+
+    const uint64_t cap = hdr->ih_cap;
+    const char *error = NULL;
+    if (memcmp(hdr->ih_magic, IMAGE_MAGIC, sizeof(hdr->ih_magic)) != 0)
+        error = "is not a hashmap image";
+    else if (hdr->ih_version != IMAGE_VERSION)
+        error = "has an unsupported version";
+    else if (hdr->ih_endian != IMAGE_ENDIAN || hdr->ih_word != sizeof(size_t))
+        error = "was saved on a different platform";
+    else if (hdr->ih_length > (uint64_t) st.st_size ||
+            hdr->ih_length < sizeof(struct image_header) + 2 * sizeof(uint64_t))
+        error = "is truncated";
+    else if (cap == 0 || (cap & (cap - 1)) != 0 ||
+            cap > (hdr->ih_length - sizeof(struct image_header)) / sizeof(uint64_t) - 1)
+        error = "has a corrupted bucket table";
+
+    if (error != NULL) {
+        fprintf(stderr, "%s %s\n", path, error);
+        munmap(base, st.st_size);
+        return -1;
+    }
+
+    // 按页清零的 calloc，没有被修改过的桶不会占用内存
+    img->im_thawed = (unsigned char*) calloc((cap + 7) / 8, 1);
+    if (img->im_thawed == NULL) {
+        munmap(base, st.st_size);
+        return -1;
+    }
+    img->im_base = (unsigned char*) base;
+    img->im_length = st.st_size;
+    img->im_cap = cap;
+    img->im_off = (const uint64_t*) (img->im_base + sizeof(struct image_header));
+    img->im_left = cap;
+    return 0;
+}
+
+void close_image(struct map_image *img)
+{
+    munmap(img->im_base, img->im_length);
+    free(img->im_thawed);
+    memset(img, 0, sizeof(struct map_image));
+}
+
+struct image_record* next_image(struct map_image *img, size_t b, struct image_record *rec)
+{
+    const uint64_t end = img->im_off[b + 1];
+    uint64_t pos = img->im_off[b];
+
+    if (rec != NULL) {
+        pos = (unsigned char*) rec - img->im_base;
+        pos += image_record_size(rec->klen, rec->vlen);
+    }
+    if (pos >= end) {
+        return NULL;
+    }
+
+    if (end > img->im_length || pos % 8 != 0 || end - pos < sizeof(struct image_record))
+        goto corrupt;
+    rec = (struct image_record*) (img->im_base + pos);
+    if (image_record_size(rec->klen, rec->vlen) > end - pos)
+        goto corrupt;
+    return rec;
+
+corrupt:
+    fprintf(stderr, "hashmap image is corrupted at bucket %zu\n", b);
+    return NULL;
+}
+
+void write_image(struct image_writer *w, const void *p, size_t n)
+{
+    const unsigned char *src = (const unsigned char*) p;
+
+    while (n > 0 && ! w->iw_error) {
+        if (w->iw_used == IMAGE_WRITE_BUFFER && flush_image(w) == -1)
+            return;
+
+        size_t m = IMAGE_WRITE_BUFFER - w->iw_used;
+        if (m > n)
+            m = n;
+        memcpy(w->iw_buf + w->iw_used, src, m);
+        w->iw_used += m;
+        src += m;
+        n -= m;
+    }
+}
+
+int flush_image(struct image_writer *w)
+{
+    size_t done = 0;
+
+    while (done < w->iw_used && ! w->iw_error) {
+        ssize_t m = write(w->iw_fd, w->iw_buf + done, w->iw_used - done);
+        if (m == -1 && errno == EINTR)
+            continue;
+        if (m <= 0) {
+            fprintf(stderr, "failed to write hashmap image: %s\n", strerror(errno));
+            w->iw_error = 1;
+            break;
+        }
+        done += m;
+    }
+    w->iw_used = 0;
+    return w->iw_error ? -1 : 0;
+}
@@ -0,0 +1,123 @@
+#ifndef _UTIL_CHASHMAP_H
+#define _UTIL_CHASHMAP_H 1
+
+#include <stddef.h>
+#include <pthread.h>
+
+
+/** 
+  * chash_map 是可以被多个线程同时访问的 hashmap
+  * 
+  * 每个桶的头指针的最低位被用作这个桶的锁，写者只锁住自己的桶，
+  * 向空桶插入时直接使用 CAS，不需要加锁。读者完全不加锁，
+  * 被移除的节点和扩容前的旧表通过 epoch 延迟回收 (参考 private/epoch.h)
+  * 
+  * 扩容参考 Java 的 ConcurrentHashMap：旧表按区间被认领，
+  * 搬迁完的桶被替换为转发标记，读者遇到它会转到新表继续查找；
+  * 写者遇到它会先帮忙搬迁，再到新表中操作。因此扩容不会阻塞其它线程，
+  * 多个写者也能同时参与搬迁
+  * 
+  * 与 hash_map 不同的是：
+  * 1. 只保存 key 和 value 的地址，不支持 value 的副本，
+  *    因为读者拿到的副本随时可能被其它线程释放
+  * 2. 桶中只有链表，不会转换为红黑树
+  * 3. 覆盖已存在的 key 时只替换 value，保留第一次插入的 key 的地址
+  */
+
+
+/** 
+  * 扩容时每个线程一次认领的桶的数量
+  */
+#define CHASHMAP_TRANSFER_STRIDE    64
+
+/** 
+  * 用于统计节点数量的计数器的个数
+  * 不同的线程使用不同的计数器，避免所有写者竞争同一个 cache line
+  */
+#define CHASHMAP_COUNTER_CELLS      16
+
+
+struct chash_table;
+struct chash_counter;
+
+
+struct chash_map {
+    /** 初始容量、自动扩容的上限和负载因子
+      * 含义与 hash_map 相同，必须在 set_chashmap 之前指定
+      */
+    size_t cm_cap;
+    size_t cm_max;
+    float cm_load;
+
+    /** 当前的表，扩容时新表挂在旧表上
+      * 它由系统自动维护
+      */
+    struct chash_table *cm_tab;
+
+    /** 分散的节点计数器
+      * 它由系统自动维护
+      */
+    struct chash_counter *cm_count;
+
+    /** 只在发起扩容时使用，保证同一时刻只有一次扩容
+      */
+    pthread_mutex_t cm_lock;
+
+    /** 参考 hash_map.hm_hash 和 hash_map.hm_cmp
+      * 它们会被多个线程同时调用
+      */
+    size_t (*cm_hash) (const void*);
+    int (*cm_cmp) (const void*, const void*);
+};
+
+
+/** 
+  * 初始化 chash_map，没有指定的字段使用默认配置
+  * 此函数不是线程安全的
+  * 
+  * @param dst 需要初始化的 chash_map 的指针
+  * 如果为空，将会使用 malloc 动态分配，这种情况下请记得回收
+  * @return 正常完成，返回 chash_map 的指针，出错返回 NULL
+  */
+struct chash_map* set_chashmap(struct chash_map *dst);
+
+
+/** 
+  * 将键值对保存到 chash_map，可以和其它操作并发
+  * 
+  * @return 如果之前不存在 key，返回 0；否则返回 1
+  * 出错返回 -1
+  */
+int put_chashmap(struct chash_map *map, const void *key, const void *val);
+
+
+/** 
+  * 根据 key 查找 value，不加任何锁
+  * 
+  * @return value 的地址，如果没找到，则返回 NULL
+  */
+void* get_chashmap(struct chash_map *map, const void *key);
+
+
+/** 
+  * 从 chash_map 中移除某一 key，可以和其它操作并发
+  * 
+  * @return 如果之前中不存在 key，返回 0；否则返回 1
+  */
+int remove_chashmap(struct chash_map *map, const void *key);
+
+
+/** 
+  * 得到 chash_map 中键值对的数量
+  * 并发修改时，它只是一个近似值
+  */
+size_t get_chashmap_size(struct chash_map *map);
+
+
+/** 
+  * 释放 chash_map 占用的所有内存
+  * *注意* 调用时不能有其它线程正在访问它
+  */
+void free_chashmap(struct chash_map *map);
+
+#endif /* _UTIL_CHASHMAP_H */
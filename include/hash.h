@@ -0,0 +1,89 @@
+#ifndef _UTIL_HASH_H
+#define _UTIL_HASH_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** 
+  * hashmap 自带的 hash 函数
+  * 
+  * 它们都输出分布均匀的 64 位 hash，hash 的每一位都可以被用来计算桶的下标。
+  * 对于整数，使用几次乘法和移位的混合函数；对于任意字节序列，
+  * 短的 key 使用 128 位乘法折叠 (类似 wyhash)，超过 128 字节的 key
+  * 按 64 字节的条带并行累加 (类似 xxh3)，并在运行时选择 AVX2、SSE2 或标量实现，
+  * 三种实现的结果完全相同
+  * 
+  * *注意* 这些函数不是加密 hash，不能抵抗刻意构造的碰撞
+  * 
+  * 下面的 hm_xxx_hash 和 hm_xxx_cmp 可以直接赋给 hash_map.hm_hash 和 hash_map.hm_cmp
+  */
+
+
+/** 
+  * 64 位整数的混合函数，输入的每一位都会影响输出的每一位
+  */
+static inline uint64_t hash_mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+/** 
+  * 32 位整数的混合函数
+  */
+static inline uint32_t hash_mix32(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+
+/** 
+  * 计算任意字节序列的 hash
+  * @param data 数据的地址
+  * @param len 数据的长度
+  * @param seed 种子，不同的种子得到互不相关的 hash
+  */
+uint64_t hash_bytes(const void *data, size_t len, uint64_t seed);
+
+
+/** key 是 int 的地址 */
+size_t hm_int_hash(const void *key);
+int hm_int_cmp(const void *one, const void *two);
+size_t hm_int_klen(const void *key);
+
+/** key 是 int64_t 的地址 */
+size_t hm_int64_hash(const void *key);
+int hm_int64_cmp(const void *one, const void *two);
+size_t hm_int64_klen(const void *key);
+
+/** key 本身作为一个整数，比较的是地址 */
+size_t hm_ptr_hash(const void *key);
+int hm_ptr_cmp(const void *one, const void *two);
+
+/** key 是以 '\0' 结尾的字符串，hm_str_klen 的长度包括末尾的 '\0' */
+size_t hm_str_hash(const void *key);
+int hm_str_cmp(const void *one, const void *two);
+size_t hm_str_klen(const void *key);
+/** 带种子的 hm_str_hash，用于 hash_map.hm_seed_hash */
+size_t hm_str_seed_hash(const void *key, size_t seed);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _UTIL_HASH_H */
@@ -0,0 +1,140 @@
+#ifndef _UTIL_HASHCACHE_H
+#define _UTIL_HASHCACHE_H 1
+
+#include <stddef.h>
+
+#include "hashmap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+  * hash_cache 是容量有限的缓存，类似 Java 的 LinkedHashMap (accessOrder 为 true)
+  *
+  * 每个条目只分配一次内存，其中嵌入了 hash_map 的节点 (参考 put_hashmap_node)
+  * 和访问顺序链表的节点，因此查找只需要一次 get_hashmap_node，
+  * 不需要再到另一个结构中查找。get_hashcache 把命中的条目移动到表头，
+  * put_hashcache 插入到表头，超过 hc_max_count 或者 hc_max_bytes 时从表尾淘汰
+  *
+  * 开启 HASHCACHE_FLAG_CLOCK 时使用 CLOCK 近似 LRU：命中只设置条目的访问位，
+  * 不修改链表；淘汰时检查表尾，访问位为 1 的条目清除访问位后放回表头 (第二次机会)，
+  * 直到遇到访问位为 0 的条目。这样读多的场景下命中不会写链表和相邻的条目
+  *
+  * *注意* hash_cache 不是线程安全的，开启 HASHCACHE_FLAG_CLOCK 时 get 也会写条目
+  */
+
+
+/**
+  * 使用 CLOCK 代替严格的 LRU，参考上面的说明
+  */
+#define HASHCACHE_FLAG_CLOCK        0x1
+
+
+struct list;
+
+
+struct hash_cache {
+    /** 保存条目的 hashmap
+      * 需要在 set_hashcache 之前指定 hm_hash 和 hm_cmp 等，和 set_hashmap 相同
+      * *注意* 必须是 HASHMAP_TYPE_CHAIN，不能开启 HASHMAP_FLAG_KEYCOPY 和 HASHMAP_FLAG_RCU
+      */
+    struct hash_map hc_map;
+
+    /** 条目数量的上限，为 0 时不限制 */
+    size_t hc_max_count;
+
+    /** 所有条目占用的字节数的上限，为 0 时不限制
+      * 每个条目按照它本身的大小加上 value 副本的长度计算，参考 hc_bytes
+      */
+    size_t hc_max_bytes;
+
+    /** 参考 HASHCACHE_FLAG_CLOCK
+      * 必须在 set_hashcache 之前指定，此后不允许修改
+      */
+    unsigned int hc_flags;
+
+    /** 目前所有条目占用的字节数
+      * 它由系统自动维护
+      */
+    size_t hc_bytes;
+
+    /** 被淘汰的条目的数量
+      * 它由系统自动维护
+      */
+    size_t hc_evictions;
+
+    /** 按访问顺序排列的条目，表头是最近访问的
+      * 它由系统自动维护
+      */
+    struct list *hc_lru;
+
+    /** 条目因为容量不足被淘汰时调用，可以为 NULL
+      * 调用时条目已经从缓存中移除，value 的副本归缓存所有，仍然有效，返回后才会被释放
+      * key 不是副本，而是调用者传给 put_hashcache 的指针
+      * 被 put_hashcache 覆盖或者被 remove_hashcache 移除的条目不会调用它
+      * *注意* 其中不允许修改这个缓存
+      */
+    void (*hc_evict) (void *key, void *value, void *arg);
+    void *hc_arg;
+};
+
+
+/**
+  * 初始化 hash_cache，hc_map 按照 set_hashmap 初始化
+  *
+  * @param dst 需要初始化的 hash_cache 的指针
+  * 如果为空，将会使用 malloc 动态分配，这种情况下请记得回收
+  * @return 正常完成，返回 hash_cache 的指针，出错返回 NULL
+  */
+struct hash_cache* set_hashcache(struct hash_cache *dst);
+
+
+/**
+  * 将键值对保存到缓存，并放到表头，参数的含义和 put_hashmap 相同
+  * key 已经存在时，旧的条目被替换；之后如果超过了容量，从表尾开始淘汰，
+  * 新插入的条目本身不会被淘汰
+  *
+  * @return 如果之前不存在 key，返回 0；否则返回 1
+  * 出错返回 -1，此时缓存保持不变
+  */
+int put_hashcache(struct hash_cache *cache, const void *key,
+  const void *val, size_t val_t);
+
+
+/**
+  * 根据 key 查找 value，命中时把条目移动到表头，
+  * 开启 HASHCACHE_FLAG_CLOCK 时只设置访问位
+  *
+  * @return value 的地址，如果没找到，则返回 NULL
+  */
+void* get_hashcache(struct hash_cache *cache, const void *key);
+
+
+/**
+  * 从缓存中移除某一 key，不会调用 hc_evict
+  *
+  * @return 如果之前中不存在 key，返回 0；否则返回 1
+  * 出错返回 -1
+  */
+int remove_hashcache(struct hash_cache *cache, const void *key);
+
+
+/**
+  * 得到缓存中条目的数量
+  */
+size_t get_hashcache_size(struct hash_cache *cache);
+
+
+/**
+  * 释放缓存占用的所有内存，不会调用 hc_evict
+  * 此后这个缓存无法再次使用，除非使用 set_hashcache 重新初始化
+  */
+void free_hashcache(struct hash_cache *cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
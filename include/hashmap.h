@@ -3,7 +3,15 @@
 #ifndef _UTIL_HASHMAP_H
 #define _UTIL_HASHMAP_H 1
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "map.h"
+#include "rbtree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 
 /** 
@@ -21,12 +29,12 @@
 
 
 /** 
-  * hashmap 的最大容量
-  * 超过这个值不会再自动扩容
-  * *注意* 这个值指的是节点的个数，而不是占用空间
+  * hashmap 的默认最大容量，可以通过 hash_map.hm_max 修改
+  * 容量达到这个值之后不会再自动扩容，但仍然可以继续插入
+  * *注意* 这个值指的是桶(bucket)的个数，而不是节点的个数或占用空间
   * 必须是 2 的整次幂
   */
-#define HASHMAP_MAX_CAPACITY    4096
+#define HASHMAP_MAX_CAPACITY    ((size_t) 1 << (sizeof(size_t) * 8 - 4))
 
 /** 
   * hashmap 的默认负载因子
@@ -61,14 +69,122 @@
 /** 
   * 默认的 hashcode 函数实现
   * 它实际上使用地址作为 hashcode，
-  * 因此不建议使用它
+  * 因此不建议使用它，include/hash.h 提供了常用类型的 hash 函数
   */
 #define HASHMAP_DEF_HASHCODE    _hm_ptr_hash
 
+/** 
+  * hashmap 的存储引擎，通过 hash_map.hm_type 选择
+  * 
+  * HASHMAP_TYPE_CHAIN 是默认的引擎，使用链表和红黑树解决碰撞
+  * 
+  * HASHMAP_TYPE_SWISS 使用开放寻址法，键值对平铺在连续的数组中，
+  * 每个 slot 对应一个保存 hash 低 7 位的控制字节，查找时借助 SSE2
+  * 一次比较 16 个控制字节，通常只需要一次 cache miss 就能命中。
+  * 它适合读多写少的场景
+  */
+#define HASHMAP_TYPE_CHAIN      0
+#define HASHMAP_TYPE_SWISS      1
+
+/** 
+  * hashmap 的可选特性，通过 hash_map.hm_flags 按位组合
+  * 
+  * HASHMAP_FLAG_INCREMENTAL 开启渐进式扩容
+  * 默认情况下，扩容会在某一次 put_hashmap 中一次性完成再散列，
+  * 耗时和 hashmap 的大小成正比。开启后，新表和旧表会同时存在，
+  * 之后的每次 put/get/remove 只搬迁少量的桶，直到旧表被搬空，
+  * 这样单次操作的最坏耗时不再和 hashmap 的大小有关
+  * *注意* 只对 HASHMAP_TYPE_CHAIN 有效
+  */
+#define HASHMAP_FLAG_INCREMENTAL        0x1
+
+/** 
+  * HASHMAP_FLAG_SLAB 使用 hashmap 私有的 slab 分配节点
+  * 节点和 value 的副本按大小分级，从连续的大页中切分出来，
+  * 被移除的节点会放回空闲链表等待复用。clear_hashmap 和 free_hashmap
+  * 不再逐个释放节点，而是一次性归还所有的页
+  * *注意* 只对 HASHMAP_TYPE_CHAIN 有效
+  */
+#define HASHMAP_FLAG_SLAB               0x2
+
+/** 
+  * HASHMAP_FLAG_RCU 允许一个写者和任意多个读者同时访问 hashmap
+  * 读者的 get_hashmap 不加锁，写者使用 release 语义发布修改，
+  * 被移除的节点和扩容前的旧表延迟到所有读者离开后再释放 (参考 private/epoch.h)
+  * 读者在扩容期间没找到 key 时会重试，找到时不受影响
+  * 
+  * 这种模式下：
+  * 1. 所有的写操作必须来自同一个线程，或者由调用者加锁串行化
+  * 2. 读者只能使用 get_hashmap 和 get_hashmap_batch，不能遍历
+  * 3. 覆盖已存在的 key 时，value 的副本总是写入新节点，不会原地修改
+  * 4. 链表不会转为红黑树，红黑树的旋转无法对读者保持一致
+  * 5. 不支持 HASHMAP_FLAG_INCREMENTAL 和 HASHMAP_FLAG_SLAB，
+  *    以及 HASHMAP_TYPE_SWISS，它们会被忽略
+  * 6. 不会缩容，hm_min_load 被调整为 0，shrink_hashmap 返回 -1
+  * *注意* 如果 val_t 不是 0，get_hashmap 返回的副本随时可能被写者替换，
+  * 读者需要在 read_lock_hashmap 和 read_unlock_hashmap 之间使用它
+  */
+#define HASHMAP_FLAG_RCU                0x4
+
+/** 
+  * HASHMAP_FLAG_KEYCOPY 让 hashmap 保存 key 的副本，类似 put_hashmap 的 val_t
+  * key 的长度由 hash_map.hm_klen 给出，副本和节点在同一次分配中，
+  * 紧跟在节点后面，value 的副本再排在它之后。这样：
+  * 1. 调用者不需要保证 key 在 put_hashmap 之后仍然有效
+  * 2. 链表中的比较先检查 hash 和长度，再用一次 memcmp 完成，
+  *    不需要调用 hm_cmp，也不需要访问调用者的内存，短 key 通常和 hash 在同一个 cache line 中
+  * 
+  * 这种模式下，两个 key 相等当且仅当它们的 hm_klen 个字节相同，
+  * hm_cmp 只用于红黑树中 hash 相同的 key 的排序，它的结果必须和字节比较一致
+  * get_hashmap 等函数返回或者遍历得到的 key 是副本的地址
+  * *注意* key 的长度不能超过 HASHMAP_MAX_KEY_COPY，否则 put_hashmap 返回 -1
+  * *注意* 只对 HASHMAP_TYPE_CHAIN 有效
+  */
+#define HASHMAP_FLAG_KEYCOPY            0x8
+
+/** 
+  * HASHMAP_FLAG_KEYCOPY 模式下 key 的最大长度
+  */
+#define HASHMAP_MAX_KEY_COPY    0xffff
+
+/** 
+  * HASHMAP_FLAG_SEED 为每个 hashmap 选择一个随机的种子，混入桶的 hash 中，
+  * 攻击者无法预先构造出落在同一个桶中的 key
+  * 如果指定了 hm_seed_hash，种子直接传给它；否则对 hm_hash 的结果
+  * 异或种子后再混合一次，这只能打散 hm_hash 低位的碰撞，完全相同的
+  * hm_hash 仍然会碰撞，因此面对不可信的 key 时应当提供 hm_seed_hash
+  * 
+  * 对于 HASHMAP_TYPE_CHAIN，某个桶的长度达到 HASHMAP_RESEED_CHAIN 时，
+  * 说明 hash 的分布已经不正常，hashmap 会更换种子，原地重新散列所有节点
+  * 为了避免在无法打散的碰撞上反复重新散列，两次自动更换种子之间，
+  * hashmap 的大小至少要翻倍，因此均摊代价仍然是 O(1)
+  * *注意* 开启 HASHMAP_FLAG_RCU 时不会自动更换种子
+  * *注意* 更换种子之后，scan_hashmap 的游标不再保证能访问到所有的键值对
+  */
+#define HASHMAP_FLAG_SEED               0x10
+
+/** 
+  * 触发自动更换种子的桶的长度，参考 HASHMAP_FLAG_SEED
+  * hash 分布均匀时，负载因子为 0.75 的 hashmap 几乎不可能出现这么长的桶
+  */
+#define HASHMAP_RESEED_CHAIN    32
+
+/** 
+  * 渐进式扩容时，每次操作最多搬迁的非空桶的数量
+  */
+#define HASHMAP_REHASH_STEP     4
+
+/** 
+  * 扩容前的容量达到这个值时，才会按 hash_map.hm_threads 使用多个线程扩容
+  * 更小的表单线程扩容只需要几毫秒，不值得创建线程
+  */
+#define HASHMAP_PARALLEL_RESIZE ((size_t) 1 << 16)
+
 
-static int _hm_ptr_hash(const void *key)
+static size_t _hm_ptr_hash(const void *key)
 {
-    return *((int*) &key);
+    // 地址的低位总是 0，乘以一个奇数常量把信息带到高位，再由 spread_hash 折叠回来
+    return (size_t) key * (size_t) 0x9e3779b97f4a7c15ull;
 }
 
 
@@ -80,23 +196,102 @@ static int _hm_ptr_hash(const void *key)
 
 static int _hm_ptr_cmp(const void *one, const void *two)
 {
-    return (int) (one - two);
+    // 地址相减可能溢出 int，而且在 C++ 中不合法
+    return one < two ? -1 : one > two;
 }
 
 
+/** 
+  * hashmap_stats 中链表长度直方图的桶数
+  * 最后一个桶统计长度不小于 HASHMAP_STATS_CHAIN - 1 的所有链表
+  */
+#define HASHMAP_STATS_CHAIN     16
+
+/** 
+  * 每次操作的计数器，只有在编译 hashmap.c 和 swiss.c 时定义了
+  * HASHMAP_STATS 才会更新，否则相关代码完全不会被编译，例如
+  *   make CFLAGS="-Wall -g -DHASHMAP_STATS"
+  * 使用 relaxed 原子操作累加，开启 HASHMAP_FLAG_RCU 时读者也可以安全地计数
+  */
+struct hashmap_counters {
+    /** get_hashmap 的次数，以及其中找到 key 的次数 */
+    size_t gets;
+    size_t hits;
+
+    /** 所有 get_hashmap 一共比较过的节点数，swiss 为探测过的组数 */
+    size_t probes;
+
+    size_t puts;
+    size_t removes;
+};
+
+/** 
+  * stat_hashmap 的结果
+  */
+struct hashmap_stats {
+    size_t hs_size;
+
+    /** 桶的数量，渐进式扩容期间包括旧表中还没有搬迁的桶 */
+    size_t hs_cap;
+
+    /** 非空的桶的数量 */
+    size_t hs_used;
+
+    /** hs_chain[i] 是包含 i 个节点的桶的数量
+      * 对于 HASHMAP_TYPE_SWISS，是需要探测 i 组才能找到的 key 的数量
+      */
+    size_t hs_chain[HASHMAP_STATS_CHAIN];
+
+    /** 红黑树的数量和最大深度，根节点的深度为 1 */
+    size_t hs_trees;
+    size_t hs_tree_depth;
+
+    /** 查找每个已存在的 key 平均需要比较的节点数，
+      * 以及查找一个不存在的 key 的期望比较次数 (假设 hash 均匀分布)
+      * 对于 HASHMAP_TYPE_SWISS，是探测的组数
+      */
+    double hs_hit_probe;
+    double hs_miss_probe;
+
+    /** 参考 hash_map.hm_resizes */
+    size_t hs_resizes;
+    size_t hs_treeify;
+    size_t hs_untreeify;
+    size_t hs_reseeds;
+
+    /** 表、节点 (包括 key 的副本) 和 value 的副本占用的字节数
+      * 不包括 malloc 和 slab 自身的开销
+      */
+    size_t hs_table_bytes;
+    size_t hs_node_bytes;
+    size_t hs_value_bytes;
+
+    struct hashmap_counters hs_ops;
+};
+
+
 struct map_entry;
+struct swiss_table;
+struct hm_slab;
+struct map_image;
+struct timer_wheel;
 
 
 struct hash_map {
     /** hashmap 目前的容量
       * *注意* 这个值必须是 2 的整次幂
       */
-    unsigned int hm_cap;
+    size_t hm_cap;
 
     /** hashmap 目前存储的节点数量
       * 它由系统自动维护
       */
-    unsigned int hm_size;
+    size_t hm_size;
+
+    /** hashmap 自动扩容的上限
+      * 参考 HASHMAP_MAX_CAPACITY
+      */
+    size_t hm_max;
 
     /** 链表转为红黑树的阈值
       * 参考 HASHMAP_DEF_TREE_THRESHOLD
@@ -116,19 +311,115 @@ struct hash_map {
       */
     float hm_load;
 
+    /** hashmap 自动缩容的负载因子，为 0 时不会自动缩容
+      * 移除键值对之后，当 size 和 capacity 的比值低于这个值时，
+      * hashmap 会缩小到比值不超过 hm_load / 2 的最小容量
+      * 它不能超过 hm_load / 4，否则会被调整为 hm_load / 4
+      * 这样缩容之后的比值介于两者之间，需要插入或移除足够多的键值对
+      * 才会再次扩容或缩容，不会来回抖动
+      * *注意* 即使开启了 HASHMAP_FLAG_INCREMENTAL，缩容也是一次性完成的
+      * *注意* 开启 HASHMAP_FLAG_RCU 时不会自动缩容
+      */
+    float hm_min_load;
+
+    /** 扩容时使用的线程数，不大于 1 时在调用者的线程中完成
+      * 容量达到 HASHMAP_PARALLEL_RESIZE 之后，每次扩容会临时创建线程，
+      * 把旧表的桶平均分给它们，各自拆分链表和红黑树，全部完成后才返回
+      * *注意* 对渐进式扩容和 HASHMAP_TYPE_SWISS 无效
+      */
+    int hm_threads;
+
     /** 保存键值对的数组
       */
     struct map_entry *hm_tab;
 
+    /** 存储引擎，参考 HASHMAP_TYPE_CHAIN
+      * 必须在 set_hashmap 之前指定，此后不允许修改
+      */
+    unsigned int hm_type;
+
+    /** HASHMAP_TYPE_SWISS 引擎使用的表
+      * 它由系统自动维护
+      */
+    struct swiss_table *hm_swiss;
+
+    /** 可选特性，参考 HASHMAP_FLAG_INCREMENTAL
+      * 必须在 set_hashmap 之前指定，此后不允许修改
+      */
+    unsigned int hm_flags;
+
+    /** 渐进式扩容时的旧表、旧表的容量，以及下一个要搬迁的桶
+      * 旧表中下标小于 hm_move 的桶都已经搬迁到 hm_tab 中
+      * 它们由系统自动维护，不在扩容时 hm_old 为 NULL
+      */
+    struct map_entry *hm_old;
+    size_t hm_old_cap;
+    size_t hm_move;
+
+    /** 开启 HASHMAP_FLAG_SLAB 时，用于分配节点的 slab
+      * 它由系统自动维护
+      */
+    struct hm_slab *hm_slab;
+
+    /** load_hashmap 映射的文件，还没有被修改过的桶直接在其中查找
+      * 它由系统自动维护，参考 load_hashmap
+      */
+    struct map_image *hm_image;
+
+    /** put_hashmap_ttl 使用的时间轮，第一次设置 TTL 时分配
+      * 它由系统自动维护，参考 expire_hashmap
+      */
+    struct timer_wheel *hm_wheel;
+
+    /** 开启 HASHMAP_FLAG_RCU 时，每次扩容开始和结束各加 1
+      * 读者据此判断查找期间是否发生过扩容
+      * 它由系统自动维护
+      */
+    size_t hm_seq;
+
+    /** 扩容的次数，以及链表转为红黑树、红黑树转为链表的次数
+      * 它们由系统自动维护，参考 stat_hashmap
+      */
+    size_t hm_resizes;
+    size_t hm_treeify;
+    size_t hm_untreeify;
+
+    /** 开启 HASHMAP_FLAG_SEED 时的种子，以及更换种子的次数
+      * 如果在 set_hashmap 之前 hm_seed 不为 0，它会作为初始的种子，否则随机选择
+      * hm_reseed_size 是上一次更换种子时 hashmap 的大小
+      */
+    size_t hm_seed;
+    size_t hm_reseeds;
+    size_t hm_reseed_size;
+
+    /** 参考 hashmap_counters，它由系统自动维护 */
+    struct hashmap_counters hm_ops;
+
     /** hashCode 函数，用来根据 key 计算出 hash
+      * hash 的每一位都可能参与计算桶的下标，因此应当尽量使用完整的 size_t
       * 大多数情况下，你需要更换它
       */
-    int (*hm_hash) (const void*);
+    size_t (*hm_hash) (const void*);
 
     /** 用来比较两个 key 是否相等的函数
       * 大多数情况下，你需要更换它
       */
     int (*hm_cmp) (const void*, const void*);
+
+    /** 可选的带种子的 hashCode 函数，参考 HASHMAP_FLAG_SEED
+      * 如果指定了它，开启 HASHMAP_FLAG_SEED 时使用它代替 hm_hash
+      */
+    size_t (*hm_seed_hash) (const void*, size_t seed);
+
+    /** 开启 HASHMAP_FLAG_KEYCOPY 时，用来得到 key 的字节数的函数
+      * 它的返回值必须大于 0，include/hash.h 提供了常用类型的实现
+      */
+    size_t (*hm_klen) (const void*);
+
+    /** TTL 使用的时钟，返回单调递增的 tick，为 NULL 时使用 CLOCK_MONOTONIC 的毫秒数
+      * 参考 put_hashmap_ttl
+      */
+    uint64_t (*hm_clock) (void);
 };
 
 /**
@@ -136,7 +427,7 @@ struct hash_map {
   * @param map hashmap
   * @return size
   */
-int get_hashmap_size(struct hash_map *map);
+size_t get_hashmap_size(struct hash_map *map);
 
 
 /** 
@@ -166,6 +457,39 @@ int put_hashmap(struct hash_map *map, const void *key,
   const void *val, size_t val_t);
 
 
+/**
+  * 和 put_hashmap 相同，但是键值对在 ttl 个 tick 之后过期，tick 由 hm_clock 给出
+  * 过期的键值对在 get_hashmap 时被发现并移除 (惰性过期)，
+  * 或者由调用者定期调用 expire_hashmap 移除
+  *
+  * 节点的定时器和节点在同一次分配中，放在 value 的副本之后，
+  * 所有的定时器挂在 hashmap 的分层时间轮上，设置和取消都是 O(1)
+  * 已经存在的 key 会使用新的 TTL；之后用 put_hashmap 覆盖它时，TTL 被取消
+  * *注意* 只对 HASHMAP_TYPE_CHAIN 有效，不支持 HASHMAP_FLAG_RCU，
+  * 遍历和 save_hashmap 不会检查 TTL，可能得到已经过期但还没有被移除的键值对
+  *
+  * @param ttl 存活的 tick 数，为 0 时和 put_hashmap 相同
+  * @return 如果之前不存在 key，返回 0；否则返回 1
+  * 出错返回 -1
+  */
+int put_hashmap_ttl(struct hash_map *map, const void *key,
+  const void *val, size_t val_t, uint64_t ttl);
+
+
+/**
+  * 移除到期时间不晚于 now 的键值对，最多移除 budget 个，
+  * 没有移除完的留给下一次调用，适合放在事件循环中定期调用
+  * 耗时和到期的键值对的数量成正比，再加上时间轮推进经过的槽，
+  * 后者每 64 个 tick 最多访问一次，和 hashmap 的大小无关
+  *
+  * @param map hashmap 的地址
+  * @param now 当前的 tick，和 hm_clock 使用相同的单位
+  * @param budget 最多移除的数量，为 0 时不限制
+  * @return 移除的键值对的数量
+  */
+size_t expire_hashmap(struct hash_map *map, uint64_t now, size_t budget);
+
+
 /** 
   * 根据 key 从 hashmap 中查找 value
   * 此函数会调用 map.hm_hash 计算 key 的 hash
@@ -173,6 +497,8 @@ int put_hashmap(struct hash_map *map, const void *key,
   * 
   * @param map hashmap 的地址
   * @param key key 的地址
+  * 已经过期的键值对 (参考 put_hashmap_ttl) 会在这里被移除
+  * 
   * @return value 的地址，如果没找到，则返回 NULL
   * *注意* 如果在 put_hashmap() 中指定了 val_t，
   * 则会返回副本 value 的地址
@@ -191,6 +517,120 @@ void* get_hashmap(struct hash_map *map, const void *key);
   */
 int remove_hashmap(struct hash_map *map, const void *key);
 
+/** 
+  * 批量查找，相当于对每个 key 调用 get_hashmap
+  * 同一组 key 先全部计算 hash，再分阶段预取桶、节点和 key，
+  * 让多个 cache miss 同时进行。适合一次处理几十到几百个 key
+  * 
+  * @param map hashmap 的地址
+  * @param keys n 个 key 的地址
+  * @param n key 的数量
+  * @param values 用于返回 n 个 value 的地址，没找到的为 NULL
+  * @return 找到的 key 的数量
+  */
+size_t get_hashmap_batch(struct hash_map *map, const void *const *keys, 
+  size_t n, void **values);
+
+
+/** 
+  * 批量插入，相当于按顺序对每个键值对调用 put_hashmap
+  * 
+  * @param map hashmap 的地址
+  * @param keys n 个 key 的地址
+  * @param vals n 个 value 的地址
+  * @param val_t 每个 value 的长度，参考 put_hashmap
+  * @param n 键值对的数量
+  * @return 新插入的 key 的数量，出错返回 -1，此时之前的键值对已经插入
+  */
+int put_hashmap_batch(struct hash_map *map, const void *const *keys, 
+  const void *const *vals, size_t val_t, size_t n);
+
+
+/**
+  * 多线程批量建立 hashmap，用于启动时一次性装入大量的键值对
+  * 结果和按顺序对每个键值对调用 put_hashmap(map, key, val, 0) 相同，重复的 key 后者覆盖前者
+  *
+  * 先一次性分配足够的容量，各线程并行地计算 hash，再按桶的下标把键值对
+  * 划分到若干个互不相交的区间，每个区间由一个线程独占地建立链表和红黑树
+  * 开启 HASHMAP_FLAG_SLAB 时，每个线程从自己的 slab 中整页地分配节点，
+  * 完成后合并到 hashmap 的 slab 中；否则每个线程各自 malloc
+  *
+  * hashmap 不为空，或者是 HASHMAP_TYPE_SWISS 时，退化为 put_hashmap_batch
+  * *注意* 期间不允许其它线程修改 hashmap，开启 HASHMAP_FLAG_RCU 时读者仍然可以访问
+  *
+  * @param map hashmap 的地址
+  * @param keys n 个 key 的地址
+  * @param vals n 个 value 的地址，和 put_hashmap 的 val_t 为 0 时一样，只保存地址
+  * @param n 键值对的数量
+  * @param nthreads 线程数，不大于 0 时使用所有在线的 CPU
+  * @return 新插入的 key 的数量，出错返回 -1，此时 hashmap 保持不变
+  */
+int build_hashmap_bulk(struct hash_map *map, const void *const *keys,
+  const void *const *vals, size_t n, int nthreads);
+
+
+/** 
+  * 批量移除，相当于按顺序对每个 key 调用 remove_hashmap
+  * 
+  * @return 被移除的 key 的数量
+  */
+size_t remove_hashmap_batch(struct hash_map *map, const void *const *keys, size_t n);
+
+
+/**
+  * 侵入式接口，类似 Linux 的 hlist 和 rb_node
+  * 调用者把 struct rb_node (include/rbtree.h) 嵌入到自己的结构体中，
+  * hashmap 直接链接这个节点，不会为键值对分配内存或者复制 key 和 value，
+  * 只有桶转为红黑树时才会分配 rb_link。查找得到节点后，用 hashmap_entry 找到外层的结构体
+  *
+  *   struct record { int id; struct rb_node node; ... };
+  *   put_hashmap_node(map, &rec->node, &rec->id, rec, &old);
+  *   struct rb_node *n = get_hashmap_node(map, &id);
+  *   struct record *r = n ? hashmap_entry(n, struct record, node) : NULL;
+  *
+  * 节点的内存始终属于调用者：remove_hashmap、clear_hashmap 和 free_hashmap
+  * 只会把它摘下，不会释放；节点在 hashmap 中期间不允许释放或者修改它
+  * 同一个 hashmap 中可以混用 put_hashmap，但 put_hashmap 覆盖 key 时，
+  * 如果 val_t 不为 0，调用者的节点同样只是被摘下
+  * *注意* 不支持 HASHMAP_TYPE_SWISS、HASHMAP_FLAG_KEYCOPY 和 HASHMAP_FLAG_RCU，
+  * 以及 load_hashmap 加载的 hashmap
+  */
+#define hashmap_entry(ptr, type, member) \
+    ((type*) ((char*) (ptr) - offsetof(type, member)))
+
+/**
+  * 把调用者的节点链接到 hashmap，节点原来的内容会被覆盖
+  *
+  * @param map hashmap 的地址
+  * @param node 调用者的节点，不能已经在某个 hashmap 中
+  * @param key key 的地址，和 put_hashmap 一样只保存地址
+  * @param val value 的地址，get_hashmap 返回它
+  * @param old 用于返回被替换下来的调用者的旧节点，没有时为 NULL，可以传入 NULL
+  * @return 如果之前不存在 key，返回 0；否则返回 1
+  * 出错返回 -1，此时 hashmap 保持不变
+  */
+int put_hashmap_node(struct hash_map *map, struct rb_node *node,
+  const void *key, const void *val, struct rb_node **old);
+
+/**
+  * 根据 key 查找节点，和 get_hashmap 相同，但是返回节点本身
+  *
+  * @return 保存 key 的节点，没找到返回 NULL
+  */
+struct rb_node* get_hashmap_node(struct hash_map *map, const void *key);
+
+/**
+  * 把节点从 hashmap 中摘下，不需要比较 key，不会释放节点
+  * 节点位于红黑树中时为 O(log n)，否则只遍历它所在的链表
+  *
+  * @param map hashmap 的地址
+  * @param node 由 put_hashmap_node 链接的节点，或者已经被摘下的这样的节点
+  * @return 如果节点在 hashmap 中，返回 1；否则返回 0
+  * 出错返回 -1
+  */
+int remove_hashmap_node(struct hash_map *map, struct rb_node *node);
+
+
 /** 
   * 释放 hashmap 占用的所有内存(包括键值对)
   * 此后这个 hashmap 无法再次使用，
@@ -209,6 +649,16 @@ void clear_hashmap(struct hash_map *map);
 
 /** 
   * 得到 hashmap 的迭代器，用于遍历每一个键值对
+  * 每次调用 iter.has_next(&iter, map) 前进到下一个键值对，
+  * 返回 1 时 iter.key 和 iter.value 有效，遍历结束返回 0
+  * 
+  *   struct map_iterator iter;
+  *   read_hashmap(map, &iter);
+  *   while (iter.has_next(&iter, map)) { ... }
+  * 
+  * *注意* 遍历期间不允许修改 hashmap
+  * 如果渐进式扩容还没有结束，此函数会先一次性完成搬迁
+  * 
   * @param map hashmap
   * @param iter iter
   * @return 完成返回 0，出错返回 -1
@@ -216,10 +666,124 @@ void clear_hashmap(struct hash_map *map);
 int read_hashmap(struct hash_map *map, struct map_iterator *iter);
 
 
+/** 
+  * 可以分多次完成的遍历，类似 redis 的 SCAN
+  * 第一次调用时 cursor 为 0，之后传入上一次的返回值，直到返回 0
+  * 游标按照二进制逆序递增，因此两次调用之间 hashmap 可以被修改、扩容：
+  * 从头到尾都存在的键值对至少会被访问一次，但可能被访问多次
+  * 
+  * @param map hashmap
+  * @param cursor 游标
+  * @param count 本次最多访问的桶的数量，至少为 1
+  * @param fn 对每个键值对调用，*注意* fn 中不允许修改 hashmap
+  * @param arg 传给 fn 的参数
+  * @return 下一次调用使用的游标，遍历结束返回 0
+  */
+size_t scan_hashmap(struct hash_map *map, size_t cursor, size_t count,
+    void (*fn)(void *key, void *value, void *arg), void *arg);
+
+
+/** 
+  * 开启 HASHMAP_FLAG_RCU 时，标记读者临界区的开始和结束
+  * 在这期间 get_hashmap 返回的 value 副本不会被释放
+  * 允许嵌套，不会阻塞写者
+  */
+void read_lock_hashmap(struct hash_map *map);
+
+void read_unlock_hashmap(struct hash_map *map);
+
+
+/** 
+  * 更换 hashmap 的种子，并重新散列所有的键值对，参考 HASHMAP_FLAG_SEED
+  * 不会分配新的节点，渐进式扩容还没有结束时，会先一次性完成搬迁
+  * 
+  * @param map 开启了 HASHMAP_FLAG_SEED 的 hashmap
+  * @return 完成返回 0，出错返回 -1
+  * 没有开启 HASHMAP_FLAG_SEED，或者开启了 HASHMAP_FLAG_RCU 时也返回 -1
+  */
+int reseed_hashmap(struct hash_map *map);
+
+
+/**
+  * 预留空间，使 hashmap 在保存 n 个键值对之前都不需要扩容
+  * 一次性扩大到足够的容量，而不是每次翻倍；容量已经足够时什么也不做
+  * 容量不会超过 hm_max，渐进式扩容还没有结束时，会先一次性完成搬迁
+  *
+  * @param map hashmap
+  * @param n 键值对的数量
+  * @return 完成返回 0，出错返回 -1，此时 hashmap 保持不变
+  */
+int reserve_hashmap(struct hash_map *map, size_t n);
+
+
+/**
+  * 把 hashmap 缩小到能够容纳现有键值对的最小容量，参考 hm_min_load
+  * 不会分配新的节点，渐进式扩容还没有结束时，会先一次性完成搬迁
+  *
+  * @param map hashmap
+  * @return 完成返回 0，出错返回 -1，此时 hashmap 保持不变
+  * 开启 HASHMAP_FLAG_RCU 时不支持缩容，也返回 -1
+  */
+int shrink_hashmap(struct hash_map *map);
+
+
+/** 
+  * 把 hashmap 的所有键值对保存到 fd，之后可以用 load_hashmap 直接映射到内存中
+  * 文件中只有偏移没有指针，带有版本号，只能被相同字节序和字长的机器加载
+  * key 的长度由 hm_klen 给出，value 必须是 put_hashmap 时 val_t 不为 0 的副本
+  * (或者 NULL)，只保存了地址的 value 无法保存
+  * 渐进式扩容还没有结束时，会先一次性完成搬迁
+  * *注意* 从 slab 中分配的 value 按照副本的容量保存，可能包含多余的字节
+  * 
+  * @param map hashmap，必须指定 hm_klen
+  * @param fd 打开的文件，从当前位置开始写入，不会调用 fsync
+  * @return 完成返回 0，出错返回 -1，此时 fd 中可能已经写入了一部分内容
+  */
+int save_hashmap(struct hash_map *map, int fd);
+
+
+/** 
+  * 把 save_hashmap 保存的文件映射到内存中，作为 map 的内容
+  * map 需要像 set_hashmap 一样事先指定 hm_hash, hm_cmp 和 hm_klen 等，
+  * 并且和保存时的 hash 函数相同，hm_cap 和 hm_seed 从文件中读取
+  * 
+  * 加载时不会读取或者复制键值对，耗时和 hashmap 的大小无关
+  * get_hashmap 直接在映射的内存中查找，返回的 key 和 value 也位于其中；
+  * 某个桶第一次被 put_hashmap 或 remove_hashmap 修改时，才把这个桶复制成普通的节点，
+  * 扩容、更换种子和 read_hashmap 等需要整张表的操作会一次性复制剩下的桶
+  * 
+  * 加载后的 hashmap 总是开启 HASHMAP_FLAG_KEYCOPY，不支持 HASHMAP_FLAG_RCU 和 HASHMAP_TYPE_SWISS
+  * *注意* 映射在 clear_hashmap 或 free_hashmap 之前一直有效，桶被复制之后，
+  * 之前得到的 value 的地址仍然可以访问，但是不会再反映对 hashmap 的修改
+  * 
+  * @param map 还没有 set_hashmap 的 hashmap，和 set_hashmap 一样由调用者分配
+  * @param path save_hashmap 写入的文件
+  * @return 完成返回 0，出错返回 -1
+  */
+int load_hashmap(struct hash_map *map, const char *path);
+
+
+/** 
+  * 统计 hashmap 的状态，用来判断 hm_hash 的分布是否足够均匀
+  * 需要遍历所有的桶和节点，不会分配内存
+  * *注意* 期间不允许修改 hashmap
+  * 
+  * @param map hashmap
+  * @param stats 用于返回统计结果
+  * @return 完成返回 0，出错返回 -1
+  */
+int stat_hashmap(struct hash_map *map, struct hashmap_stats *stats);
+
+
 /** 
   * 对 hashmap 生成调试信息
+  * 把 stat_hashmap 的结果打印到 stdout
   * @param map 
   */
 void debug_hashmap(struct hash_map *map);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* _UTIL_HASHMAP_H_ */
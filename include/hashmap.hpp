@@ -0,0 +1,395 @@
+#ifndef _UTIL_HASHMAP_HPP
+#define _UTIL_HASHMAP_HPP 1
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <utility>
+
+#include "hashmap.h"
+#include "rbtree.h"
+
+
+/**
+  * hash_map 的 C++17 模板版本，只需要包含这个头文件，
+  * 并链接 rbtree.c
+  *
+  * 桶、链表和红黑树与 HASHMAP_TYPE_CHAIN 完全相同，区别在于：
+  * 1. hash 和比较函数是模板参数，查找路径可以被完全内联，没有间接调用
+  * 2. key 和 value 按值保存在节点中，支持移动语义，不需要 val_t 和 memcpy
+  * 3. Eq 只需要判断是否相等，红黑树中 hash 相同的 key 不排序，
+  *    查找时两侧的子树都需要检查，参考 Java HashMap 的 TreeNode.find
+  *
+  *   HashMap<int, std::string> map;
+  *   map.put(1, "one");
+  *   std::string *p = map.get(1);
+  *
+  * 内存不足时抛出 std::bad_alloc，此时 HashMap 保持不变
+  * 不是线程安全的
+  */
+template <class K, class V, class Hash = std::hash<K>, class Eq = std::equal_to<K>>
+class HashMap
+{
+public:
+    explicit HashMap(size_t cap = HASHMAP_DEF_CAPACITY,
+        float load = HASHMAP_DEF_LOAD_FACTOR,
+        const Hash &hash = Hash(), const Eq &eq = Eq())
+        : tab_(nullptr), cap_(round(cap)), size_(0), load_(load),
+          hash_(hash), eq_(eq)
+    {
+        tab_ = new Bucket[cap_]();
+    }
+
+    HashMap(const HashMap&) = delete;
+    HashMap& operator=(const HashMap&) = delete;
+
+    /**
+      * 被移动之后的 HashMap 只能析构或者被重新赋值
+      */
+    HashMap(HashMap &&other) noexcept
+        : tab_(other.tab_), cap_(other.cap_), size_(other.size_),
+          load_(other.load_), hash_(std::move(other.hash_)), eq_(std::move(other.eq_))
+    {
+        other.tab_ = nullptr;
+        other.cap_ = other.size_ = 0;
+    }
+
+    HashMap& operator=(HashMap &&other) noexcept
+    {
+        if (this != &other) {
+            clear();
+            delete[] tab_;
+            tab_ = other.tab_;
+            cap_ = other.cap_;
+            size_ = other.size_;
+            load_ = other.load_;
+            hash_ = std::move(other.hash_);
+            eq_ = std::move(other.eq_);
+            other.tab_ = nullptr;
+            other.cap_ = other.size_ = 0;
+        }
+        return *this;
+    }
+
+    ~HashMap()
+    {
+        clear();
+        delete[] tab_;
+    }
+
+    size_t size() const { return size_; }
+
+    size_t capacity() const { return cap_; }
+
+    /**
+      * 根据 key 查找 value
+      * @return value 的地址，如果没找到，则返回 nullptr
+      * 它在 key 被移除或覆盖之前一直有效，扩容不会移动节点
+      */
+    template <class KK>
+    V* get(const KK &key)
+    {
+        Node *node = find(key, spread(hash_(key)));
+        return node ? &node->value : nullptr;
+    }
+
+    template <class KK>
+    const V* get(const KK &key) const
+    {
+        return const_cast<HashMap*>(this)->get(key);
+    }
+
+    /**
+      * 保存键值对，key 已经存在时只替换 value，不会重新分配节点
+      * @return 如果之前不存在 key，返回 true；否则返回 false
+      */
+    template <class KK, class VV>
+    bool put(KK &&key, VV &&val)
+    {
+        const size_t hash = spread(hash_(key));
+        Node *node = find(key, hash);
+        if (node != nullptr) {
+            node->value = std::forward<VV>(val);
+            return false;
+        }
+
+        node = new Node(hash, std::forward<KK>(key), std::forward<VV>(val));
+
+        Bucket &entry = tab_[hash & (cap_ - 1)];
+        if (is_tree(entry.rbtree)) {
+            if (! insert_tree(&entry.rbtree, node)) {
+                delete node;
+                throw std::bad_alloc();
+            }
+        }
+        else {
+            node->part = entry.rbtree;
+            entry.rbtree = node;
+        }
+        size_ ++;
+        if (++ entry.size >= HASHMAP_DEF_TREE_THRESHOLD && ! is_tree(entry.rbtree)) {
+            to_tree(&entry.rbtree);
+        }
+
+        if (size_ > (size_t) ((double) cap_ * load_) && cap_ < HASHMAP_MAX_CAPACITY) {
+            resize();
+        }
+        return true;
+    }
+
+    /**
+      * 移除 key
+      * @return 如果之前存在 key，返回 true；否则返回 false
+      */
+    template <class KK>
+    bool remove(const KK &key)
+    {
+        const size_t hash = spread(hash_(key));
+        Bucket &entry = tab_[hash & (cap_ - 1)];
+        Node *node;
+
+        if (is_tree(entry.rbtree)) {
+            if ((node = find_tree(rbtree_root(entry.rbtree), key, hash)) == nullptr)
+                return false;
+            remove_rbtree_node(&entry.rbtree, node_rblink(node));
+        }
+        else {
+            rb_node **link = &entry.rbtree;
+            for (; *link != nullptr; link = &(*link)->part) {
+                node = static_cast<Node*>(*link);
+                if (node->hash == hash && eq_(node->key, key))
+                    break;
+            }
+            if (*link == nullptr)
+                return false;
+            *link = node->part;
+        }
+
+        delete node;
+        size_ --;
+        if (-- entry.size <= HASHMAP_DEF_UNTREE_THRESHOLD && is_tree(entry.rbtree)) {
+            un_rbtree(&entry.rbtree);
+        }
+        return true;
+    }
+
+    /**
+      * 对每个键值对调用 fn(const K&, V&)，遍历期间不允许修改 HashMap
+      */
+    template <class F>
+    void for_each(F &&fn)
+    {
+        for (size_t i = 0; i < cap_; i++) {
+            rb_node *root = tab_[i].rbtree;
+            if (is_tree(root)) {
+                for (rb_node *p = first_rbtree(root); p != nullptr; p = next_rbtree(p))
+                    fn(static_cast<const K&>(static_cast<Node*>(p)->key), static_cast<Node*>(p)->value);
+            }
+            else {
+                for (rb_node *p = root; p != nullptr; p = p->part)
+                    fn(static_cast<const K&>(static_cast<Node*>(p)->key), static_cast<Node*>(p)->value);
+            }
+        }
+    }
+
+    void clear()
+    {
+        for (size_t i = 0; i < cap_; i++) {
+            Bucket &entry = tab_[i];
+            if (is_tree(entry.rbtree))
+                un_rbtree(&entry.rbtree);
+
+            rb_node *p = entry.rbtree, *next;
+            for (; p != nullptr; p = next) {
+                next = p->part;
+                delete static_cast<Node*>(p);
+            }
+            entry.size = 0;
+            entry.rbtree = nullptr;
+        }
+        size_ = 0;
+    }
+
+private:
+    /**
+      * 节点的 rb_node 部分和 C 版本相同，key 和 value 紧跟在后面
+      * rb_node 的 key 和 value 指向它们，以便和 C 的工具函数共用
+      * 桶转为红黑树时，和 C 版本一样另外分配 rb_link，节点本身不会移动
+      */
+    struct Node : rb_node
+    {
+        K key;
+        V value;
+
+        template <class KK, class VV>
+        Node(size_t h, KK &&k, VV &&v)
+            : rb_node(), key(std::forward<KK>(k)), value(std::forward<VV>(v))
+        {
+            rb_node::key = &key;
+            rb_node::value = &value;
+            rb_node::hash = h;
+            rb_node::part = nullptr;
+        }
+    };
+
+    /** 与 hashmap.c 中的 map_entry 相同 */
+    struct Bucket
+    {
+        size_t size;
+        rb_node *rbtree;
+    };
+
+    static bool is_tree(const rb_node *head)
+    {
+        return is_rbtree(head);
+    }
+
+    static size_t round(size_t n)
+    {
+        size_t cap = HASHMAP_DEF_CAPACITY;
+        if (n > HASHMAP_MAX_CAPACITY)
+            n = HASHMAP_MAX_CAPACITY;
+        while (cap < n)
+            cap <<= 1;
+        return cap;
+    }
+
+    /** 参考 hashmap.c 中的 spread_hash */
+    static size_t spread(size_t hash)
+    {
+#if SIZE_MAX > 0xffffffffu
+        hash ^= hash >> 32;
+#endif
+        hash ^= hash >> 16;
+        return hash;
+    }
+
+    template <class KK>
+    Node* find(const KK &key, size_t hash)
+    {
+        rb_node *p = tab_[hash & (cap_ - 1)].rbtree;
+        if (is_tree(p)) {
+            return find_tree(rbtree_root(p), key, hash);
+        }
+        for (; p != nullptr; p = p->part) {
+            Node *node = static_cast<Node*>(p);
+            if (node->hash == hash && eq_(node->key, key))
+                return node;
+        }
+        return nullptr;
+    }
+
+    /**
+      * 红黑树按 hash 排序，hash 相同的节点可能分布在两侧的子树中
+      */
+    template <class KK>
+    Node* find_tree(rb_link *p, const KK &key, size_t hash)
+    {
+        while (p != nullptr) {
+            if (hash < p->node->hash) {
+                p = p->left;
+            }
+            else if (hash > p->node->hash) {
+                p = p->right;
+            }
+            else {
+                Node *node = static_cast<Node*>(p->node);
+                if (eq_(node->key, key))
+                    return node;
+                if (p->left != nullptr && (node = find_tree(p->left, key, hash)) != nullptr)
+                    return node;
+                p = p->right;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+      * hash 相同时放到右边，因此中序遍历仍然按 hash 有序
+      * @return 分配 rb_link 失败时返回 false
+      */
+    static bool insert_tree(rb_node **head, rb_node *node)
+    {
+        rb_link *parent = nullptr, *p = rbtree_root(*head);
+        int left = 0;
+        while (p != nullptr) {
+            parent = p;
+            left = node->hash < p->node->hash;
+            p = left ? p->left : p->right;
+        }
+        return link_rbtree(head, parent, left, node) == 0;
+    }
+
+    /**
+      * 只按 hash 排序，hash 相同的节点保持原来的顺序
+      * 分配 rb_link 失败时仍然是链表，HashMap 可以继续使用
+      */
+    static void to_tree(rb_node **root)
+    {
+        size_t n = 0;
+        for (rb_node *p = *root; p != nullptr; p = p->part)
+            n ++;
+        *root = make_rbtree(sort_rblist(*root, nullptr), n, nullptr);
+    }
+
+    /**
+      * 参考 hashmap.c 中的 split_tree，拆分得到的链表有序，直接建树
+      */
+    static void split_tree(rb_node *head, Bucket &lo, Bucket &hi, size_t old_cap)
+    {
+        rb_link *spare = nullptr;
+        split_rbtree(head, old_cap, &lo.rbtree, &lo.size, &hi.rbtree, &hi.size, &spare);
+        if (lo.size >= HASHMAP_DEF_TREE_THRESHOLD)
+            lo.rbtree = make_rbtree(lo.rbtree, lo.size, &spare);
+        if (hi.size >= HASHMAP_DEF_TREE_THRESHOLD)
+            hi.rbtree = make_rbtree(hi.rbtree, hi.size, &spare);
+        free_rblinks(spare);
+    }
+
+    /**
+      * 参考 hashmap.c 中的 split_entry
+      * 分配新表失败时放弃扩容，HashMap 仍然可以继续使用
+      */
+    void resize()
+    {
+        const size_t old_cap = cap_;
+        Bucket *new_tab = new (std::nothrow) Bucket[old_cap << 1]();
+        if (new_tab == nullptr) {
+            return;
+        }
+
+        for (size_t i = 0; i < old_cap; i++) {
+            rb_node *p = tab_[i].rbtree, *next;
+            if (is_tree(p)) {
+                split_tree(p, new_tab[i], new_tab[i + old_cap], old_cap);
+                continue;
+            }
+
+            for (; p != nullptr; p = next) {
+                next = p->part;
+                Bucket &dst = new_tab[(p->hash & old_cap) ? i + old_cap : i];
+                p->part = dst.rbtree;
+                dst.rbtree = p;
+                dst.size ++;
+            }
+            if (new_tab[i].size >= HASHMAP_DEF_TREE_THRESHOLD)
+                to_tree(&new_tab[i].rbtree);
+            if (new_tab[i + old_cap].size >= HASHMAP_DEF_TREE_THRESHOLD)
+                to_tree(&new_tab[i + old_cap].rbtree);
+        }
+
+        delete[] tab_;
+        tab_ = new_tab;
+        cap_ = old_cap << 1;
+    }
+
+    Bucket *tab_;
+    size_t cap_;
+    size_t size_;
+    float load_;
+    Hash hash_;
+    Eq eq_;
+};
+
+#endif /* _UTIL_HASHMAP_HPP */
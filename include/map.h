@@ -3,11 +3,13 @@
 #ifndef _UTIL_MAP_H
 #define _UTIL_MAP_H 1
 
+#include <stddef.h>
+
 struct map_iterator
 {
     void *key;
     void *value;
-    int offset;
+    size_t offset;
     void *tag;
     int (*has_next)(struct map_iterator* iter, void* map);
 };
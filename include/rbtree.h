@@ -1,37 +1,168 @@
-
-
 #ifndef _UTIL_RBTREE_H
 #define _UTIL_RBTREE_H 1
 
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 enum
 {
     RB_RED = 0,
-    RB_BLK = 1,   
+    RB_BLK = 1,
 };
 
+/**
+  * 一个键值对，桶中的节点以 part 相连
+  * 节点本身不包含红黑树的指针，绝大多数节点只会位于很短的链表中；
+  * 桶转为红黑树时，才为每个节点另外分配一个 rb_link 作为树的节点，
+  * 因此 rb_node 不会被移动，key 和 value 的副本的地址保持不变
+  * 在红黑树中时，part 指向节点自己的 rb_link，参考 node_rblink
+  */
 struct rb_node
 {
     void *key;
     void *value;
-    int hash;
-    int color;
-    struct rb_node *left;
-    struct rb_node *right;
+    size_t hash;
+    /** 节点来自 slab 时，记录它的 size class */
+    unsigned char slab;
+    /** 不为 0 时，value 的副本之后是节点的定时器，参考 put_hashmap_ttl */
+    unsigned char ttl;
+    /** 开启 HASHMAP_FLAG_KEYCOPY 时，紧跟在节点后面的 key 副本的长度
+      * 否则为 0，key 指向调用者的内存
+      */
+    unsigned short key_c;
+    /** key 副本之后最多能保存多少字节的 value 副本 */
+    unsigned int val_c;
     struct rb_node *part;
 };
 
-void free_rbtree(struct rb_node *root);
+/**
+  * 红黑树的节点，指向它保存的 rb_node
+  * 和 Linux 的 rbtree 一样，父节点的地址和颜色保存在同一个字中：
+  * rb_link 至少按 8 字节对齐，地址的最低位总是 0，用来保存颜色
+  */
+struct rb_link
+{
+    uintptr_t parent_color;
+    struct rb_link *left;
+    struct rb_link *right;
+    struct rb_node *node;
+};
+
+/**
+  * 桶中的链表和红黑树共用一个 struct rb_node* 指针，
+  * 保存红黑树时，它是根节点的地址加 1，下面的函数中称为 head
+  */
+static inline int is_rbtree(const struct rb_node *head)
+{
+    return ((uintptr_t) head & 1) != 0;
+}
+
+static inline struct rb_link* rbtree_root(const struct rb_node *head)
+{
+    return (struct rb_link*) ((uintptr_t) head & ~(uintptr_t) 1);
+}
+
+static inline struct rb_node* rbtree_head(const struct rb_link *root)
+{
+    return root == NULL ? NULL : (struct rb_node*) ((uintptr_t) root | 1);
+}
+
+/** 红黑树中的节点对应的 rb_link */
+static inline struct rb_link* node_rblink(const struct rb_node *node)
+{
+    return (struct rb_link*) node->part;
+}
 
-struct rb_node* new_rb_node(const void *key, int hash, 
+/**
+  * 释放红黑树中所有的 rb_link 和 rb_node，rb_node 必须来自 malloc
+  */
+void free_rbtree(struct rb_node *head);
+
+void set_rb_node(struct rb_node *node, const void *key, size_t hash,
+    const void *val, size_t val_t);
+
+struct rb_node* new_rb_node(const void *key, size_t hash,
     const void *val, size_t val_t);
 
-struct rb_node* get_rbtree2(struct rb_node *root, 
-    const void *key, int hash, int (*cmp)(const void*, const void*));
+struct rb_node* get_rbtree2(struct rb_node *head,
+    const void *key, size_t hash, int (*cmp)(const void*, const void*));
 
-struct rb_node* put_rbtree(struct rb_node **root, 
+/**
+  * 把 new_node 插入红黑树，调用者保证其中没有相同的 key
+  * @return 完成返回 0，分配 rb_link 失败返回 -1，此时红黑树保持不变
+  */
+int put_rbtree(struct rb_node **head,
     struct rb_node *new_node, int (*cmp)(const void*, const void*));
 
-struct rb_node* remove_rbtree2(struct rb_node **root,
-    const void *key, int hash, int (*cmp)(const void*, const void*));
+/**
+  * 中序遍历的第一个节点，以及 node 的下一个节点
+  */
+struct rb_node* first_rbtree(struct rb_node *head);
+
+struct rb_node* next_rbtree(struct rb_node *node);
+
+struct rb_node* remove_rbtree2(struct rb_node **head,
+    const void *key, size_t hash, int (*cmp)(const void*, const void*));
+
+/**
+  * 为 node 分配 rb_link，挂到 parent 的左边 (left 不为 0) 或右边，然后重新平衡
+  * 查找插入位置由调用者完成，因此不需要比较函数
+  * parent 为 NULL 时，node 成为根节点
+  * @return 完成返回 0，分配失败返回 -1
+  */
+int link_rbtree(struct rb_node **head, struct rb_link *parent,
+    int left, struct rb_node *node);
+
+/**
+  * 从红黑树中移除已经找到的 link，并释放它
+  * @return link 保存的节点
+  */
+struct rb_node* remove_rbtree_node(struct rb_node **head, struct rb_link *link);
+
+/**
+  * 把红黑树拆成一条以 part 相连的链表，释放所有的 rb_link，节点的顺序不确定
+  */
+void un_rbtree(struct rb_node **head);
+
+/**
+  * 把以 part 相连的链表按 hash 排序，hash 相同时再使用 cmp 排序
+  * cmp 为 NULL 时只比较 hash，hash 相同的节点保持原来的顺序
+  * 自底向上的归并排序，不需要额外的内存
+  * @return 排序后的链表
+  */
+struct rb_node* sort_rblist(struct rb_node *head, int (*cmp)(const void*, const void*));
+
+/**
+  * 用已经排好序的、以 part 相连的 n 个节点建立红黑树
+  * 每次取中间的节点作为根，最深的一层涂红，其余涂黑，
+  * 不需要比较和旋转，耗时为 O(n)
+  *
+  * @param spare 不为 NULL 时，优先使用其中的 rb_link (以 left 相连)，不够时再分配
+  * @return 红黑树的 head；分配失败时返回原来的链表
+  */
+struct rb_node* make_rbtree(struct rb_node *head, size_t n, struct rb_link **spare);
+
+/**
+  * 按照 hash & bit 是否为 0，把红黑树拆成 lo 和 hi 两条以 part 相连的链表
+  * 中序遍历，因此两条链表仍然是有序的，可以直接交给 make_rbtree，
+  * 参考 Java HashMap 的 TreeNode.split
+  * 所有的 rb_link 以 left 相连放入 spare，供 make_rbtree 重复使用
+  */
+void split_rbtree(struct rb_node *head, size_t bit,
+    struct rb_node **lo, size_t *lo_n, struct rb_node **hi, size_t *hi_n,
+    struct rb_link **spare);
+
+/**
+  * 释放 split_rbtree 和 make_rbtree 剩下的 rb_link
+  */
+void free_rblinks(struct rb_link *spare);
+
+#ifdef __cplusplus
+}
+#endif
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,148 @@
+#ifndef _UTIL_SHARDMAP_H
+#define _UTIL_SHARDMAP_H 1
+
+#include <stddef.h>
+
+#include "hashmap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+  * sharded_hash_map 由 2^sm_bits 个互相独立的 hash_map 组成
+  *
+  * key 的 hash 混合之后，最高的 sm_bits 位选择分片，每个分片有自己的锁，
+  * 各自扩容，因此不同分片上的写者不会互相等待，单次扩容的停顿也只有
+  * 一个大 hashmap 的 1 / 2^sm_bits。分片内部仍然是普通的 hash_map，
+  * 不需要为并发改变任何代码路径
+  *
+  * 开启 SHARDMAP_FLAG_OWNED 时不加锁，由调用者保证每个分片只被一个线程访问，
+  * 例如按照 get_sharded_index 把请求分发给固定的线程
+  * 分片开启 HASHMAP_FLAG_RCU 时，get_sharded_hashmap 不加锁
+  *
+  * *注意* 如果 val_t 不是 0，get_sharded_hashmap 返回的副本可能被其它线程
+  * 对同一个 key 的 put 或 remove 释放，调用者需要自己保证没有这样的并发
+  */
+
+
+/**
+  * 分片数的上限是 2^SHARDMAP_MAX_BITS
+  */
+#define SHARDMAP_MAX_BITS       16
+
+/**
+  * 不使用分片的锁，参考上面的说明
+  */
+#define SHARDMAP_FLAG_OWNED     0x1
+
+
+struct hashmap_shard;
+
+
+struct sharded_hash_map {
+    /** 分片数为 2^sm_bits，不超过 SHARDMAP_MAX_BITS
+      * 必须在 set_sharded_hashmap 之前指定，此后不允许修改
+      */
+    unsigned int sm_bits;
+
+    /** 参考 SHARDMAP_FLAG_OWNED
+      * 必须在 set_sharded_hashmap 之前指定，此后不允许修改
+      */
+    unsigned int sm_flags;
+
+    /** 每个分片的配置，set_sharded_hashmap 把它复制给每个分片再初始化
+      * hm_hash 同时用来选择分片，hm_cap 是所有分片的总容量
+      */
+    struct hash_map sm_proto;
+
+    /** 所有的分片
+      * 它由系统自动维护
+      */
+    struct hashmap_shard *sm_shards;
+};
+
+
+/**
+  * 每个分片的统计，参考 stat_sharded_hashmap
+  */
+struct shard_stats {
+    struct hashmap_stats ss_map;
+
+    /** 加锁时锁已经被其它线程持有的次数 */
+    size_t ss_contended;
+};
+
+
+/**
+  * 初始化 sharded_hash_map，每个分片按照 sm_proto 调用 set_hashmap
+  * 此函数不是线程安全的
+  *
+  * @param dst 需要初始化的 sharded_hash_map 的指针
+  * 如果为空，将会使用 malloc 动态分配，这种情况下请记得回收
+  * @return 正常完成，返回 sharded_hash_map 的指针，出错返回 NULL
+  */
+struct sharded_hash_map* set_sharded_hashmap(struct sharded_hash_map *dst);
+
+
+/**
+  * 得到 key 所在的分片的下标，范围是 [0, 2^sm_bits)
+  */
+size_t get_sharded_index(struct sharded_hash_map *map, const void *key);
+
+
+/**
+  * 在 key 所在的分片中调用 put_hashmap，可以和其它操作并发
+  *
+  * @return 如果之前不存在 key，返回 0；否则返回 1
+  * 出错返回 -1
+  */
+int put_sharded_hashmap(struct sharded_hash_map *map, const void *key,
+  const void *val, size_t val_t);
+
+
+/**
+  * 在 key 所在的分片中调用 get_hashmap，可以和其它操作并发
+  *
+  * @return value 的地址，如果没找到，则返回 NULL
+  */
+void* get_sharded_hashmap(struct sharded_hash_map *map, const void *key);
+
+
+/**
+  * 在 key 所在的分片中调用 remove_hashmap，可以和其它操作并发
+  *
+  * @return 如果之前中不存在 key，返回 0；否则返回 1
+  * 出错返回 -1
+  */
+int remove_sharded_hashmap(struct sharded_hash_map *map, const void *key);
+
+
+/**
+  * 得到所有分片中键值对的数量之和
+  * 并发修改时，它只是一个近似值
+  */
+size_t get_sharded_hashmap_size(struct sharded_hash_map *map);
+
+
+/**
+  * 统计第 i 个分片，期间会持有这个分片的锁
+  *
+  * @return 完成返回 0，出错返回 -1
+  */
+int stat_sharded_hashmap(struct sharded_hash_map *map, size_t i,
+  struct shard_stats *stats);
+
+
+/**
+  * 释放所有的分片
+  * *注意* 调用时不能有其它线程正在访问它
+  */
+void free_sharded_hashmap(struct sharded_hash_map *map);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -119,4 +119,39 @@ void free_list(struct list *list)
     memset(list, 0, sizeof(struct list));
 }
 
+void link_list_head(struct list *list, struct list_node *node)
+{
+    node->prev = NULL;
+    node->next = list->ls_head;
+    if (list->ls_head == NULL)
+        list->ls_tail = node;
+    else
+        list->ls_head->prev = node;
+    list->ls_head = node;
+    list->ls_size ++;
+}
+
+void unlink_list(struct list *list, struct list_node *node)
+{
+    if (node->prev != NULL)
+        node->prev->next = node->next;
+    else
+        list->ls_head = node->next;
+    if (node->next != NULL)
+        node->next->prev = node->prev;
+    else
+        list->ls_tail = node->prev;
+    node->prev = node->next = NULL;
+    list->ls_size --;
+}
+
+void move_list_head(struct list *list, struct list_node *node)
+{
+    if (list->ls_head == node) {
+        return;
+    }
+    unlink_list(list, node);
+    link_list_head(list, node);
+}
+
 #endif
\ No newline at end of file
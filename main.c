@@ -6,21 +6,8 @@
 #include <string.h>
 
 #include "include/hashmap.h"
+#include "include/hash.h"
 
-int str_hash(const void *p)
-{
-    int hash = 0;
-    
-    for (char *str = (char*) p; *str != '\0'; str ++) {
-        hash = 31 * hash + *str;
-    }
-    return hash;
-}
-
-int str_cmp(const void *p1, const void *p2)
-{
-    return strcmp((char*) p1, (char*) p2);
-}
 
 static char *keys[] = {
     "Hello",
@@ -40,8 +27,8 @@ int main(int argc, char const *argv[])
 {
     struct hash_map map;
     memset(&map, 0, sizeof(map));
-    map.hm_cmp = str_cmp;
-    map.hm_hash = str_hash;
+    map.hm_cmp = hm_str_cmp;
+    map.hm_hash = hm_str_hash;
 
     assert(set_hashmap(&map));
 
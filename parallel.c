@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "private/parallel.h"
+
+struct parallel_task {
+    void (*fn)(void*, int, int);
+    void *arg;
+    int id;
+    int nthreads;
+};
+
+int parallel_threads(int nthreads)
+{
+    if (nthreads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = cpus > 0 ? (int) cpus : 1;
+    }
+    return nthreads < PARALLEL_MAX_THREADS ? nthreads : PARALLEL_MAX_THREADS;
+}
+
+static void* run_task(void *p)
+{
+    struct parallel_task *task = (struct parallel_task*) p;
+    task->fn(task->arg, task->id, task->nthreads);
+    return NULL;
+}
+
+void run_parallel(int nthreads, void (*fn)(void *arg, int id, int nthreads), void *arg)
+{
+    pthread_t threads[PARALLEL_MAX_THREADS];
+    struct parallel_task tasks[PARALLEL_MAX_THREADS];
+    int started, i;
+
+    for (started = 1; started < nthreads; started++) {
+        struct parallel_task *task = tasks + started;
+        task->fn = fn;
+        task->arg = arg;
+        task->id = started;
+        task->nthreads = nthreads;
+        if (pthread_create(threads + started, NULL, run_task, task) != 0) {
+            fprintf(stderr, "failed to create thread %d of %d\n", started, nthreads);
+            break;
+        }
+    }
+
+    fn(arg, 0, nthreads);
+    for (i = started; i < nthreads; i++) {
+        fn(arg, i, nthreads);
+    }
+    for (i = 1; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
@@ -0,0 +1,43 @@
+
+#ifndef _UTIL_EPOCH_H
+#define _UTIL_EPOCH_H 1
+
+#include <stddef.h>
+
+/**
+  * 基于 epoch 的延迟回收 (epoch-based reclamation)
+  * 
+  * 无锁的读者可能仍然持有已经从表中摘下的节点或旧表，因此
+  * 写者不能立即释放它们，而是调用 retire_epoch 放入当前线程的待回收链表。
+  * 读者在访问共享数据前后调用 enter_epoch 和 leave_epoch，
+  * 全局 epoch 只有在所有活跃的线程都观察到它之后才会前进。
+  * 在 epoch e 中摘下的内存，等全局 epoch 到达 e + 2 之后就不会再有人访问，
+  * 这时才真正调用回收函数
+  * 
+  * 每个线程第一次调用 enter_epoch 时会自动注册，线程退出时注销，
+  * 注销后的记录和它还没有回收的内存会交给之后注册的线程
+  * 注册时无法分配记录的线程共用一条记录，它们的临界区互相等待，但不会出错
+  */
+
+/**
+  * 进入临界区，之后读到的共享指针在 leave_epoch 之前都不会被释放
+  * 允许嵌套调用
+  */
+void enter_epoch(void);
+
+void leave_epoch(void);
+
+/**
+  * 延迟回收 ptr，等到所有可能看到它的线程都离开临界区后
+  * 调用 fn(ptr)，fn 为 NULL 时调用 free
+  * *注意* 必须在 ptr 对其它线程不可达之后才能调用
+  */
+void retire_epoch(void *ptr, void (*fn)(void*));
+
+/**
+  * 等待一个完整的宽限期，并回收当前线程所有的待回收内存
+  * 调用者不能处于临界区中
+  */
+void synchronize_epoch(void);
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef _UTIL_IMAGE_H
+#define _UTIL_IMAGE_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+  * save_hashmap 保存的文件格式，所有的整数都是本机字节序
+  *
+  *   image_header
+  *   uint64_t offset[cap + 1]      桶 i 的记录位于 [offset[i], offset[i + 1])
+  *   记录...                        同一个桶的记录连续存放
+  *
+  * 每条记录是 image_record，紧跟着 key 和 value，各自补齐到 8 字节
+  * 文件中只有相对于文件开头的偏移，没有指针，因此可以映射到任意地址，
+  * 加载时不需要解析或者修改
+  */
+
+#define IMAGE_MAGIC         "HMIMAGE"
+#define IMAGE_VERSION       1
+#define IMAGE_ENDIAN        0x01020304u
+
+/** value 为 NULL 的记录的 vlen */
+#define IMAGE_NULL_VALUE    0xffffffffu
+
+/** 写文件时的缓冲区大小 */
+#define IMAGE_WRITE_BUFFER  (64 * 1024)
+
+struct image_header {
+    char ih_magic[8];
+    uint32_t ih_version;
+
+    /** 写入 IMAGE_ENDIAN 和 sizeof(size_t)，用来拒绝其它平台保存的文件 */
+    uint32_t ih_endian;
+    uint32_t ih_word;
+
+    /** 保存时 hm_flags 中的 HASHMAP_FLAG_SEED，以及 hm_seed */
+    uint32_t ih_flags;
+    uint64_t ih_seed;
+
+    uint64_t ih_size;
+    uint64_t ih_cap;
+
+    /** 整个文件的长度 */
+    uint64_t ih_length;
+    uint64_t ih_reserved;
+};
+
+struct image_record {
+    uint64_t hash;
+    uint32_t klen;
+    uint32_t vlen;
+};
+
+/**
+  * 映射到内存中的文件
+  * 桶第一次被修改时，会被复制成普通的节点，im_thawed 中对应的位被置为 1
+  */
+struct map_image {
+    unsigned char *im_base;
+    size_t im_length;
+    size_t im_cap;
+    const uint64_t *im_off;
+
+    unsigned char *im_thawed;
+
+    /** 还没有被复制的桶的数量，为 0 时不再需要检查 im_thawed */
+    size_t im_left;
+};
+
+/**
+  * 写文件时使用的缓冲区，出错后之后的写入都会被忽略
+  */
+struct image_writer {
+    int iw_fd;
+    int iw_error;
+    size_t iw_used;
+    unsigned char iw_buf[IMAGE_WRITE_BUFFER];
+};
+
+static inline size_t image_pad(size_t n)
+{
+    return (n + 7) & ~(size_t) 7;
+}
+
+static inline size_t image_record_size(size_t klen, size_t vlen)
+{
+    return sizeof(struct image_record) + image_pad(klen) +
+        (vlen == IMAGE_NULL_VALUE ? 0 : image_pad(vlen));
+}
+
+static inline void* image_key(struct image_record *rec)
+{
+    return rec + 1;
+}
+
+static inline void* image_value(struct image_record *rec)
+{
+    if (rec->vlen == IMAGE_NULL_VALUE)
+        return NULL;
+    return (unsigned char*) (rec + 1) + image_pad(rec->klen);
+}
+
+/**
+  * 以 MAP_PRIVATE 的方式映射 path，并检查文件头
+  * 写入映射的内存只会复制对应的页，不会修改文件
+  * @param hdr 用于返回文件头
+  * @return 完成返回 0，出错返回 -1
+  */
+int open_image(struct map_image *img, const char *path, struct image_header *hdr);
+
+void close_image(struct map_image *img);
+
+/**
+  * 返回桶 b 中 rec 之后的记录，rec 为 NULL 时返回第一条
+  * 没有更多的记录，或者记录越界时返回 NULL
+  * 只检查访问到的记录，因此打开文件的耗时和文件的大小无关
+  */
+struct image_record* next_image(struct map_image *img, size_t b, struct image_record *rec);
+
+void write_image(struct image_writer *w, const void *p, size_t n);
+
+/**
+  * 写出缓冲区中剩余的内容
+  * @return 之前的写入全部成功返回 0，否则返回 -1
+  */
+int flush_image(struct image_writer *w);
+
+#endif
@@ -3,6 +3,8 @@
 #ifndef _UTIL_LIST_H
 #define _UTIL_LIST_H 1
 
+#include <stddef.h>
+
 
 struct list_node {
     void *value;
@@ -26,4 +28,18 @@ struct list_node* remove_list_tail(struct list *list);
 
 void free_list(struct list *list);
 
+/**
+  * 下面的函数不分配内存，node 由调用者嵌入在自己的结构体中，
+  * free_list 不能用于这样的链表
+  */
+
+/** 把 node 放到表头 */
+void link_list_head(struct list *list, struct list_node *node);
+
+/** 把 node 从链表中摘下 */
+void unlink_list(struct list *list, struct list_node *node);
+
+/** 把链表中的 node 移动到表头，O(1) */
+void move_list_head(struct list *list, struct list_node *node);
+
 #endif
\ No newline at end of file
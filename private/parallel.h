@@ -0,0 +1,25 @@
+#ifndef _UTIL_PARALLEL_H
+#define _UTIL_PARALLEL_H 1
+
+#include <stddef.h>
+
+/**
+  * 同时运行的线程数的上限
+  */
+#define PARALLEL_MAX_THREADS    64
+
+/**
+  * 把调用者指定的线程数调整到 [1, PARALLEL_MAX_THREADS]
+  * nthreads 不大于 0 时，使用在线的 CPU 数量
+  */
+int parallel_threads(int nthreads);
+
+/**
+  * 用 nthreads 个线程执行 fn(arg, id, nthreads)，id 从 0 到 nthreads - 1
+  * 调用者自己作为第 0 个线程，所有线程结束后才返回，
+  * 因此 fn 在返回前写入的内容对调用者都是可见的
+  * 创建线程失败时，剩下的 id 由调用者依次执行，fn 不需要处理这种情况
+  */
+void run_parallel(int nthreads, void (*fn)(void *arg, int id, int nthreads), void *arg);
+
+#endif
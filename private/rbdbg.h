@@ -15,22 +15,22 @@ void cat_node_map(struct rb_node *node)
         return;
     }
     else
-        printf("[i][%d, %s][%p]\n", i->hash, i->color == RB_BLK ? "BLK" : "RED", i);
+        printf("[i][%zu, %s][%p]\n", i->hash, i->color == RB_BLK ? "BLK" : "RED", i);
     
     if ((i = node->part) == NULL)
         printf("[p][0, NUL][NUL]\n");
     else
-        printf("[p][%d, %s][%p]\n", i->hash, i->color == RB_BLK ? "BLK" : "RED", i);
+        printf("[p][%zu, %s][%p]\n", i->hash, i->color == RB_BLK ? "BLK" : "RED", i);
     
     if ((i = node->left) == NULL)
         printf("[l][0, NUL][NUL]\n");
     else
-        printf("[l][%d, %s][%p]\n", i->hash, i->color == RB_BLK ? "BLK" : "RED", i);
+        printf("[l][%zu, %s][%p]\n", i->hash, i->color == RB_BLK ? "BLK" : "RED", i);
 
     if ((i = node->right) == NULL)
         printf("[r][0, NUL][NUL]\n");
     else
-        printf("[r][%d, %s][%p]\n", i->hash, i->color == RB_BLK ? "BLK" : "RED", i);
+        printf("[r][%zu, %s][%p]\n", i->hash, i->color == RB_BLK ? "BLK" : "RED", i);
 }
 */
 
@@ -63,7 +63,7 @@ static void cat_rbtree(struct rb_node *root)
             else {
                 // printf("[%d][%s][%X] ", node->hash, node->color == RB_RED ? 
                 //     "RED" : "BLK", (int) node);
-                printf("[%d][%s] ", node->hash, node->color == RB_RED ? "RED" : "BLK");
+                printf("[%zu][%s] ", node->hash, node->color == RB_RED ? "RED" : "BLK");
                 add_list_tail(next_list, node->left, 0);
                 add_list_tail(next_list, node->right, 0);
             }
@@ -117,7 +117,7 @@ static void do_test_rbtree(struct rb_node *node, struct list *list, int *blk, in
     /*
     for (list_node = list->ls_head; list_node; list_node = list_node->next) {
         e = (struct rb_node*) (list_node->value);
-        printf("%d[%s][%p]->", e->hash, e->color == RB_RED ? "RED" : "BLK", e);
+        printf("%zu[%s][%p]->", e->hash, e->color == RB_RED ? "RED" : "BLK", e);
     }
     printf("[NUL]\n");
 */
@@ -0,0 +1,76 @@
+
+#ifndef _UTIL_SLAB_H
+#define _UTIL_SLAB_H 1
+
+#include <stddef.h>
+
+/**
+  * 每次向系统申请的页的大小
+  * 同一个 size class 的内存块从页中连续地切分出来
+  */
+#define SLAB_PAGE_SIZE      (64 * 1024)
+
+/**
+  * size class 的数量，以及 slab 能分配的最大内存块
+  * 超过 SLAB_MAX_BLOCK 的内存块直接使用 malloc 分配，
+  * 但仍然由 slab 记录，以便一次性释放
+  */
+#define SLAB_CLASSES        32
+#define SLAB_MAX_BLOCK      1024
+
+/** 通过 malloc 分配的大内存块使用的 size class */
+#define SLAB_LARGE          0xff
+
+struct slab_page;
+struct slab_large;
+
+struct slab_class {
+    /** 已回收的内存块组成的单链表 */
+    void *free;
+
+    /** 当前页中还没有切分的部分 */
+    char *cur;
+    char *end;
+};
+
+struct hm_slab {
+    struct slab_class sl_cls[SLAB_CLASSES];
+
+    /** 申请过的所有页，以及所有的大内存块 */
+    struct slab_page *sl_pages;
+    struct slab_large *sl_large;
+
+    /** 占用的内存，包括页头和还没有切分的部分 */
+    size_t sl_bytes;
+};
+
+/**
+  * 分配一个至少 size 个字节的内存块
+  * @param cls 用于返回内存块的 size class，释放时需要提供
+  * @return 内存块的地址，出错返回 NULL
+  */
+void* alloc_slab(struct hm_slab *slab, size_t size, unsigned char *cls);
+
+/**
+  * 回收 alloc_slab 分配的内存块，放入对应 size class 的空闲链表
+  */
+void free_slab(struct hm_slab *slab, void *ptr, unsigned char cls);
+
+/**
+  * 得到 size class 对应的内存块的实际大小
+  * 对于 SLAB_LARGE，返回 0
+  */
+size_t slab_block_size(unsigned char cls);
+
+/**
+  * 把 src 的所有页、大内存块和空闲链表转交给 dst，之后 src 为空
+  * 由 dst 负责回收 src 分配过的内存块，用于把多个线程各自的 slab 合并到一起
+  */
+void merge_slab(struct hm_slab *dst, struct hm_slab *src);
+
+/**
+  * 一次性释放 slab 分配的所有内存块，slab 仍然可以继续使用
+  */
+void clear_slab(struct hm_slab *slab);
+
+#endif
@@ -0,0 +1,94 @@
+
+#ifndef _UTIL_SWISS_H
+#define _UTIL_SWISS_H 1
+
+#include <stddef.h>
+
+struct hash_map;
+struct hashmap_stats;
+
+/**
+  * 每组控制字节的数量，即一次 SSE2 比较能检查的 slot 个数
+  * 表的容量不允许比它小
+  */
+#define SWISS_GROUP_WIDTH   16
+
+/**
+  * 平铺在数组中的键值对
+  * 如果 val_t 不是 0，value 指向单独分配的副本，val_t 是副本的容量
+  */
+struct swiss_slot {
+    void *key;
+    void *value;
+    size_t val_t;
+    size_t hash;
+};
+
+/**
+  * 控制字节 ctrl[i] 描述了 slot[i] 的状态：
+  * 空、已删除，或者保存着 hash 的低 7 位
+  * ctrl 的长度是 capacity + SWISS_GROUP_WIDTH，
+  * 末尾克隆了前 SWISS_GROUP_WIDTH 个字节，这样从任意位置
+  * 都能一次读出完整的一组
+  */
+struct swiss_table {
+    signed char *ctrl;
+    struct swiss_slot *slot;
+
+    /** 在下次扩容之前，还能占用的空 slot 的数量
+      * *注意* 已删除的 slot 不会归还这个值
+      */
+    size_t left;
+};
+
+int set_swiss(struct hash_map *map);
+
+/**
+  * 预取 hash 对应的第一组控制字节和 slot，用于批量操作
+  */
+void prefetch_swiss(struct hash_map *map, size_t hash);
+
+void* get_swiss(struct hash_map *map, const void *key, size_t hash);
+
+int put_swiss(struct hash_map *map, const void *key, size_t hash,
+    const void *val, size_t val_t);
+
+int remove_swiss(struct hash_map *map, const void *key, size_t hash);
+
+/**
+  * 从 *offset 开始找到下一个被占用的 slot，并把它的下标保存到 *offset
+  * @return 没有更多的 slot 时返回 NULL
+  */
+struct swiss_slot* next_swiss(struct hash_map *map, size_t *offset);
+
+/**
+  * 访问所有理想位置 (hash 的高位 & mask) 为 home 的键值对
+  * 扩容后，它们的理想位置只可能是 home 的扩展，这保证了
+  * scan_hashmap 的游标在扩容后仍然有效
+  */
+void scan_swiss(struct hash_map *map, size_t home,
+    void (*fn)(void *key, void *value, void *arg), void *arg);
+
+/**
+  * 把表重建为 new_cap 的容量，可以扩大也可以缩小
+  * new_cap 放不下现有的键值对，或者新表分配失败时返回 -1，此时表保持不变
+  */
+int resize_swiss(struct hash_map *map, size_t new_cap);
+
+/**
+  * 使用 hash 重新计算所有 key 的 hash，并重建整张表，容量不变
+  * 新表分配失败时返回 -1，此时表保持不变
+  */
+int rehash_swiss(struct hash_map *map, size_t (*hash)(struct hash_map*, const void*));
+
+/**
+  * 填写 stat_hashmap 中和表的结构有关的部分
+  * hs_chain 统计的是每个 key 需要探测的组数
+  */
+void stat_swiss(struct hash_map *map, struct hashmap_stats *stats);
+
+void clear_swiss(struct hash_map *map);
+
+void free_swiss(struct hash_map *map);
+
+#endif
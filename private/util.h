@@ -0,0 +1,48 @@
+
+#ifndef _UTIL_UTIL_H
+#define _UTIL_UTIL_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+  * 把 n 向上调整为 2 的整次幂
+  */
+static inline size_t round_capacity(size_t n)
+{
+    n --;
+    n |= n >> 1;
+    n |= n >> 2;
+    n |= n >> 4;
+    n |= n >> 8;
+    n |= n >> 16;
+#if SIZE_MAX > 0xffffffffu
+    n |= n >> 32;
+#endif
+    return n + 1;
+}
+
+/**
+  * hashcode 的高位和低位相异或，得到 hash
+  * 这样在容量较小时，高位的信息也能参与计算桶的下标
+  */
+static inline size_t spread_hash(size_t hash)
+{
+#if SIZE_MAX > 0xffffffffu
+    hash ^= hash >> 32;
+#endif
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/**
+  * 更新 hash_map.hm_ops 中的计数器，没有定义 HASHMAP_STATS 时什么也不做
+  */
+#ifdef HASHMAP_STATS
+#define _STAT_ADD(map, field, n) \
+    __atomic_fetch_add(&(map)->hm_ops.field, (size_t) (n), __ATOMIC_RELAXED)
+#else
+#define _STAT_ADD(map, field, n) ((void) 0)
+#endif
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef _UTIL_WHEEL_H
+#define _UTIL_WHEEL_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+  * 分层时间轮，参考 Linux 2.6 的 kernel/timer.c
+  * 每一层有 WHEEL_SLOTS 个槽，第 l 层的一个槽覆盖 WHEEL_SLOTS^l 个 tick，
+  * 更远的定时器放在 tw_overflow 中。第 0 层的指针转完一圈时，
+  * 把上一层的下一个槽拆下来重新放入 (cascade)，因此每个定时器最多被移动 WHEEL_LEVELS 次，
+  * 添加和删除都是 O(1)
+  *
+  * 6 位 5 层可以覆盖 2^30 个 tick，以毫秒为单位大约是 12 天
+  */
+#define WHEEL_BITS      6
+#define WHEEL_SLOTS     (1 << WHEEL_BITS)
+#define WHEEL_LEVELS    5
+
+/**
+  * 定时器，以 next 和 pprev 挂在槽中，类似 Linux 的 hlist，删除时不需要知道所在的槽
+  */
+struct hm_timer {
+    struct hm_timer *next;
+    struct hm_timer **pprev;
+    uint64_t expire;
+    /** 定时器所属的对象，由调用者使用 */
+    void *owner;
+};
+
+struct timer_wheel {
+    /** 下一个要处理的 tick，小于它的 tick 都已经处理过 */
+    uint64_t tw_now;
+
+    /** 定时器的数量 */
+    size_t tw_count;
+
+    /** 第 0 层中可能不为空的槽，用来跳过空槽
+      * 删除定时器时不会清除，访问到空槽时才清除
+      */
+    uint64_t tw_bits;
+
+    struct hm_timer *tw_slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    struct hm_timer *tw_overflow;
+};
+
+/**
+  * 初始化空的时间轮，now 为当前的 tick
+  */
+void set_wheel(struct timer_wheel *wheel, uint64_t now);
+
+/**
+  * 按照 timer->expire 放入时间轮，已经过期的定时器放在 tw_now 的槽中
+  */
+void add_timer(struct timer_wheel *wheel, struct hm_timer *timer);
+
+/**
+  * 从时间轮中删除定时器
+  */
+void del_timer(struct timer_wheel *wheel, struct hm_timer *timer);
+
+/**
+  * 把时间轮向 now 推进，取出一个 expire 不大于 now 的定时器
+  * 每次只取一个，调用者可以随时停下，下一次从停下的地方继续
+  * @return 到期的定时器，已经从时间轮中删除；没有时返回 NULL
+  */
+struct hm_timer* next_expired(struct timer_wheel *wheel, uint64_t now);
+
+#endif
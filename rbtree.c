@@ -1,88 +1,131 @@
-
-
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <memory.h>
 
 #include "include/rbtree.h"
 
 
-static void left_rotate(struct rb_node *node);
-static void right_rotate(struct rb_node *node);
-static void replace_node(struct rb_node *old_node, struct rb_node *new_node);
-static struct rb_node* balance_insert(struct rb_node *root, struct rb_node *new_node);
-static struct rb_node* balance_remove(struct rb_node *root, struct rb_node *old_node);
+static void left_rotate(struct rb_link *node);
+static void right_rotate(struct rb_link *node);
+static struct rb_link* balance_insert(struct rb_link *root, struct rb_link *new_node);
+static struct rb_link* balance_remove(struct rb_link *root, struct rb_link *old_node);
+
+/**
+  * 父节点的地址和颜色共用 parent_color，参考 Linux 的 rb_parent 和 rb_color
+  */
+static inline struct rb_link* rb_parent(const struct rb_link *node)
+{
+    return (struct rb_link*) (node->parent_color & ~(uintptr_t) 1);
+}
+
+static inline int rb_color(const struct rb_link *node)
+{
+    return (int) (node->parent_color & 1);
+}
+
+static inline void set_parent(struct rb_link *node, struct rb_link *parent)
+{
+    node->parent_color = (uintptr_t) parent | (node->parent_color & 1);
+}
+
+static inline void set_color(struct rb_link *node, int color)
+{
+    node->parent_color = (node->parent_color & ~(uintptr_t) 1) | (uintptr_t) color;
+}
+
+/** 为 node 分配 rb_link，新节点总是红色 */
+static struct rb_link* new_rb_link(struct rb_node *node, struct rb_link *parent)
+{
+    struct rb_link *link = (struct rb_link*) malloc(sizeof(struct rb_link));
+    if (link == NULL) {
+        return NULL;
+    }
+    link->parent_color = (uintptr_t) parent | RB_RED;
+    link->left = link->right = NULL;
+    link->node = node;
+    node->part = (struct rb_node*) link;
+    return link;
+}
 
+/**
+  * 红黑树先按 hash 排序，hash 相同时再使用 cmp_func 排序
+  * *注意* hash 是无符号数，不能直接相减
+  */
+static inline int cmp_node(size_t hash, const void *key, struct rb_node *node,
+    int (*cmp_func)(const void*, const void*))
+{
+    if (hash != node->hash)
+        return hash < node->hash ? -1 : 1;
+    return cmp_func(key, node->key);
+}
 
-struct rb_node* get_rbtree2(struct rb_node *root, 
-    const void *key, int hash, int (*cmp_func)(const void*, const void*))
+static struct rb_link* find_link(struct rb_link *root,
+    const void *key, size_t hash, int (*cmp_func)(const void*, const void*))
 {
-    struct rb_node *node = root;
+    struct rb_link *link = root;
     int cmp;
 
-    while (node) {
-        if ((cmp = hash - node->hash) == 0 && 
-            (cmp = cmp_func(key, node->key)) == 0) {
+    while (link) {
+        if ((cmp = cmp_node(hash, key, link->node, cmp_func)) == 0) {
             break;
         }
-        node = cmp < 0 ? node->left : node->right;
+        link = cmp < 0 ? link->left : link->right;
     }
-    return node;
+    return link;
+}
+
+struct rb_node* get_rbtree2(struct rb_node *head,
+    const void *key, size_t hash, int (*cmp_func)(const void*, const void*))
+{
+    struct rb_link *link = find_link(rbtree_root(head), key, hash, cmp_func);
+    return link ? link->node : NULL;
 }
 
 
-struct rb_node* put_rbtree(struct rb_node **root, 
+int put_rbtree(struct rb_node **head,
     struct rb_node *new_node, int (*cmp_func)(const void*, const void*))
 {
-    struct rb_node *node, *next = *root;
-
-    int cmp;
-    const int hash = new_node->hash;
+    struct rb_link *parent = NULL, *link = rbtree_root(*head);
+    const size_t hash = new_node->hash;
     const void *key = new_node->key;
+    int cmp = 0;
 
-    while ((node = next) != NULL) {
-        if ((cmp = hash - node->hash) == 0 && 
-            (cmp = cmp_func(key, node->key)) == 0) {
-            replace_node(node, new_node);
-            break;
-        }
-        else if (cmp < 0 && (next = node->left) == NULL)
-            node->left = new_node;
-        else if (cmp > 0 && (next = node->right) == NULL)
-            node->right = new_node;
-
-        new_node->part = node;
+    while (link != NULL) {
+        parent = link;
+        cmp = cmp_node(hash, key, link->node, cmp_func);
+        link = cmp < 0 ? link->left : link->right;
     }
-    *root = balance_insert(*root, new_node);
-    return node;
+    return link_rbtree(head, parent, cmp < 0, new_node);
 }
 
-static struct rb_node* balance_insert(struct rb_node *root, struct rb_node *new_node)
+static struct rb_link* balance_insert(struct rb_link *root, struct rb_link *new_node)
 {
-    struct rb_node *i = new_node, *p, *pp, *u;
+    struct rb_link *i = new_node, *p, *pp, *u;
 
     do {
         // 如果没有父节点，说明是根节点，直接涂黑
-        if ((p = i->part) == NULL) {
-            i->color = RB_BLK;
+        if ((p = rb_parent(i)) == NULL) {
+            set_color(i, RB_BLK);
             root = i;
             break;
         }
 
         // 如果父节点是黑色，直接怼上去
-        if (i->color == RB_BLK || p->color == RB_BLK) {
+        if (rb_color(i) == RB_BLK || rb_color(p) == RB_BLK) {
             break;
         }
 
         // 此时父节点是红色，而根节点是黑色，因此肯定存在祖父节点
-        pp = p->part;
+        pp = rb_parent(p);
         u = pp->left == p ? pp->right : pp->left;
 
         // 叔叔节点为红色，涂黑父节点和叔叔节点，
         // 涂红祖父节点，并以祖父节点为当前节点
-        if (u != NULL && u->color == RB_RED) {
-            p->color = u->color = RB_BLK;
-            pp->color = RB_RED;
+        if (u != NULL && rb_color(u) == RB_RED) {
+            set_color(p, RB_BLK);
+            set_color(u, RB_BLK);
+            set_color(pp, RB_RED);
             i = pp;
             continue;
         }
@@ -91,8 +134,8 @@ static struct rb_node* balance_insert(struct rb_node *root, struct rb_node *new_
             if (i == p->right) {
                 left_rotate(p);
                 i = p;
-                p = i->part;
-                pp = p->part;
+                p = rb_parent(i);
+                pp = rb_parent(p);
             }
             right_rotate(pp);
         }
@@ -100,13 +143,13 @@ static struct rb_node* balance_insert(struct rb_node *root, struct rb_node *new_
             if (i == p->left) {
                 right_rotate(p);
                 i = p;
-                p = i->part;
-                pp = p->part;
+                p = rb_parent(i);
+                pp = rb_parent(p);
             }
             left_rotate(pp);
         }
-        p->color = RB_BLK;
-        pp->color = RB_RED;
+        set_color(p, RB_BLK);
+        set_color(pp, RB_RED);
         i = p;
     } while (1);
 
@@ -114,21 +157,44 @@ static struct rb_node* balance_insert(struct rb_node *root, struct rb_node *new_
 }
 
 
-struct rb_node* remove_rbtree2(struct rb_node** root, 
-    const void *key, int hash, int (*cmp_func)(const void*, const void*))
+int link_rbtree(struct rb_node **head, struct rb_link *parent,
+    int left, struct rb_node *node)
 {
-    struct rb_node* old_node = get_rbtree2(*root, key, hash, cmp_func);
-    if (old_node == NULL) {
-        return NULL;
+    struct rb_link *root = rbtree_root(*head);
+    struct rb_link *link = new_rb_link(node, parent);
+    if (link == NULL) {
+        return -1;
     }
 
+    if (parent == NULL)
+        root = link;
+    else if (left)
+        parent->left = link;
+    else
+        parent->right = link;
+    *head = rbtree_head(balance_insert(root, link));
+    return 0;
+}
+
+struct rb_node* remove_rbtree2(struct rb_node **head,
+    const void *key, size_t hash, int (*cmp_func)(const void*, const void*))
+{
+    struct rb_link *link = find_link(rbtree_root(*head), key, hash, cmp_func);
+    return link ? remove_rbtree_node(head, link) : NULL;
+}
+
+struct rb_node* remove_rbtree_node(struct rb_node **head, struct rb_link *old_node)
+{
+    struct rb_link *root = rbtree_root(*head);
+    struct rb_node *data = old_node->node;
+
     // 找到替换节点
-    struct rb_node *node = NULL, *next;
+    struct rb_link *node = NULL, *next;
     if ((next = old_node->right) != NULL) {
         do {
             node = next;
         } while ((next = next->left) != NULL);
-    } 
+    }
     else if ((next = old_node->left) != NULL) {
         /** 只有左子节点时，可以根据红黑树的性质推理出：
           * old_node 为黑色
@@ -137,61 +203,66 @@ struct rb_node* remove_rbtree2(struct rb_node** root,
           */
         node = next;
     }
-    else if (old_node->part == NULL) {
+    else if (rb_parent(old_node) == NULL) {
         // 如果要移除根节点，直接返回
-        *root = NULL;
-        return old_node;
+        *head = NULL;
+        free(old_node);
+        data->part = NULL;
+        return data;
     }
     else {
         // 看来这个 old_node 也是个没有孩子的单身狗
         node = old_node;
     }
-    
-    *root = balance_remove(*root, node);
 
-    // 此时，old_node 可能移动到了根节点的位置
-    // 我们需要重置下根节点
-    if (old_node->part == NULL)
-        *root = node;
+    root = balance_remove(root, node);
 
     // 把替换节点从红黑树中移除
     // *注意* 此时替换节点是可能存在子节点的
-    if ((next = node->left) != NULL)
-        next->part = node->part;
-    else if ((next = node->right) != NULL)
-        next->part = node->part;
-    if (node->part == NULL) {
+    struct rb_link *parent = rb_parent(node);
+    if ((next = node->left) == NULL)
+        next = node->right;
+    if (next != NULL)
+        set_parent(next, parent);
+    if (parent == NULL)
+        root = next;
+    else if (parent->left == node)
+        parent->left = next;
+    else
+        parent->right = next;
+
+    /* rb_link 只是节点的容器，不需要像 Linux 那样移动替换节点，
+     * 把替换节点保存的 rb_node 交给 old_node，释放替换节点即可
+     */
+    if (node != old_node) {
+        old_node->node = node->node;
+        old_node->node->part = (struct rb_node*) old_node;
     }
-    else if (node->part->left == node)
-        node->part->left = next;
-    else 
-        node->part->right = next;
-    node->part = node->left = node->right = NULL;
-
-    // 用替换节点替换掉老节点
-    replace_node(old_node, node);
+    free(node);
 
-    return old_node;
+    *head = rbtree_head(root);
+    data->part = NULL;
+    return data;
 }
 
 
-static struct rb_node* balance_remove(struct rb_node *root, struct rb_node *old_node)
+static struct rb_link* balance_remove(struct rb_link *root, struct rb_link *old_node)
 {
-    struct rb_node *r = old_node, *p, *s, *sl, *sr;
+    struct rb_link *r = old_node, *p, *s, *sl, *sr;
     do {
         sl = sr = NULL;
         // 如果是红节点或根节点，直接返回
-        if (r->color == RB_RED || (p = r->part) == NULL) {
-            r->color = RB_BLK;
+        if (rb_color(r) == RB_RED || (p = rb_parent(r)) == NULL) {
+            set_color(r, RB_BLK);
             break;
         }
         // 当前节点为父节点的左节点
         if (p->left == r) {
-            if ((s = p->right) != NULL && s->color == RB_RED) {
-                s->color = RB_BLK;
-                p->color = RB_RED;
+            if ((s = p->right) != NULL && rb_color(s) == RB_RED) {
+                set_color(s, RB_BLK);
+                set_color(p, RB_RED);
                 left_rotate(p);
-                if (s->part == NULL)
+                if (rb_parent(s) == NULL)
                     root = s;
                 s = p->right;
             }
@@ -199,62 +270,61 @@ static struct rb_node* balance_remove(struct rb_node *root, struct rb_node *old_
             sr = s == NULL ? NULL : s->right;
 
             // 兄弟节点的右节点为黑色
-            if (sr == NULL || sr->color == RB_BLK) {
+            if (sr == NULL || rb_color(sr) == RB_BLK) {
                 // 左节点也是黑色
-                if (sl == NULL || sl->color == RB_BLK) {
-                    if (s != NULL) 
-                        s->color = RB_RED;
+                if (sl == NULL || rb_color(sl) == RB_BLK) {
+                    if (s != NULL)
+                        set_color(s, RB_RED);
                     r = p;
                     continue;
                 }
                 // 此时兄弟节点的左节点为红色，因此 s 不为空
-                s->color = RB_RED;
-                sl->color = RB_BLK;
+                set_color(s, RB_RED);
+                set_color(sl, RB_BLK);
                 right_rotate(s);
                 s = sl;
                 sl = s->left;
                 sr = s->right;
-                // cat_node_map(s);
             }
             // 此时兄弟节点的右节点为红色
-            s->color = p->color;
-            p->color = RB_BLK;
-            sr->color = RB_BLK;
+            set_color(s, rb_color(p));
+            set_color(p, RB_BLK);
+            set_color(sr, RB_BLK);
             left_rotate(p);
-            if (s->part == NULL)
+            if (rb_parent(s) == NULL)
                 root = s;
         }
         else {
-            if ((s = p->left) != NULL && s->color == RB_RED) {
-                s->color = RB_BLK;
-                p->color = RB_RED;
+            if ((s = p->left) != NULL && rb_color(s) == RB_RED) {
+                set_color(s, RB_BLK);
+                set_color(p, RB_RED);
                 right_rotate(p);
-                if (s->part == NULL)
+                if (rb_parent(s) == NULL)
                     root = s;
                 s = p->left;
             }
             sl = s == NULL ? NULL : s->left;
             sr = s == NULL ? NULL : s->right;
 
-            if (sl == NULL || sl->color == RB_BLK) {
-                if (sr == NULL || sr->color == RB_BLK) {
+            if (sl == NULL || rb_color(sl) == RB_BLK) {
+                if (sr == NULL || rb_color(sr) == RB_BLK) {
                     if (s != NULL)
-                        s->color = RB_RED;
+                        set_color(s, RB_RED);
                     r = p;
                     continue;
                 }
-                s->color = RB_RED;
-                sr->color = RB_BLK;
+                set_color(s, RB_RED);
+                set_color(sr, RB_BLK);
                 left_rotate(s);
                 s = sr;
                 sl = s->left;
                 sr = s->right;
             }
-            s->color = p->color;
-            p->color = RB_BLK;
-            sl->color = RB_BLK;
+            set_color(s, rb_color(p));
+            set_color(p, RB_BLK);
+            set_color(sl, RB_BLK);
             right_rotate(p);
-            if (s->part == NULL)
+            if (rb_parent(s) == NULL)
                 root = s;
         }
         break;
@@ -269,44 +339,44 @@ static struct rb_node* balance_remove(struct rb_node *root, struct rb_node *old_
   *        2     -->    1
   *       /              \
   *      3                3
-  * 
+  *
   * 需要改动的部分：
   * 0 的子节点，3 的父节点
   * 1 的右节点，1 的父节点
   * 2 的父节点，2 的左节点
   */
-static void left_rotate(struct rb_node *node) 
+static void left_rotate(struct rb_link *node)
 {
-    struct rb_node *one, *two, *three, *zero;
+    struct rb_link *one, *two, *three, *zero;
     one = node;
     two = node->right;
-    zero = node->part;
+    zero = rb_parent(node);
     three = two == NULL ? NULL : two->left;
 
     if (zero == NULL) {
     }
     else if (zero->left == one)
         zero->left = two;
-    else 
+    else
         zero->right = two;
 
     if (three != NULL)
-        three->part = one;
+        set_parent(three, one);
 
     if (two != NULL) {
-        two->part = zero;
+        set_parent(two, zero);
         two->left = one;
     }
 
     one->right = three;
-    one->part = two;
+    set_parent(one, two);
 }
 
-static void right_rotate(struct rb_node *node)
+static void right_rotate(struct rb_link *node)
 {
-    struct rb_node *one, *two, *three, *zero;
+    struct rb_link *one, *two, *three, *zero;
     two = node;
-    zero = node->part;
+    zero = rb_parent(node);
     one = node->left;
     three = one == NULL ? NULL : one->right;
 
@@ -314,47 +384,37 @@ static void right_rotate(struct rb_node *node)
     }
     else if (zero->left == two)
         zero->left = one;
-    else 
+    else
         zero->right = one;
 
     if (three != NULL)
-        three->part = two;
+        set_parent(three, two);
 
     if (one != NULL) {
-        one->part = zero;
+        set_parent(one, zero);
         one->right = two;
     }
-    two->part = one;
-    two->left = three; 
+    set_parent(two, one);
+    two->left = three;
 }
 
 
-static void replace_node(struct rb_node *old_node, struct rb_node *new_node)
+void set_rb_node(struct rb_node *node, const void *key,
+    size_t hash, const void *val, size_t val_t)
 {
-    if (new_node != NULL) {
-        new_node->part = old_node->part;
-        new_node->left = old_node->left;
-        new_node->right = old_node->right;
-        new_node->color = old_node->color;
-    }
-
-    struct rb_node *node;
+    node->value = val_t == 0 ? (void*) val : memcpy(node + 1, val, val_t);
 
-    if ((node = old_node->left) != NULL)
-        node->part = new_node;
-    if ((node = old_node->right) != NULL)
-        node->part = new_node;
-    if ((node = old_node->part) == NULL) {
-    }
-    else if (node->left == old_node)
-        node->left = new_node;
-    else 
-        node->right = new_node;
+    node->hash = hash;
+    node->key = (void*) key;
+    node->slab = 0;
+    node->ttl = 0;
+    node->key_c = 0;
+    node->val_c = val_t > UINT_MAX ? 0 : (unsigned int) val_t;
+    node->part = NULL;
 }
 
-
-struct rb_node* new_rb_node(const void *key, 
-    int hash, const void *val, size_t val_t)
+struct rb_node* new_rb_node(const void *key,
+    size_t hash, const void *val, size_t val_t)
 {
     const size_t mem_t = sizeof(struct rb_node) + val_t;
     struct rb_node *node = (struct rb_node*) malloc(mem_t);
@@ -362,24 +422,280 @@ struct rb_node* new_rb_node(const void *key,
         return NULL;
     }
 
-    node->value = val_t == 0 ? (void*) val : memcpy(node + 1, val, val_t);
+    set_rb_node(node, key, hash, val, val_t);
+    return node;
+}
 
-    node->hash = hash;
-    node->key = (void*) key;
-    node->color = RB_RED;
-    node->left = node->right = node->part = NULL;
+/**
+  * 中序遍历的第一个节点，即最左边的节点
+  */
+static struct rb_link* first_link(struct rb_link *link)
+{
+    if (link != NULL) {
+        while (link->left != NULL)
+            link = link->left;
+    }
+    return link;
+}
 
-    return node;
+/**
+  * 中序遍历的下一个节点
+  * 借助父节点回溯，不需要递归或额外的栈
+  */
+static struct rb_link* next_link(struct rb_link *link)
+{
+    if (link->right != NULL) {
+        return first_link(link->right);
+    }
+
+    struct rb_link *p;
+    while ((p = rb_parent(link)) != NULL && p->right == link) {
+        link = p;
+    }
+    return p;
 }
 
-void free_rbtree(struct rb_node *root)
+struct rb_node* first_rbtree(struct rb_node *head)
 {
-    if (root == NULL) {
-        return;
+    struct rb_link *link = first_link(rbtree_root(head));
+    return link ? link->node : NULL;
+}
+
+struct rb_node* next_rbtree(struct rb_node *node)
+{
+    struct rb_link *link = next_link(node_rblink(node));
+    return link ? link->node : NULL;
+}
+
+/**
+  * 后序遍历，把访问过的子树从父节点上摘下，不需要递归或额外的栈
+  * 返回以 part 相连的所有节点，rb_link 全部被释放
+  */
+static struct rb_node* drop_links(struct rb_link *link)
+{
+    struct rb_node *list = NULL;
+    struct rb_link *next;
+
+    while (link != NULL) {
+        if ((next = link->left) != NULL) {
+            link->left = NULL;
+            link = next;
+        }
+        else if ((next = link->right) != NULL) {
+            link->right = NULL;
+            link = next;
+        }
+        else {
+            next = rb_parent(link);
+            link->node->part = list;
+            list = link->node;
+            free(link);
+            link = next;
+        }
     }
-    free_rbtree(root->left);
-    free_rbtree(root->right);
-    free(root);
+    return list;
+}
+
+void free_rbtree(struct rb_node *head)
+{
+    struct rb_node *node = drop_links(rbtree_root(head)), *next;
+    for (; node != NULL; node = next) {
+        next = node->part;
+        free(node);
+    }
+}
+
+void un_rbtree(struct rb_node **head)
+{
+    *head = drop_links(rbtree_root(*head));
 }
 
+/**
+  * sort_rblist 的比较，cmp 为 NULL 时 hash 相同的节点视为相等
+  */
+static inline int cmp_list(struct rb_node *a, struct rb_node *b,
+    int (*cmp_func)(const void*, const void*))
+{
+    if (a->hash != b->hash)
+        return a->hash < b->hash ? -1 : 1;
+    return cmp_func == NULL ? 0 : cmp_func(a->key, b->key);
+}
+
+struct rb_node* sort_rblist(struct rb_node *head, int (*cmp_func)(const void*, const void*))
+{
+    struct rb_node *a, *b, *tail, **link;
+    size_t width, n, i;
+
+    for (width = 1; ; width <<= 1) {
+        struct rb_node *rest = head;
+        head = NULL;
+        link = &head;
+        n = 0;
+
+        // 每次合并两段长度为 width 的有序链表
+        while (rest != NULL) {
+            a = rest;
+            for (i = 1, tail = a; i < width && tail->part != NULL; i++)
+                tail = tail->part;
+            b = tail->part;
+            tail->part = NULL;
+
+            for (i = 1, tail = b; i < width && tail != NULL && tail->part != NULL; i++)
+                tail = tail->part;
+            if (tail != NULL) {
+                rest = tail->part;
+                tail->part = NULL;
+            }
+            else {
+                rest = NULL;
+            }
+
+            // a 排在前面，相等时先取 a，因此排序是稳定的
+            while (a != NULL && b != NULL) {
+                if (cmp_list(b, a, cmp_func) < 0) {
+                    *link = b;
+                    b = b->part;
+                }
+                else {
+                    *link = a;
+                    a = a->part;
+                }
+                link = &(*link)->part;
+            }
+            *link = a != NULL ? a : b;
+            while (*link != NULL)
+                link = &(*link)->part;
+            n ++;
+        }
+        if (n <= 1)
+            break;
+    }
+    return head;
+}
 
+/**
+  * 用 *list 开头的 n 个节点建立子树，消耗掉的节点从 *list 中移除，
+  * rb_link 从 *links 中取出
+  * 左子树取 (n - 1) / 2 个节点，因此所有的叶子都位于最深的两层
+  */
+static struct rb_link* make_subtree(struct rb_node **list, struct rb_link **links,
+    size_t n, int depth, int red, struct rb_link *parent)
+{
+    if (n == 0) {
+        return NULL;
+    }
+
+    const size_t left_n = (n - 1) / 2;
+    struct rb_link *left = make_subtree(list, links, left_n, depth + 1, red, NULL);
+    struct rb_link *link = *links;
+    struct rb_node *node = *list;
+
+    *links = link->left;
+    *list = node->part;
+
+    link->node = node;
+    node->part = (struct rb_node*) link;
+    link->parent_color = (uintptr_t) parent | (depth == red ? RB_RED : RB_BLK);
+    link->left = left;
+    if (left != NULL)
+        set_parent(left, link);
+    link->right = make_subtree(list, links, n - 1 - left_n, depth + 1, red, link);
+    return link;
+}
+
+struct rb_node* make_rbtree(struct rb_node *head, size_t n, struct rb_link **spare)
+{
+    struct rb_link *links = NULL, *link;
+    size_t got = 0;
+    int depth = 0;
+
+    if (n == 0) {
+        return NULL;
+    }
+
+    // 先准备好所有的 rb_link，分配失败时不修改链表
+    while (got < n && spare != NULL && (link = *spare) != NULL) {
+        *spare = link->left;
+        link->left = links;
+        links = link;
+        got ++;
+    }
+    for (; got < n; got++) {
+        if ((link = (struct rb_link*) malloc(sizeof(struct rb_link))) == NULL)
+            break;
+        link->left = links;
+        links = link;
+    }
+    if (got < n) {
+        if (spare != NULL) {
+            for (; links != NULL; links = link) {
+                link = links->left;
+                links->left = *spare;
+                *spare = links;
+            }
+        }
+        else {
+            free_rblinks(links);
+        }
+        return head;
+    }
+
+    // 最深的一层是 floor(log2(n))，它可能不满，涂红之后每条路径的黑色节点数相同
+    while ((n >> (depth + 1)) != 0) {
+        depth ++;
+    }
+
+    struct rb_link *root = make_subtree(&head, &links, n, 0, depth, NULL);
+    set_color(root, RB_BLK);
+    return rbtree_head(root);
+}
+
+void split_rbtree(struct rb_node *head, size_t bit,
+    struct rb_node **lo, size_t *lo_n, struct rb_node **hi, size_t *hi_n,
+    struct rb_link **spare)
+{
+    struct rb_node *lo_head = NULL, *lo_tail = NULL;
+    struct rb_node *hi_head = NULL, *hi_tail = NULL;
+    struct rb_link *link, *next;
+
+    /* 遍历期间 next_link 还需要已访问节点的 parent_color 和 right，
+     * 但不会再访问它们的 left，因此可以立即用 left 把它们串进 spare
+     */
+    *lo_n = *hi_n = 0;
+    for (link = first_link(rbtree_root(head)); link != NULL; link = next) {
+        struct rb_node *node = link->node;
+        next = next_link(link);
+        link->left = *spare;
+        *spare = link;
+
+        node->part = NULL;
+        if (node->hash & bit) {
+            if (hi_tail == NULL)
+                hi_head = node;
+            else
+                hi_tail->part = node;
+            hi_tail = node;
+            (*hi_n) ++;
+        }
+        else {
+            if (lo_tail == NULL)
+                lo_head = node;
+            else
+                lo_tail->part = node;
+            lo_tail = node;
+            (*lo_n) ++;
+        }
+    }
+
+    *lo = lo_head;
+    *hi = hi_head;
+}
+
+void free_rblinks(struct rb_link *spare)
+{
+    struct rb_link *next;
+    for (; spare != NULL; spare = next) {
+        next = spare->left;
+        free(spare);
+    }
+}
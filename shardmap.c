@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <memory.h>
+#include <pthread.h>
+
+#include "include/hashmap.h"
+#include "include/hash.h"
+#include "include/shardmap.h"
+
+#define _IS_OWNED(map)  ((map)->sm_flags & SHARDMAP_FLAG_OWNED)
+#define _SHARDS(map)    ((size_t) 1 << (map)->sm_bits)
+
+
+/**
+  * 分片，按 cache line 对齐，相邻分片的锁不会伪共享
+  */
+struct hashmap_shard {
+    pthread_mutex_t lock;
+
+    /** 加锁时需要等待的次数，只在持有锁时修改 */
+    size_t contended;
+
+    struct hash_map map;
+} __attribute__((aligned(64)));
+
+
+/**
+  * 混合之后取最高的 sm_bits 位
+  * 分片内部的桶使用 hash 的低位，同一个分片中的 key 最高位相同，不影响桶的分布
+  */
+static inline struct hashmap_shard* find_shard(struct sharded_hash_map *map, const void *key)
+{
+    if (map->sm_bits == 0)
+        return map->sm_shards;
+
+    const uint64_t hash = hash_mix64((uint64_t) map->sm_proto.hm_hash(key));
+    return map->sm_shards + (size_t) (hash >> (64 - map->sm_bits));
+}
+
+static inline void lock_shard(struct sharded_hash_map *map, struct hashmap_shard *shard)
+{
+    if (_IS_OWNED(map))
+        return;
+    if (pthread_mutex_trylock(&(shard->lock)) != 0) {
+        pthread_mutex_lock(&(shard->lock));
+        shard->contended ++;
+    }
+}
+
+static inline void unlock_shard(struct sharded_hash_map *map, struct hashmap_shard *shard)
+{
+    if (! _IS_OWNED(map))
+        pthread_mutex_unlock(&(shard->lock));
+}
+
+/** 释放前 n 个已经初始化的分片 */
+static void free_shards(struct sharded_hash_map *map, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        free_hashmap(&(map->sm_shards[i].map));
+        pthread_mutex_destroy(&(map->sm_shards[i].lock));
+    }
+    free(map->sm_shards);
+    map->sm_shards = NULL;
+}
+
+struct sharded_hash_map* set_sharded_hashmap(struct sharded_hash_map *dst)
+{
+    struct sharded_hash_map *map = dst;
+    size_t i, n;
+
+    if (map == NULL) {
+        if ((map = (struct sharded_hash_map*) malloc(sizeof(struct sharded_hash_map))) == NULL)
+            return NULL;
+        memset(map, 0, sizeof(struct sharded_hash_map));
+    }
+    if (map->sm_bits > SHARDMAP_MAX_BITS) {
+        fprintf(stderr, "sm_bits adjusted to %d\n", SHARDMAP_MAX_BITS);
+        map->sm_bits = SHARDMAP_MAX_BITS;
+    }
+
+    n = _SHARDS(map);
+    if (posix_memalign((void**) &(map->sm_shards), 64, sizeof(struct hashmap_shard) * n) != 0) {
+        fprintf(stderr, "failed to malloc %zu hashmap shards\n", n);
+        map->sm_shards = NULL;
+        goto fail;
+    }
+    memset(map->sm_shards, 0, sizeof(struct hashmap_shard) * n);
+
+    // hm_cap 是总容量，平均分给每个分片
+    for (i = 0; i < n; i++) {
+        struct hashmap_shard *shard = map->sm_shards + i;
+
+        shard->map = map->sm_proto;
+        shard->map.hm_cap = map->sm_proto.hm_cap >> map->sm_bits;
+        if (set_hashmap(&(shard->map)) == NULL)
+            break;
+        pthread_mutex_init(&(shard->lock), NULL);
+    }
+    if (i != n) {
+        free_shards(map, i);
+        goto fail;
+    }
+
+    // 选择分片时使用和分片相同的 hash 函数，包括 set_hashmap 选择的默认函数
+    map->sm_proto.hm_hash = map->sm_shards[0].map.hm_hash;
+    map->sm_proto.hm_cmp = map->sm_shards[0].map.hm_cmp;
+    return map;
+
+fail:
+    if (dst == NULL)
+        free(map);
+    return NULL;
+}
+
+size_t get_sharded_index(struct sharded_hash_map *map, const void *key)
+{
+    return (size_t) (find_shard(map, key) - map->sm_shards);
+}
+
+int put_sharded_hashmap(struct sharded_hash_map *map, const void *key,
+  const void *val, size_t val_t)
+{
+    struct hashmap_shard *shard = find_shard(map, key);
+
+    lock_shard(map, shard);
+    const int ret = put_hashmap(&(shard->map), key, val, val_t);
+    unlock_shard(map, shard);
+    return ret;
+}
+
+void* get_sharded_hashmap(struct sharded_hash_map *map, const void *key)
+{
+    struct hashmap_shard *shard = find_shard(map, key);
+
+    // RCU 的读者不需要和写者互斥
+    if (shard->map.hm_flags & HASHMAP_FLAG_RCU)
+        return get_hashmap(&(shard->map), key);
+
+    lock_shard(map, shard);
+    void *value = get_hashmap(&(shard->map), key);
+    unlock_shard(map, shard);
+    return value;
+}
+
+int remove_sharded_hashmap(struct sharded_hash_map *map, const void *key)
+{
+    struct hashmap_shard *shard = find_shard(map, key);
+
+    lock_shard(map, shard);
+    const int ret = remove_hashmap(&(shard->map), key);
+    unlock_shard(map, shard);
+    return ret;
+}
+
+size_t get_sharded_hashmap_size(struct sharded_hash_map *map)
+{
+    size_t size = 0;
+    for (size_t i = 0, n = _SHARDS(map); i < n; i++)
+        size += __atomic_load_n(&(map->sm_shards[i].map.hm_size), __ATOMIC_RELAXED);
+    return size;
+}
+
+int stat_sharded_hashmap(struct sharded_hash_map *map, size_t i,
+  struct shard_stats *stats)
+{
+    if (i >= _SHARDS(map)) {
+        fprintf(stderr, "shard %zu out of range [0, %zu)\n", i, _SHARDS(map));
+        return -1;
+    }
+
+    struct hashmap_shard *shard = map->sm_shards + i;
+    lock_shard(map, shard);
+    const int ret = stat_hashmap(&(shard->map), &(stats->ss_map));
+    stats->ss_contended = shard->contended;
+    unlock_shard(map, shard);
+    return ret;
+}
+
+void free_sharded_hashmap(struct sharded_hash_map *map)
+{
+    if (map->sm_shards != NULL)
+        free_shards(map, _SHARDS(map));
+}
+
+#undef _IS_OWNED
+#undef _SHARDS
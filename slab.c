@@ -0,0 +1,190 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+
+#include "private/slab.h"
+
+/**
+  * 页头，紧接着就是切分出来的内存块
+  */
+struct slab_page {
+    struct slab_page *next;
+    size_t size;
+};
+
+/**
+  * 大内存块的头部，所有的大内存块组成一个双向链表
+  */
+struct slab_large {
+    struct slab_large *prev;
+    struct slab_large *next;
+    size_t size;
+    size_t reserved;    // 保证内存块按 16 字节对齐
+};
+
+/**
+  * size class 的划分：
+  * [8, 128]     步长为 8，共 16 个
+  * (128, 512]   步长为 32，共 12 个
+  * (512, 1024]  步长为 128，共 4 个
+  * 这样每个内存块浪费的空间不会超过 1/4
+  */
+static int size_class(size_t size)
+{
+    if (size <= 128)
+        return size == 0 ? 0 : (size + 7) / 8 - 1;
+    if (size <= 512)
+        return 16 + (size - 128 + 31) / 32 - 1;
+    if (size <= SLAB_MAX_BLOCK)
+        return 28 + (size - 512 + 127) / 128 - 1;
+    return -1;
+}
+
+size_t slab_block_size(unsigned char cls)
+{
+    if (cls < 16)
+        return (cls + 1) * 8;
+    if (cls < 28)
+        return 128 + (cls - 15) * 32;
+    if (cls < SLAB_CLASSES)
+        return 512 + (cls - 27) * 128;
+    return 0;
+}
+
+static void* alloc_large(struct hm_slab *slab, size_t size)
+{
+    struct slab_large *large = (struct slab_large*) malloc(sizeof(struct slab_large) + size);
+    if (large == NULL) {
+        return NULL;
+    }
+    large->prev = NULL;
+    large->size = sizeof(struct slab_large) + size;
+    large->next = slab->sl_large;
+    if (slab->sl_large != NULL)
+        slab->sl_large->prev = large;
+    slab->sl_large = large;
+    slab->sl_bytes += large->size;
+    return large + 1;
+}
+
+void* alloc_slab(struct hm_slab *slab, size_t size, unsigned char *cls)
+{
+    int i = size_class(size);
+    if (i < 0) {
+        *cls = SLAB_LARGE;
+        return alloc_large(slab, size);
+    }
+
+    struct slab_class *sc = slab->sl_cls + i;
+    const size_t block = slab_block_size(i);
+    void *ptr;
+
+    *cls = (unsigned char) i;
+
+    // 优先复用已回收的内存块
+    if ((ptr = sc->free) != NULL) {
+        sc->free = *((void**) ptr);
+        return ptr;
+    }
+
+    // 当前页已经用完，申请新的一页
+    if (sc->cur == NULL || sc->cur + block > sc->end) {
+        struct slab_page *page = (struct slab_page*) malloc(SLAB_PAGE_SIZE);
+        if (page == NULL) {
+            return NULL;
+        }
+        page->next = slab->sl_pages;
+        page->size = block;
+        slab->sl_pages = page;
+        slab->sl_bytes += SLAB_PAGE_SIZE;
+
+        sc->cur = (char*) (page + 1);
+        sc->end = (char*) page + SLAB_PAGE_SIZE;
+    }
+
+    ptr = sc->cur;
+    sc->cur += block;
+    return ptr;
+}
+
+void free_slab(struct hm_slab *slab, void *ptr, unsigned char cls)
+{
+    if (ptr == NULL) {
+        return;
+    }
+
+    if (cls == SLAB_LARGE) {
+        struct slab_large *large = ((struct slab_large*) ptr) - 1;
+        if (large->prev != NULL)
+            large->prev->next = large->next;
+        else
+            slab->sl_large = large->next;
+        if (large->next != NULL)
+            large->next->prev = large->prev;
+        slab->sl_bytes -= large->size;
+        free(large);
+        return;
+    }
+
+    struct slab_class *sc = slab->sl_cls + cls;
+    *((void**) ptr) = sc->free;
+    sc->free = ptr;
+}
+
+void merge_slab(struct hm_slab *dst, struct hm_slab *src)
+{
+    if (src->sl_pages != NULL) {
+        struct slab_page *tail = src->sl_pages;
+        while (tail->next != NULL)
+            tail = tail->next;
+        tail->next = dst->sl_pages;
+        dst->sl_pages = src->sl_pages;
+    }
+
+    if (src->sl_large != NULL) {
+        struct slab_large *tail = src->sl_large;
+        while (tail->next != NULL)
+            tail = tail->next;
+        tail->next = dst->sl_large;
+        if (dst->sl_large != NULL)
+            dst->sl_large->prev = tail;
+        dst->sl_large = src->sl_large;
+    }
+
+    for (int i = 0; i < SLAB_CLASSES; i++) {
+        struct slab_class *d = dst->sl_cls + i, *s = src->sl_cls + i;
+        if (s->free != NULL) {
+            void *tail = s->free;
+            while (*((void**) tail) != NULL)
+                tail = *((void**) tail);
+            *((void**) tail) = d->free;
+            d->free = s->free;
+        }
+        // 两边都有没切分完的页时，只保留一个，另一个的剩余部分随页一起释放
+        if (d->cur == NULL || (s->cur != NULL && s->end - s->cur > d->end - d->cur)) {
+            d->cur = s->cur;
+            d->end = s->end;
+        }
+    }
+
+    dst->sl_bytes += src->sl_bytes;
+    memset(src, 0, sizeof(struct hm_slab));
+}
+
+void clear_slab(struct hm_slab *slab)
+{
+    struct slab_page *page, *next_page;
+    for (page = slab->sl_pages; page != NULL; page = next_page) {
+        next_page = page->next;
+        free(page);
+    }
+
+    struct slab_large *large, *next_large;
+    for (large = slab->sl_large; large != NULL; large = next_large) {
+        next_large = large->next;
+        free(large);
+    }
+
+    memset(slab, 0, sizeof(struct hm_slab));
+}
@@ -0,0 +1,509 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "include/hashmap.h"
+#include "private/swiss.h"
+#include "private/util.h"
+
+/**
+  * 控制字节的取值
+  * 非负数表示 slot 已被占用，值为 hash 的低 7 位
+  */
+enum
+{
+    CTRL_EMPTY = -128,
+    CTRL_DELETED = -2,
+};
+
+/** hash 的高位用于定位组，低 7 位存放在控制字节中 */
+#define _H1(hash) ((hash) >> 7)
+#define _H2(hash) ((signed char) ((hash) & 0x7f))
+
+#define _MALLOC(t, n) ((t*) malloc(sizeof(t) * (n)))
+
+static int rebuild_swiss(struct hash_map *map, size_t new_cap,
+    size_t (*hash)(struct hash_map*, const void*));
+
+/**
+  * 下面三个函数各自检查一组 (16 个) 控制字节，
+  * 返回一个位掩码，第 i 位为 1 表示第 i 个字节满足条件
+  */
+#ifdef __SSE2__
+
+static inline unsigned int match_byte(const signed char *ctrl, signed char h2)
+{
+    __m128i group = _mm_loadu_si128((const __m128i*) ctrl);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), group));
+}
+
+static inline unsigned int match_empty(const signed char *ctrl)
+{
+    return match_byte(ctrl, CTRL_EMPTY);
+}
+
+static inline unsigned int match_free(const signed char *ctrl)
+{
+    // EMPTY 和 DELETED 都小于 -1，而被占用的 slot 都是非负数
+    __m128i group = _mm_loadu_si128((const __m128i*) ctrl);
+    return _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), group));
+}
+
+#else
+
+static inline unsigned int match_byte(const signed char *ctrl, signed char h2)
+{
+    unsigned int mask = 0;
+    for (int i = 0; i < SWISS_GROUP_WIDTH; i++) {
+        if (ctrl[i] == h2)
+            mask |= 1u << i;
+    }
+    return mask;
+}
+
+static inline unsigned int match_empty(const signed char *ctrl)
+{
+    return match_byte(ctrl, CTRL_EMPTY);
+}
+
+static inline unsigned int match_free(const signed char *ctrl)
+{
+    unsigned int mask = 0;
+    for (int i = 0; i < SWISS_GROUP_WIDTH; i++) {
+        if (ctrl[i] < -1)
+            mask |= 1u << i;
+    }
+    return mask;
+}
+
+#endif
+
+static inline void set_ctrl(struct swiss_table *t, size_t cap,
+    size_t i, signed char h)
+{
+    t->ctrl[i] = h;
+    // 同步修改末尾的克隆字节
+    if (i < SWISS_GROUP_WIDTH)
+        t->ctrl[cap + i] = h;
+}
+
+static size_t growth_limit(struct hash_map *map, size_t cap)
+{
+    // 达到最大容量之后不再扩容，允许占满除最后一个之外的所有 slot
+    if (cap >= map->hm_max)
+        return cap - 1;
+
+    size_t limit = (size_t) ((double) cap * map->hm_load);
+    // 至少保留一个空 slot，否则查找无法终止
+    return limit >= cap ? cap - 1 : limit;
+}
+
+/**
+  * 沿着探测序列查找 key 所在的 slot
+  * 每次检查一整组控制字节，遇到空 slot 说明 key 不存在
+  * 组的步长按三角数增长，由于容量是 2 的整次幂，这能保证覆盖整张表
+  * @param groups 不为 NULL 时，用于返回探测过的组数
+  * @return key 所在的 slot，没找到返回 NULL
+  */
+static struct swiss_slot* find_swiss(struct hash_map *map, const void *key, size_t hash,
+    size_t *groups)
+{
+    struct swiss_table *t = map->hm_swiss;
+    const size_t mask = map->hm_cap - 1;
+    const signed char h2 = _H2(hash);
+    size_t pos = _H1(hash) & mask, step = 0;
+
+    while (1) {
+        const signed char *group = t->ctrl + pos;
+        unsigned int m = match_byte(group, h2);
+
+        if (groups != NULL)
+            ++ *groups;
+        while (m != 0) {
+            struct swiss_slot *slot = t->slot + ((pos + __builtin_ctz(m)) & mask);
+            if (slot->hash == hash && map->hm_cmp(key, slot->key) == 0) {
+                return slot;
+            }
+            m &= m - 1;
+        }
+        if (match_empty(group) != 0) {
+            return NULL;
+        }
+        step += SWISS_GROUP_WIDTH;
+        pos = (pos + step) & mask;
+    }
+}
+
+/**
+  * 沿着探测序列找到第一个空的或已删除的 slot
+  */
+static size_t find_free(struct swiss_table *t, size_t cap, size_t hash)
+{
+    const size_t mask = cap - 1;
+    size_t pos = _H1(hash) & mask, step = 0;
+    unsigned int m;
+
+    while ((m = match_free(t->ctrl + pos)) == 0) {
+        step += SWISS_GROUP_WIDTH;
+        pos = (pos + step) & mask;
+    }
+    return (pos + __builtin_ctz(m)) & mask;
+}
+
+int set_swiss(struct hash_map *map)
+{
+    if (map->hm_max < SWISS_GROUP_WIDTH)
+        map->hm_max = SWISS_GROUP_WIDTH;
+    if (map->hm_cap < SWISS_GROUP_WIDTH)
+        map->hm_cap = SWISS_GROUP_WIDTH;
+
+    struct swiss_table *t = _MALLOC(struct swiss_table, 1);
+    if (t == NULL) {
+        return -1;
+    }
+    memset(t, 0, sizeof(struct swiss_table));
+
+    const size_t cap = map->hm_cap;
+    t->ctrl = _MALLOC(signed char, cap + SWISS_GROUP_WIDTH);
+    t->slot = _MALLOC(struct swiss_slot, cap);
+    if (t->ctrl == NULL || t->slot == NULL) {
+        free(t->ctrl);
+        free(t->slot);
+        free(t);
+        return -1;
+    }
+    memset(t->ctrl, CTRL_EMPTY, cap + SWISS_GROUP_WIDTH);
+    t->left = growth_limit(map, cap);
+
+    map->hm_swiss = t;
+    return 0;
+}
+
+void prefetch_swiss(struct hash_map *map, size_t hash)
+{
+    struct swiss_table *t = map->hm_swiss;
+    const size_t pos = _H1(hash) & (map->hm_cap - 1);
+
+    __builtin_prefetch(t->ctrl + pos);
+    __builtin_prefetch(t->slot + pos);
+}
+
+void* get_swiss(struct hash_map *map, const void *key, size_t hash)
+{
+#ifdef HASHMAP_STATS
+    size_t groups = 0;
+    struct swiss_slot *slot = find_swiss(map, key, hash, &groups);
+    _STAT_ADD(map, probes, groups);
+#else
+    struct swiss_slot *slot = find_swiss(map, key, hash, NULL);
+#endif
+    return slot ? slot->value : NULL;
+}
+
+/**
+  * 为 value 分配副本，val_t 为 0 时直接使用 val
+  */
+static void* copy_value(const void *val, size_t val_t)
+{
+    if (val_t == 0) {
+        return (void*) val;
+    }
+    void *value = malloc(val_t);
+    if (value == NULL) {
+        fprintf(stderr, "failed to malloc value copy\n");
+        return NULL;
+    }
+    return memcpy(value, val, val_t);
+}
+
+int put_swiss(struct hash_map *map, const void *key, size_t hash,
+    const void *val, size_t val_t)
+{
+    struct swiss_table *t = map->hm_swiss;
+    struct swiss_slot *slot = find_swiss(map, key, hash, NULL);
+    void *value;
+
+    if (slot != NULL) {
+        /* 更新已存在的 key
+         * 旧的副本放得下新的 value 时，直接原地覆盖
+         */
+        if (val_t != 0 && val_t <= slot->val_t) {
+            slot->key = (void*) key;
+            memmove(slot->value, val, val_t);
+            return 1;
+        }
+        if ((value = copy_value(val, val_t)) == NULL) {
+            return -1;
+        }
+        if (slot->val_t != 0)
+            free(slot->value);
+        slot->key = (void*) key;
+        slot->value = value;
+        slot->val_t = val_t;
+        return 1;
+    }
+
+    if ((value = copy_value(val, val_t)) == NULL) {
+        return -1;
+    }
+
+    size_t cap = map->hm_cap;
+    size_t idx = find_free(t, cap, hash);
+
+    if (t->left == 0 && t->ctrl[idx] != CTRL_DELETED) {
+        /* 没有可用的空 slot 了
+         * 如果是已删除的 slot 太多，原地重建即可，否则扩容为 2 倍
+         */
+        size_t new_cap = cap;
+        if (map->hm_size + 1 > growth_limit(map, cap) / 2) {
+            if (cap < map->hm_max)
+                new_cap = cap << 1;
+            else if (map->hm_size + 1 >= cap) {
+                fprintf(stderr, "swiss table is full at %zu capacity\n", cap);
+                if (val_t != 0) free(value);
+                return -1;
+            }
+        }
+        if (resize_swiss(map, new_cap) == -1) {
+            fprintf(stderr, "failed to resize swiss table to %zu capacity\n", new_cap);
+            if (val_t != 0) free(value);
+            return -1;
+        }
+        t = map->hm_swiss;
+        cap = map->hm_cap;
+        idx = find_free(t, cap, hash);
+    }
+
+    if (t->ctrl[idx] == CTRL_EMPTY)
+        t->left --;
+    set_ctrl(t, cap, idx, _H2(hash));
+
+    slot = t->slot + idx;
+    slot->key = (void*) key;
+    slot->value = value;
+    slot->val_t = val_t;
+    slot->hash = hash;
+
+    map->hm_size ++;
+    return 0;
+}
+
+int remove_swiss(struct hash_map *map, const void *key, size_t hash)
+{
+    struct swiss_slot *slot = find_swiss(map, key, hash, NULL);
+    if (slot == NULL) {
+        return 0;
+    }
+
+    struct swiss_table *t = map->hm_swiss;
+    const size_t cap = map->hm_cap, mask = cap - 1;
+    const size_t i = slot - t->slot;
+
+    if (slot->val_t != 0)
+        free(slot->value);
+
+    /** 如果 i 前后连续被占用的 slot 不足一组，
+      * 那么任何探测序列都不可能越过 i 继续向后查找，
+      * 此时可以直接标记为空，否则只能标记为已删除
+      */
+    size_t before = (i - SWISS_GROUP_WIDTH) & mask;
+    unsigned int empty_after = match_empty(t->ctrl + i);
+    unsigned int empty_before = match_empty(t->ctrl + before);
+    int never_full = empty_before && empty_after &&
+        __builtin_ctz(empty_after) + (__builtin_clz(empty_before) - 16) < SWISS_GROUP_WIDTH;
+
+    if (never_full) {
+        set_ctrl(t, cap, i, CTRL_EMPTY);
+        t->left ++;
+    }
+    else {
+        set_ctrl(t, cap, i, CTRL_DELETED);
+    }
+    map->hm_size --;
+    return 1;
+}
+
+int resize_swiss(struct hash_map *map, size_t new_cap)
+{
+    if (growth_limit(map, new_cap) < map->hm_size)
+        return -1;
+    if (rebuild_swiss(map, new_cap, NULL) == -1)
+        return -1;
+    map->hm_resizes ++;
+    return 0;
+}
+
+/**
+  * 把所有的键值对搬到容量为 new_cap 的新表
+  * hash 不为 NULL 时，使用它重新计算每个 key 的 hash
+  */
+static int rebuild_swiss(struct hash_map *map, size_t new_cap,
+    size_t (*hash)(struct hash_map*, const void*))
+{
+    struct swiss_table *t = map->hm_swiss;
+    const size_t old_cap = map->hm_cap;
+
+    signed char *ctrl = _MALLOC(signed char, new_cap + SWISS_GROUP_WIDTH);
+    struct swiss_slot *slot = _MALLOC(struct swiss_slot, new_cap);
+    if (ctrl == NULL || slot == NULL) {
+        free(ctrl);
+        free(slot);
+        return -1;
+    }
+    memset(ctrl, CTRL_EMPTY, new_cap + SWISS_GROUP_WIDTH);
+
+    struct swiss_table new_t = { ctrl, slot, 0 };
+
+    /* 把所有被占用的 slot 搬到新表，已删除的 slot 会被丢弃 */
+    for (size_t i = 0; i < old_cap; i++) {
+        if (t->ctrl[i] < 0)
+            continue;
+        struct swiss_slot *old_slot = t->slot + i;
+        size_t h = hash ? hash(map, old_slot->key) : old_slot->hash;
+        size_t idx = find_free(&new_t, new_cap, h);
+        set_ctrl(&new_t, new_cap, idx, _H2(h));
+        slot[idx] = *old_slot;
+        slot[idx].hash = h;
+    }
+
+    free(t->ctrl);
+    free(t->slot);
+    t->ctrl = ctrl;
+    t->slot = slot;
+    t->left = growth_limit(map, new_cap) - map->hm_size;
+    map->hm_cap = new_cap;
+    return 0;
+}
+
+struct swiss_slot* next_swiss(struct hash_map *map, size_t *offset)
+{
+    struct swiss_table *t = map->hm_swiss;
+    const size_t cap = map->hm_cap;
+    size_t i = *offset;
+
+    /* 一次检查一组控制字节，跳过空的和已删除的 slot
+     * *注意* 末尾的克隆字节不能算在内
+     */
+    while (i < cap) {
+        unsigned int full = ~match_free(t->ctrl + i) & 0xffff;
+        if (cap - i < SWISS_GROUP_WIDTH)
+            full &= (1u << (cap - i)) - 1;
+        if (full != 0) {
+            i += __builtin_ctz(full);
+            __builtin_prefetch(t->slot + i + 4);
+            *offset = i;
+            return t->slot + i;
+        }
+        i += SWISS_GROUP_WIDTH;
+    }
+    *offset = cap;
+    return NULL;
+}
+
+void scan_swiss(struct hash_map *map, size_t home,
+    void (*fn)(void *key, void *value, void *arg), void *arg)
+{
+    struct swiss_table *t = map->hm_swiss;
+    const size_t mask = map->hm_cap - 1;
+    size_t pos = home & mask, step = 0;
+
+    /* 和查找一样沿着探测序列前进，直到遇到包含空 slot 的组
+     * 只访问“理想位置”恰好是 home 的键值对
+     */
+    while (1) {
+        const signed char *group = t->ctrl + pos;
+        unsigned int full = ~match_free(group) & 0xffff;
+
+        while (full != 0) {
+            struct swiss_slot *slot = t->slot + ((pos + __builtin_ctz(full)) & mask);
+            if ((_H1(slot->hash) & mask) == (home & mask))
+                fn(slot->key, slot->value, arg);
+            full &= full - 1;
+        }
+        if (match_empty(group) != 0) {
+            return;
+        }
+        step += SWISS_GROUP_WIDTH;
+        pos = (pos + step) & mask;
+    }
+}
+
+int rehash_swiss(struct hash_map *map, size_t (*hash)(struct hash_map*, const void*))
+{
+    return rebuild_swiss(map, map->hm_cap, hash);
+}
+
+void stat_swiss(struct hash_map *map, struct hashmap_stats *stats)
+{
+    struct swiss_table *t = map->hm_swiss;
+    const size_t cap = map->hm_cap, mask = cap - 1;
+    size_t hit = 0, miss = 0;
+
+    stats->hs_cap = cap;
+    stats->hs_table_bytes = cap * sizeof(struct swiss_slot) + cap + SWISS_GROUP_WIDTH;
+
+    /* 对每个 key，沿着探测序列数出需要探测几组才能到达它的 slot */
+    for (size_t i = 0; i < cap; i++) {
+        if (t->ctrl[i] < 0)
+            continue;
+        const struct swiss_slot *slot = t->slot + i;
+        size_t pos = _H1(slot->hash) & mask, step = 0, groups = 1;
+        while (((i - pos) & mask) >= SWISS_GROUP_WIDTH) {
+            step += SWISS_GROUP_WIDTH;
+            pos = (pos + step) & mask;
+            groups ++;
+        }
+        hit += groups;
+        stats->hs_used ++;
+        stats->hs_chain[groups < HASHMAP_STATS_CHAIN ? groups : HASHMAP_STATS_CHAIN - 1] ++;
+        stats->hs_value_bytes += slot->val_t;
+    }
+
+    /* 不存在的 key 可能从任意位置开始探测，直到遇到包含空 slot 的组 */
+    for (size_t i = 0; i < cap; i++) {
+        size_t pos = i, step = 0;
+        miss ++;
+        while (match_empty(t->ctrl + pos) == 0) {
+            step += SWISS_GROUP_WIDTH;
+            pos = (pos + step) & mask;
+            miss ++;
+        }
+    }
+
+    stats->hs_hit_probe = stats->hs_used ? (double) hit / stats->hs_used : 0;
+    stats->hs_miss_probe = (double) miss / cap;
+}
+
+void clear_swiss(struct hash_map *map)
+{
+    struct swiss_table *t = map->hm_swiss;
+    const size_t cap = map->hm_cap;
+
+    for (size_t i = 0; i < cap; i++) {
+        if (t->ctrl[i] >= 0 && t->slot[i].val_t != 0)
+            free(t->slot[i].value);
+    }
+    memset(t->ctrl, CTRL_EMPTY, cap + SWISS_GROUP_WIDTH);
+    t->left = growth_limit(map, cap);
+    map->hm_size = 0;
+}
+
+void free_swiss(struct hash_map *map)
+{
+    struct swiss_table *t = map->hm_swiss;
+
+    clear_swiss(map);
+    free(t->ctrl);
+    free(t->slot);
+    free(t);
+    map->hm_swiss = NULL;
+}
+
+#undef _MALLOC
+#undef _H1
+#undef _H2
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/hashmap.h"
+
+/**
+  * get_hashmap_batch 在红黑树的桶上的测试
+  * hash 只取 key 除以 TREE_KEYS 的商，每 TREE_KEYS 个 key 落在同一个桶中，
+  * 只插入其中的偶数，桶会转为红黑树，奇数在同一棵树中查找但不存在
+  * 批量查找的结果必须和 get_hashmap 一致
+  * 使用 -fsanitize=undefined 编译，参考 Makefile 中的 test 目标
+  */
+
+#define TREE_KEYS   64
+#define N           (TREE_KEYS * 256)
+
+static size_t keys[N * 2];
+static const void *kp[N * 2];
+static void *out[N * 2];
+
+static size_t tree_hash(const void *key)
+{
+    return *((const size_t*) key) / TREE_KEYS;
+}
+
+static int tree_cmp(const void *one, const void *two)
+{
+    const size_t a = *((const size_t*) one), b = *((const size_t*) two);
+    return a < b ? -1 : a > b;
+}
+
+static int run(unsigned int flags)
+{
+    struct hash_map map;
+    struct hashmap_stats stats;
+    size_t i, found;
+    int ret = 0;
+
+    memset(&map, 0, sizeof(map));
+    map.hm_hash = tree_hash;
+    map.hm_cmp = tree_cmp;
+    map.hm_flags = flags;
+    if (set_hashmap(&map) == NULL) {
+        fprintf(stderr, "failed to init hashmap\n");
+        return -1;
+    }
+
+    for (i = 0; i < N * 2; i += 2) {
+        put_hashmap(&map, kp[i], kp[i], sizeof(size_t));
+    }
+    stat_hashmap(&map, &stats);
+    if (stats.hs_trees == 0) {
+        fprintf(stderr, "flags %#x: no bucket was treeified\n", flags);
+        ret = -1;
+    }
+
+    found = get_hashmap_batch(&map, kp, N * 2, out);
+    if (found != N) {
+        fprintf(stderr, "flags %#x: batch found %zu keys, expected %d\n", flags, found, N);
+        ret = -1;
+    }
+    for (i = 0; i < N * 2; i++) {
+        void *value = get_hashmap(&map, kp[i]);
+        if (out[i] != value || (value != NULL && *((size_t*) value) != keys[i])) {
+            fprintf(stderr, "flags %#x: batch result of key %zu differs\n", flags, keys[i]);
+            ret = -1;
+            break;
+        }
+    }
+
+    free_hashmap(&map);
+    return ret;
+}
+
+int main(void)
+{
+    for (size_t i = 0; i < N * 2; i++) {
+        keys[i] = i;
+        kp[i] = keys + i;
+    }
+
+    if (run(0) != 0 || run(HASHMAP_FLAG_INCREMENTAL) != 0 || run(HASHMAP_FLAG_SLAB) != 0)
+        return 1;
+    printf("batch_tree ok\n");
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "include/hashmap.h"
+#include "include/hash.h"
+
+/**
+  * HASHMAP_FLAG_RCU 的读者和写者的压力测试
+  * 写者反复插入大量 key 让表扩大，再全部移除，期间设置了 hm_min_load，
+  * 读者不断查找一组始终存在的 key，必须每次都能找到
+  * 开启 HASHMAP_FLAG_RCU 时不允许缩容，否则读者可能把旧的容量用在新的小表上而越界
+  */
+
+#define STABLE      1024
+#define CHURN       (1 << 16)
+#define ROUNDS      8
+#define READERS     3
+
+static size_t keys[STABLE + CHURN];
+static struct hash_map map;
+static int done;
+static int failed;
+
+static void* read_loop(void *arg)
+{
+    (void) arg;
+    while (! __atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+        for (size_t i = 0; i < STABLE; i++) {
+            size_t *value = (size_t*) get_hashmap(&map, keys + i);
+            if (value != keys + i) {
+                fprintf(stderr, "reader lost key %zu\n", i);
+                __atomic_store_n(&failed, 1, __ATOMIC_RELAXED);
+                return NULL;
+            }
+        }
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    pthread_t readers[READERS];
+    size_t i, cap = 0;
+    int r, ret = 0;
+
+    for (i = 0; i < STABLE + CHURN; i++) {
+        keys[i] = i;
+    }
+
+    memset(&map, 0, sizeof(map));
+    map.hm_hash = hm_int64_hash;
+    map.hm_cmp = hm_int64_cmp;
+    map.hm_flags = HASHMAP_FLAG_RCU;
+    map.hm_min_load = 0.1f;
+    if (set_hashmap(&map) == NULL) {
+        fprintf(stderr, "failed to init hashmap\n");
+        return 1;
+    }
+    if (map.hm_min_load != 0) {
+        fprintf(stderr, "hm_min_load is not reset under HASHMAP_FLAG_RCU\n");
+        ret = 1;
+    }
+    // set_hashmap 之后再设置，确认移除时也不会自动缩容
+    map.hm_min_load = 0.1f;
+
+    for (i = 0; i < STABLE; i++) {
+        put_hashmap(&map, keys + i, keys + i, 0);
+    }
+    for (r = 0; r < READERS; r++) {
+        pthread_create(readers + r, NULL, read_loop, NULL);
+    }
+
+    for (r = 0; r < ROUNDS && ! __atomic_load_n(&failed, __ATOMIC_RELAXED); r++) {
+        for (i = STABLE; i < STABLE + CHURN; i++)
+            put_hashmap(&map, keys + i, keys + i, 0);
+        if (cap == 0)
+            cap = map.hm_cap;
+        for (i = STABLE; i < STABLE + CHURN; i++)
+            remove_hashmap(&map, keys + i);
+        if (map.hm_cap != cap) {
+            fprintf(stderr, "capacity changed from %zu to %zu\n", cap, map.hm_cap);
+            ret = 1;
+            break;
+        }
+    }
+    if (shrink_hashmap(&map) != -1) {
+        fprintf(stderr, "shrink_hashmap succeeded under HASHMAP_FLAG_RCU\n");
+        ret = 1;
+    }
+
+    __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+    for (r = 0; r < READERS; r++) {
+        pthread_join(readers[r], NULL);
+    }
+    if (failed || get_hashmap_size(&map) != STABLE)
+        ret = 1;
+
+    free_hashmap(&map);
+    if (ret == 0)
+        printf("rcu_shrink ok\n");
+    return ret;
+}
@@ -0,0 +1,124 @@
+#include <memory.h>
+
+#include "private/wheel.h"
+
+#define _MASK (WHEEL_SLOTS - 1)
+#define _INDEX(t, l) (((t) >> (WHEEL_BITS * (l))) & _MASK)
+
+void set_wheel(struct timer_wheel *wheel, uint64_t now)
+{
+    memset(wheel, 0, sizeof(struct timer_wheel));
+    wheel->tw_now = now;
+}
+
+/** 把定时器挂到槽的头部 */
+static inline void link_timer(struct hm_timer **slot, struct hm_timer *timer)
+{
+    timer->next = *slot;
+    if (*slot != NULL)
+        (*slot)->pprev = &(timer->next);
+    timer->pprev = slot;
+    *slot = timer;
+}
+
+/**
+  * 选择定时器所在的层：到期时间和 tw_now 的距离小于 WHEEL_SLOTS^(l+1) 时放在第 l 层，
+  * 槽的下标取自到期时间本身，而不是距离，这样 cascade 时不需要重新计算
+  */
+static void place_timer(struct timer_wheel *wheel, struct hm_timer *timer)
+{
+    const uint64_t expire = timer->expire < wheel->tw_now ? wheel->tw_now : timer->expire;
+    const uint64_t delta = expire - wheel->tw_now;
+
+    for (int l = 0; l < WHEEL_LEVELS; l++) {
+        if (delta < (uint64_t) 1 << (WHEEL_BITS * (l + 1))) {
+            if (l == 0)
+                wheel->tw_bits |= (uint64_t) 1 << _INDEX(expire, 0);
+            link_timer(&(wheel->tw_slots[l][_INDEX(expire, l)]), timer);
+            return;
+        }
+    }
+    link_timer(&(wheel->tw_overflow), timer);
+}
+
+void add_timer(struct timer_wheel *wheel, struct hm_timer *timer)
+{
+    place_timer(wheel, timer);
+    wheel->tw_count ++;
+}
+
+void del_timer(struct timer_wheel *wheel, struct hm_timer *timer)
+{
+    *(timer->pprev) = timer->next;
+    if (timer->next != NULL)
+        timer->next->pprev = timer->pprev;
+    timer->next = NULL;
+    timer->pprev = NULL;
+    wheel->tw_count --;
+}
+
+/** 拆下一个槽，重新放入其中的每个定时器，它们会落到更低的层 */
+static void cascade_slot(struct timer_wheel *wheel, struct hm_timer **slot)
+{
+    struct hm_timer *timer = *slot, *next;
+
+    *slot = NULL;
+    for (; timer != NULL; timer = next) {
+        next = timer->next;
+        place_timer(wheel, timer);
+    }
+}
+
+/**
+  * tw_now 刚好转完第 0 层的一圈，依次 cascade 更高层的当前槽
+  * 某一层的下标不为 0 时，更高的层还没有转完，不需要继续
+  */
+static void cascade(struct timer_wheel *wheel)
+{
+    for (int l = 1; l < WHEEL_LEVELS; l++) {
+        const size_t i = _INDEX(wheel->tw_now, l);
+        cascade_slot(wheel, &(wheel->tw_slots[l][i]));
+        if (i != 0)
+            return;
+    }
+    cascade_slot(wheel, &(wheel->tw_overflow));
+}
+
+/** 推进到 tick，经过一圈的边界时 cascade */
+static inline void move_to(struct timer_wheel *wheel, uint64_t tick)
+{
+    wheel->tw_now = tick;
+    if (_INDEX(tick, 0) == 0)
+        cascade(wheel);
+}
+
+struct hm_timer* next_expired(struct timer_wheel *wheel, uint64_t now)
+{
+    while (wheel->tw_now <= now) {
+        if (wheel->tw_count == 0) {
+            // 没有定时器，不需要 cascade
+            wheel->tw_now = now + 1;
+            return NULL;
+        }
+
+        const size_t i = _INDEX(wheel->tw_now, 0);
+        struct hm_timer *timer = wheel->tw_slots[0][i];
+        if (timer != NULL) {
+            del_timer(wheel, timer);
+            return timer;
+        }
+
+        // 在 tw_bits 中找到这一圈中下一个可能不为空的槽，否则直接到下一圈的开头
+        wheel->tw_bits &= ~((uint64_t) 1 << i);
+        const uint64_t rest = wheel->tw_bits & (~(uint64_t) 0 << i);
+        const uint64_t next = rest != 0 ?
+            wheel->tw_now - i + (uint64_t) __builtin_ctzll(rest) :
+            (wheel->tw_now | _MASK) + 1;
+
+        move_to(wheel, next <= now ? next : now + 1);
+    }
+    return NULL;
+}
+
+#undef _MASK
+#undef _INDEX